@@ -0,0 +1,116 @@
+#include "Checkpoint.h"
+#include <fstream>
+#include <iostream>
+#include <cstring>
+#include <cstdio>
+#include <vector>
+#include <string>
+#include <random>
+
+static const char coverMagic[8] = { 'W', 'E', 'A', 'V', 'E', 'C', 'V', 'R' };
+static const int32_t coverVersion = 1;
+
+CheckpointKey &CheckpointKey::add(const void *data, size_t len)
+{
+    const unsigned char *p = (const unsigned char *)data;
+    for (size_t i = 0; i < len; i++)
+    {
+        hash_ ^= p[i];
+        hash_ *= 1099511628211ULL;
+    }
+    return *this;
+}
+
+CheckpointKey &CheckpointKey::add(const std::string &s)
+{
+    add(int(s.size()));
+    return add(s.data(), s.size());
+}
+
+bool CheckpointKey::addFile(const std::string &filename)
+{
+    std::ifstream ifs(filename, std::ios::binary);
+    if (!ifs)
+        return false;
+    std::vector<char> buf(1 << 16);
+    while (ifs)
+    {
+        ifs.read(buf.data(), buf.size());
+        add(buf.data(), ifs.gcount());
+    }
+    return ifs.eof();
+}
+
+std::string CheckpointKey::hex() const
+{
+    char buf[17];
+    std::snprintf(buf, sizeof(buf), "%016llx", (unsigned long long)hash_);
+    return std::string(buf);
+}
+
+bool writeCheckpoint(const std::string &filename, const std::function<bool(const std::string &)> &write)
+{
+    // batch jobs sharing a checkpoint directory may save the same stage at once, so each writes its own temporary file
+    std::string tmpname = filename + ".tmp" + std::to_string(std::random_device()());
+    if (!write(tmpname))
+    {
+        std::remove(tmpname.c_str());
+        std::cerr << "Couldn't write checkpoint " << filename << std::endl;
+        return false;
+    }
+    std::remove(filename.c_str());
+    if (std::rename(tmpname.c_str(), filename.c_str()) != 0)
+    {
+        std::remove(tmpname.c_str());
+        std::cerr << "Couldn't move checkpoint into place at " << filename << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool saveCoverCheckpoint(const std::string &filename, const Eigen::VectorXd &theta, const Eigen::VectorXd &scales)
+{
+    std::ofstream ofs(filename, std::ios::binary);
+    if (!ofs)
+        return false;
+    int32_t header[3] = { coverVersion, int32_t(theta.size()), int32_t(scales.size()) };
+    ofs.write(coverMagic, sizeof(coverMagic));
+    ofs.write((const char *)header, sizeof(header));
+    ofs.write((const char *)theta.data(), theta.size() * sizeof(double));
+    ofs.write((const char *)scales.data(), scales.size() * sizeof(double));
+    ofs.flush();
+    return bool(ofs);
+}
+
+bool loadCoverCheckpoint(const std::string &filename, int nverts, int nfaces, Eigen::VectorXd &theta, Eigen::VectorXd &scales)
+{
+    std::ifstream ifs(filename, std::ios::binary);
+    if (!ifs)
+        return false;
+    char magic[8];
+    int32_t header[3];
+    ifs.read(magic, sizeof(magic));
+    ifs.read((char *)header, sizeof(header));
+    if (!ifs || std::memcmp(magic, coverMagic, sizeof(magic)) != 0 || header[0] != coverVersion)
+    {
+        std::cerr << filename << " is not a cover checkpoint" << std::endl;
+        return false;
+    }
+    if (header[1] != nverts || header[2] != nfaces)
+    {
+        std::cerr << "Cover checkpoint " << filename << " is for a cover with " << header[1] << " vertices and " << header[2] << " faces, not " << nverts << " and " << nfaces << std::endl;
+        return false;
+    }
+    Eigen::VectorXd newtheta(nverts);
+    Eigen::VectorXd newscales(nfaces);
+    ifs.read((char *)newtheta.data(), nverts * sizeof(double));
+    ifs.read((char *)newscales.data(), nfaces * sizeof(double));
+    if (!ifs)
+    {
+        std::cerr << "Error reading cover checkpoint " << filename << ": file is truncated" << std::endl;
+        return false;
+    }
+    theta = newtheta;
+    scales = newscales;
+    return true;
+}
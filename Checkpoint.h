@@ -0,0 +1,41 @@
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include <Eigen/Core>
+#include <string>
+#include <functional>
+#include <cstdint>
+#include <cstddef>
+
+// Running hash (FNV-1a) of everything a pipeline stage's output depends on: its inputs' contents and its parameters.
+// Chaining the key of one stage into the next means changing a parameter only invalidates the stages downstream of it.
+class CheckpointKey
+{
+public:
+    CheckpointKey() : hash_(14695981039346656037ULL) {}
+
+    CheckpointKey &add(const void *data, size_t len);
+    CheckpointKey &add(double d) { return add(&d, sizeof(double)); }
+    CheckpointKey &add(int i) { return add(&i, sizeof(int)); }
+    CheckpointKey &add(const std::string &s);
+    CheckpointKey &add(const CheckpointKey &key) { return add(&key.hash_, sizeof(uint64_t)); }
+    // hashes the contents of a file; false if it can't be read
+    bool addFile(const std::string &filename);
+
+    std::string hex() const;
+
+private:
+    uint64_t hash_;
+};
+
+// Produces filename by having write() fill in a temporary file that is renamed into place only if write() succeeds,
+// so a run that dies mid-write never leaves a truncated checkpoint behind
+bool writeCheckpoint(const std::string &filename, const std::function<bool(const std::string &)> &write);
+
+// Integrated (and possibly rounded) cover functions: per-vertex theta and per-face scales.
+// Format: magic "WEAVECVR", int32 version, int32 nverts, int32 nfaces, nverts doubles theta, nfaces doubles scales.
+bool saveCoverCheckpoint(const std::string &filename, const Eigen::VectorXd &theta, const Eigen::VectorXd &scales);
+// fails, without modifying theta and scales, unless the file is complete and its sizes are nverts and nfaces
+bool loadCoverCheckpoint(const std::string &filename, int nverts, int nfaces, Eigen::VectorXd &theta, Eigen::VectorXd &scales);
+
+#endif
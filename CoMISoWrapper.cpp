@@ -1,54 +1,78 @@
 #include "CoMISoWrapper.h"
 #include <iostream>
+#include <chrono>
+#include "Profiler.h"
 #include <CoMISo/Solver/ConstrainedSolver.hh>
 
 void ComisoWrapper(const Eigen::SparseMatrix<double> &constraints,
-    const Eigen::SparseMatrix<double> &A, 
+    const Eigen::SparseMatrix<double> &A,
     Eigen::VectorXd &result,
     const Eigen::VectorXd &rhs,
     const Eigen::VectorXi &toRound,
-    double reg)
+    const ComisoParams &params,
+    ComisoTimings *timings)
 {
+    PROFILE_SCOPE("ComisoWrapper");
     int n = A.rows();
     assert(n == A.cols());
     assert(n + 1 == constraints.cols());
-    std::cout << n << " " << rhs.size() << std::endl;
     assert(n == rhs.size());
-    COMISO::ConstrainedSolver solver;
 
-    gmm::col_matrix< gmm::wsvector< double > > Agmm(n,n);
-    int nconstraints = constraints.rows();
-    gmm::row_matrix< gmm::wsvector< double > > Cgmm(nconstraints, n+1); // constraints
-
-    for (int k=0; k < A.outerSize(); ++k){
-        for (Eigen::SparseMatrix<double>::InnerIterator it(A,k); it; ++it){
-            int row = it.row();
-            int col = it.col();
-            Agmm(row, col) += it.value();
-        }
-    }
-    for (int k=0; k < constraints.outerSize(); ++k){
-        for (Eigen::SparseMatrix<double>::InnerIterator it(constraints,k); it; ++it){
-            int row = it.row();
-            int col = it.col();
-            Cgmm(row, col) += it.value();
-        }
+    auto convertStart = std::chrono::steady_clock::now();
+
+    // Eigen's compressed column-major storage is exactly CSC, and its row-major storage CSR, so both matrices are
+    // viewed in place by gmm and copied a column (row) at a time instead of through random-access insertion
+    Eigen::SparseMatrix<double> Acomp;
+    const Eigen::SparseMatrix<double> *Ap = &A;
+    if (!A.isCompressed())
+    {
+        Acomp = A;
+        Acomp.makeCompressed();
+        Ap = &Acomp;
     }
+    gmm::csc_matrix_ref<const double *, const int *, const int *> Aref(Ap->valuePtr(), Ap->innerIndexPtr(), Ap->outerIndexPtr(), n, n);
+    gmm::col_matrix< gmm::wsvector< double > > Agmm(n, n);
+    gmm::copy(Aref, Agmm);
 
-    std::vector<double> rhsv(n,0); 
-    for (int i = 0; i < n; i++)
-        rhsv[i] = rhs[i];
+    int nconstraints = constraints.rows();
+    Eigen::SparseMatrix<double, Eigen::RowMajor> Crow(constraints);
+    Crow.makeCompressed();
+    gmm::csr_matrix_ref<const double *, const int *, const int *> Cref(Crow.valuePtr(), Crow.innerIndexPtr(), Crow.outerIndexPtr(), nconstraints, n + 1);
+    gmm::row_matrix< gmm::wsvector< double > > Cgmm(nconstraints, n + 1); // constraints
+    gmm::copy(Cref, Cgmm);
 
+    std::vector<double> rhsv(rhs.data(), rhs.data() + n);
     std::vector<double> X(n, 0);
-    std::vector<int> toRoundv(toRound.size());
-    for (int i = 0; i < toRound.size(); i++)
-        toRoundv[i] = toRound[i];
+    std::vector<int> toRoundv(toRound.data(), toRound.data() + toRound.size());
     for (int i = 0; i < toRoundv.size(); i++)
     {
         assert(toRoundv[i] >= 0 && toRoundv[i] < n);
     }
-    solver.solve(Cgmm, Agmm, X, rhsv, toRoundv, reg, false, false);
-    result.resize(n);
-    for (int i = 0; i < n; i++)
-        result[i] = X[i];
+
+    auto solveStart = std::chrono::steady_clock::now();
+
+    COMISO::ConstrainedSolver solver;
+    COMISO::MISolver &miso = solver.misolver();
+    miso.set_direct_rounding(params.directRounding);
+    miso.set_multiple_rounding(params.multipleRounding);
+    miso.set_multiple_rounding_threshold(params.multipleRoundingThreshold);
+    miso.set_local_iters(params.localIters);
+    miso.set_local_error(params.localError);
+    miso.set_cg_iters(params.cgIters);
+    miso.set_cg_error(params.cgError);
+    miso.set_final_full(params.finalFull);
+    solver.solve(Cgmm, Agmm, X, rhsv, toRoundv, params.reg, params.verbose, params.verbose);
+
+    auto solveEnd = std::chrono::steady_clock::now();
+
+    result = Eigen::Map<Eigen::VectorXd>(X.data(), n);
+
+    double convertTime = std::chrono::duration<double>(solveStart - convertStart).count();
+    double solveTime = std::chrono::duration<double>(solveEnd - solveStart).count();
+    std::cout << "CoMISo: " << n << " variables, " << nconstraints << " constraints, " << toRoundv.size() << " integer; conversion " << convertTime << "s, solve " << solveTime << "s" << std::endl;
+    if (timings)
+    {
+        timings->conversion = convertTime;
+        timings->solve = solveTime;
+    }
 }
@@ -4,11 +4,50 @@
 #include <Eigen/Sparse>
 #include <Eigen/Core>
 
+// Options forwarded to CoMISo's mixed-integer solver. Defaults match those of CoMISo's MISolver, except reg, which is
+// the value this code has always passed.
+struct ComisoParams
+{
+    ComisoParams() :
+        reg(1e-6),
+        directRounding(false),
+        multipleRounding(true),
+        multipleRoundingThreshold(0.5),
+        localIters(100000),
+        localError(1e-3),
+        cgIters(50),
+        cgError(1e-3),
+        finalFull(true),
+        verbose(false)
+    {}
+
+    double reg; // regularization factor of the quadratic system
+    bool directRounding; // round all integer variables at once instead of iteratively
+    bool multipleRounding; // per pass, round every variable closer than multipleRoundingThreshold to an integer (otherwise just one)
+    double multipleRoundingThreshold;
+    unsigned int localIters; // Gauss-Seidel iterations of the local solve after each rounding pass
+    double localError;
+    unsigned int cgIters; // conjugate gradient iterations when the local solve does not converge
+    double cgError;
+    bool finalFull; // do a full sparse solve once all variables are rounded
+    bool verbose; // print CoMISo's settings and internal timings
+};
+
+// Wall-clock time (in seconds) spent converting to CoMISo's matrix format and in the solver itself
+struct ComisoTimings
+{
+    double conversion;
+    double solve;
+};
+
+// Solves A x = rhs subject to the linear constraints (one per row, last column holding the constant term) with x[toRound] integer.
+// A and constraints are handed to CoMISo in bulk from their compressed storage; no per-entry insertion.
 void ComisoWrapper(const Eigen::SparseMatrix<double> &constraints,
     const Eigen::SparseMatrix<double> &A,
     Eigen::VectorXd &result,
     const Eigen::VectorXd &rhs,
     const Eigen::VectorXi &toRound,
-    double reg);
+    const ComisoParams &params,
+    ComisoTimings *timings = NULL);
 
 #endif
\ No newline at end of file
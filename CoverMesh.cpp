@@ -7,14 +7,21 @@
 #include <igl/is_vertex_manifold.h>
 #include <igl/is_edge_manifold.h>
 #include <set>
+#include <algorithm>
+#include <cmath>
 #include <igl/cotmatrix_entries.h>
 #include <igl/facet_components.h>
 #include <igl/remove_unreferenced.h>
 #include "Traces.h"
 #include "igl/massmatrix.h"
 #include "FieldIntegration.h"
+#include "GeometryCache.h"
 #include "igl/cotmatrix.h"
 #include "CoMISoWrapper.h"
+#include "Parallel.h"
+#include "GaussNewton.h"
+#include "Profiler.h"
+#include "SolverProgress.h"
 
 # define M_PI           3.14159265358979323846
 
@@ -23,6 +30,7 @@ using namespace std;
 CoverMesh::CoverMesh(const Surface &originalSurf, const Eigen::MatrixXd &V, const Eigen::MatrixXi &F, const Eigen::VectorXi &oldToNewVertMap, const Eigen::MatrixXd &field, int ncovers)
 {
     originalSurf_ = new Surface(originalSurf);
+    geomCache_ = new GeometryCache(*originalSurf_);
     fs = new FieldSurface(V, F, 1);
     int nfaces = F.rows();
     ncovers_ = ncovers;
@@ -48,14 +56,15 @@ CoverMesh::~CoverMesh()
     if (data_.splitMesh)
         delete data_.splitMesh;
     delete originalSurf_;
+    delete geomCache_;
 }
 
-double CoverMesh::barycentric(double val1, double val2, double target)
+double CoverMesh::barycentric(double val1, double val2, double target) const
 {
     return (target-val1) / (val2-val1);
 }
 
-bool CoverMesh::crosses(double isoval, double val1, double val2, double minval, double maxval, double &bary)
+bool CoverMesh::crosses(double isoval, double val1, double val2, double minval, double maxval, double &bary) const
 {
     double halfperiod = 0.5*(maxval-minval);
     if(fabs(val2-val1) <= halfperiod)
@@ -91,18 +100,74 @@ bool CoverMesh::crosses(double isoval, double val1, double val2, double minval,
 } 
 
 
-void CoverMesh::extractIsoline(const Eigen::VectorXd &func, double isoval, double minval, double maxval, std::vector<Trace> &isotrace)
+void CoverMesh::classifyIsolineFaces(const Eigen::VectorXd &func, int numISOLines, double minval, double maxval, std::vector<std::vector<int> > &crossedFaces) const
+{
+    crossedFaces.clear();
+    crossedFaces.resize(numISOLines);
+    if (numISOLines <= 0)
+        return;
+
+    double period = maxval - minval;
+    double halfperiod = 0.5*period;
+    int nfaces = fs->nFaces();
+    std::vector<int> faceLines;
+    for (int i = 0; i < nfaces; i++)
+    {
+        if (fs->isFaceDeleted(i))
+            continue;
+        faceLines.clear();
+        for (int j = 0; j < 3; j++)
+        {
+            double val1 = func[fs->data().F(i, (j + 1) % 3)];
+            double val2 = func[fs->data().F(i, (j + 2) % 3)];
+            // the range of values swept by the edge, unwrapped the same way crosses() does
+            double lo = std::min(val1, val2);
+            double hi = std::max(val1, val2);
+            if (hi - lo > halfperiod)
+            {
+                double wrappedlo = hi;
+                hi = lo + period;
+                lo = wrappedlo;
+            }
+            // candidate isovalues, padded by one on each side; crosses() has the final say
+            int first = 0;
+            int last = numISOLines - 1;
+            if (std::isfinite(lo) && std::isfinite(hi))
+            {
+                double klo = std::floor((lo - minval) / period * numISOLines) - 1;
+                double khi = std::ceil((hi - minval) / period * numISOLines) + 1;
+                if (khi - klo + 1 < numISOLines)
+                {
+                    first = int(klo);
+                    last = int(khi);
+                }
+            }
+            for (int k = first; k <= last; k++)
+            {
+                int line = ((k % numISOLines) + numISOLines) % numISOLines;
+                double isoval = minval + (maxval - minval) * double(line) / double(numISOLines);
+                double bary;
+                if (crosses(isoval, val1, val2, minval, maxval, bary))
+                    faceLines.push_back(line);
+            }
+        }
+        std::sort(faceLines.begin(), faceLines.end());
+        faceLines.erase(std::unique(faceLines.begin(), faceLines.end()), faceLines.end());
+        for (int line : faceLines)
+            crossedFaces[line].push_back(i);
+    }
+}
+
+void CoverMesh::extractIsoline(const Eigen::VectorXd &func, double isoval, double minval, double maxval, const std::vector<int> &crossedFaces, std::vector<Trace> &isotrace) const
 {    
     int nfaces = fs->nFaces();
-    bool *visited = new bool[nfaces];
-    for(int i=0; i<nfaces; i++)
-        visited[i] = fs->isFaceDeleted(i);
-        
+    // faces with a lower index than the current start face count as visited, exactly as if every face were swept in order
+    std::vector<bool> visited(nfaces, false);
 
     // Iterate between faces until encountering a zero level set.  
     // Trace out the level set in both directions from this face (marking faces as visited)
     // Save isoline to centerline
-    for(int i=0; i<nfaces; i++)
+    for(int i : crossedFaces)
     {
         if(visited[i])
             continue;
@@ -125,7 +190,7 @@ void CoverMesh::extractIsoline(const Eigen::VectorXd &func, double isoval, doubl
                 
                 int prevface = i;
                 int curface = fs->data().faceNeighbors(i, j);
-                while(curface != -1 && !visited[curface])
+                while(curface != -1 && curface > i && !visited[curface] && !fs->isFaceDeleted(curface))
                 {                
                     visited[curface] = true;
                     TraceSegment nextseg;
@@ -198,22 +263,31 @@ void CoverMesh::extractIsoline(const Eigen::VectorXd &func, double isoval, doubl
             isotrace.push_back(line);
         }
     }
-    delete[] visited;
 }
 
 void  CoverMesh::recomputeIsolines(int numISOLines, std::vector<Trace> &isotraces)
 {
+    PROFILE_SCOPE("CoverMesh::recomputeIsolines");
     double minval = -M_PI;
     double maxval = M_PI;
     double numlines = numISOLines;
 
     isotraces.clear();
 
-    for(int i=0; i<numlines; i++)
+    // one sweep over the faces finds, for every isovalue, the faces its isoline passes through
+    std::vector<std::vector<int> > crossedFaces;
+    classifyIsolineFaces(theta, numISOLines, minval, maxval, crossedFaces);
+
+    // isolines of different isovalues are independent, so trace them in parallel and concatenate in isovalue order
+    std::vector<std::vector<Trace> > lineTraces(numISOLines);
+    parallelFor(0, numISOLines, [&](int i)
     {
         double isoval = minval + (maxval-minval) * double(i)/double(numlines);
-        extractIsoline(theta, isoval, minval, maxval, isotraces);
-    }
+        extractIsoline(theta, isoval, minval, maxval, crossedFaces[i], lineTraces[i]);
+    });
+
+    for (int i = 0; i < numISOLines; i++)
+        isotraces.insert(isotraces.end(), lineTraces[i].begin(), lineTraces[i].end());
     std::cout << "Extracted " << isotraces.size() << " isolines" << std::endl;
 }
 
@@ -308,8 +382,9 @@ int CoverMesh::visMeshToCoverMesh(int vertid)
     return data_.splitToCoverVerts[vertid];
 }
 
-void CoverMesh::roundAntipodalCovers(int numISOLines)
+void CoverMesh::roundAntipodalCovers(int numISOLines, const ComisoParams &comiso)
 {
+    PROFILE_SCOPE("CoverMesh::roundAntipodalCovers");
     // create a mesh without deleted faces
     int undeletedFaces = fs->numUndeletedFaces();
     Eigen::MatrixXi undelF(undeletedFaces, 3);
@@ -415,7 +490,7 @@ void CoverMesh::roundAntipodalCovers(int numISOLines)
     for (int i = 0; i < nfields*ncorrs; i++)
         toRound[i] = newverts + i;
 
-    ComisoWrapper(C, A, result, rhs, toRound, 1e-6);
+    ComisoWrapper(C, A, result, rhs, toRound, comiso);
     std::cout << "Residual: " << (A*result - rhs).norm() << std::endl;
     Eigen::VectorXd ctest(newverts + nfields * ncorrs + 1);
     ctest.segment(0, newverts + nfields * ncorrs) = result;
@@ -431,8 +506,9 @@ void CoverMesh::roundAntipodalCovers(int numISOLines)
     }
 }
 
-void CoverMesh::integrateField(LocalFieldIntegration *lmethod, GlobalFieldIntegration *gmethod, double globalScale)
+void CoverMesh::integrateField(LocalFieldIntegration *lmethod, GlobalFieldIntegration *gmethod, double globalScale, SolverProgress *progress)
 {
+    PROFILE_SCOPE("CoverMesh::integrateField");
     int globalverts = fs->nVerts();
     theta.resize(globalverts);
     theta.setZero();
@@ -468,12 +544,19 @@ void CoverMesh::integrateField(LocalFieldIntegration *lmethod, GlobalFieldIntegr
     for(int i=0; i<components.size(); i++)
         componentsizes[components[i]]++;    
     std::cout << "Covering mesh has " << ncomponents << " connected components" << std::endl;
+    int origfaces = geomCache_->nBaseFaces();
     // loop over the connected components
     for(int component = 0; component < ncomponents; component++)
     {
+        if (!reportProgress(progress, "integration", double(component) / ncomponents))
+        {
+            std::cout << "Cancelled after " << component << " of " << ncomponents << " components" << std::endl;
+            break;
+        }
         std::cout << "Component " << component << ": " << componentsizes[component] << " faces" << std::endl;
         // faces for just this connected component
         Eigen::VectorXi compFacesToGlobal(componentsizes[component]);
+        Eigen::VectorXi compFacesToBase(componentsizes[component]);
         Eigen::MatrixXi compF(componentsizes[component], 3);
         Eigen::MatrixXd compField(componentsizes[component], 2);
         int idx=0;
@@ -482,6 +565,7 @@ void CoverMesh::integrateField(LocalFieldIntegration *lmethod, GlobalFieldIntegr
             if(components[i] == component)
             {
                 compFacesToGlobal[idx] = undelFaceMap[i];
+                compFacesToBase[idx] = undelFaceMap[i] % origfaces;
                 compF.row(idx) = undelF.row(i);
                 Eigen::Vector2d vec = fs->v(undelFaceMap[i], 0); 
                 double vecnorm = (fs->data().Bs[undelFaceMap[i]] * vec).norm();
@@ -497,12 +581,15 @@ void CoverMesh::integrateField(LocalFieldIntegration *lmethod, GlobalFieldIntegr
         // connected component surface
         Surface surf(prunedV, prunedF);
         
+        ComponentGeometry geom;
+        geomCache_->gather(surf, compFacesToBase, geom);
+        
         std::cout << "Built connected component surface" << std::endl;
 
         // component theta and s
         Eigen::VectorXd compS;
         Eigen::VectorXd compTheta;
-        lmethod->locallyIntegrateOneComponent(surf, compField, compS);
+        lmethod->locallyIntegrateOneComponent(surf, geom, compField, compS);
         
         double maxS = 0;
         for(int i=0; i<compS.size(); i++)
@@ -521,7 +608,7 @@ void CoverMesh::integrateField(LocalFieldIntegration *lmethod, GlobalFieldIntegr
             scales[compFacesToGlobal[i]] = compS[i];
         }
 
-        gmethod->globallyIntegrateOneComponent(surf, compField, compS, compTheta);
+        gmethod->globallyIntegrateOneComponent(surf, geom, compField, compS, compTheta, progress);
         
         
         // map component theta to the global theta vector
@@ -649,34 +736,53 @@ static double periodicDiff(double a, double b)
     return diff;
 }
 
+double CoverMesh::faceGradThetaDeviation(int face) const
+{
+    if(fs->isFaceDeleted(face))
+        return 0;
+    Eigen::Vector2d diffs;
+    double val0 = theta[fs->data().F(face,0)];
+    diffs[0] = periodicDiff(val0, theta[fs->data().F(face,1)]);
+    diffs[1] = periodicDiff(val0, theta[fs->data().F(face,2)]);
+    const Eigen::Matrix<double, 3, 2> &B = fs->data().Bs[face];
+    Eigen::Matrix2d BTB = B.transpose()*B;
+    Eigen::Vector2d grad = BTB.inverse() * diffs;
+    Eigen::Vector3d grademb = B * grad;
+    Eigen::Vector3d vemb = B*fs->data().Js.block<2,2>(2*face,0)*fs->v(face,0);
+    Eigen::Vector3d n = fs->faceNormal(face);
+    double angle = asin(grademb.cross(vemb).dot(n) / grademb.norm() / vemb.norm());
+    return fabs( angle ) / (0.5 * M_PI);
+}
+
 void CoverMesh::gradThetaDeviation(Eigen::VectorXd &error) const
 {
     int nfaces = fs->nFaces();
     error.resize(nfaces);
-    error.setZero();
-    for(int i=0; i<nfaces; i++)
+    parallelFor(0, nfaces, [&](int i)
     {
-        if(fs->isFaceDeleted(i))
-            error[i] = 0;
-        else
+        error[i] = faceGradThetaDeviation(i);
+    });
+}
+
+void CoverMesh::computeDiagnostics(const SolverParams &params, CoverDiagnostics &diag) const
+{
+    int nfaces = fs->nFaces();
+    int nfields = fs->nFields();
+    diag.scales = scales;
+    diag.connectionEnergy.resize(nfaces);
+    diag.gradDeviation.resize(nfaces);
+    parallelFor(0, nfaces, [&](int f)
+    {
+        // same as FieldSurface::connectionEnergy with a zero threshold
+        double energy = 0;
+        for (int e = 0; e < 3; e++)
         {
-            double vals[3];
-            for(int j=0; j<3; j++)
-            {
-                vals[j] = theta[fs->data().F(i,j)];
-                Eigen::Vector2d diffs;
-                diffs[0] = periodicDiff(vals[0], vals[1]);
-                diffs[1] = periodicDiff(vals[0], vals[2]);
-                Eigen::Matrix<double, 3, 2> B = fs->data().Bs[i];
-                Eigen::Matrix2d BTB = B.transpose()*B;
-                Eigen::Matrix2d BTBinv = BTB.inverse();
-                Eigen::Vector2d grad = BTBinv * diffs;
-                Eigen::Vector3d grademb = B * grad;
-                Eigen::Vector3d vemb = B*fs->data().Js.block<2,2>(2*i,0)*fs->v(i,0);
-                Eigen::Vector3d n = fs->faceNormal(i);
-                double theta = asin(grademb.cross(vemb).dot(n) / grademb.norm() / vemb.norm());
-                error[i] = fabs( theta ) / (0.5 * M_PI);
-            }
+            for (int j = 0; j < nfields; j++)
+                energy += fs->edgeCurlEnergy(f, e, j);
         }
-    }
+        if (params.vizShowCurlSign)
+            energy = (energy < 0 ? -1 : 1);
+        diag.connectionEnergy[f] = energy;
+        diag.gradDeviation[f] = faceGradThetaDeviation(f);
+    });
 }
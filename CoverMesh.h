@@ -12,6 +12,10 @@ class Surface;
 class TraceSet;
 class LocalFieldIntegration;
 class GlobalFieldIntegration;
+class GeometryCache;
+struct SolverParams;
+class SolverProgress;
+struct ComisoParams;
 
 struct CoverData
 {
@@ -24,6 +28,14 @@ struct CoverData
     std::vector<int> splitMeshCuts; // edges of the split mesh that are cuts
 };
 
+// Per-face diagnostics of a cover, one column per quantity, each indexed by face of the cover mesh
+struct CoverDiagnostics
+{
+    Eigen::VectorXd scales; // integrated field scale s
+    Eigen::VectorXd connectionEnergy; // as FieldSurface::connectionEnergy, with zero threshold
+    Eigen::VectorXd gradDeviation; // as CoverMesh::gradThetaDeviation
+};
+
 class CoverMesh
 {
 public:
@@ -43,11 +55,14 @@ public:
         bool hideVectors,
         double vectorScale);
 
-    void integrateField(LocalFieldIntegration *lmethod, GlobalFieldIntegration *gmethod, double globalScale);
-    void roundAntipodalCovers(int numISOLines);
+    // If progress is cancelled, stops after the current connected component; theta and scales are zero on the rest
+    void integrateField(LocalFieldIntegration *lmethod, GlobalFieldIntegration *gmethod, double globalScale, SolverProgress *progress = NULL);
+    void roundAntipodalCovers(int numISOLines, const ComisoParams &comiso);
     double renderScale() {return renderScale_;}
     const Surface &splitMesh() const;
     void gradThetaDeviation(Eigen::VectorXd &error) const;
+    // computes all per-face diagnostics of the cover in one pass over its faces
+    void computeDiagnostics(const SolverParams &params, CoverDiagnostics &diag) const;
     
     // maps indices of vertices on the visualization mesh to corresponding "parent" vertices on the cover mesh
     int visMeshToCoverMesh(int vertid);
@@ -55,20 +70,26 @@ public:
     void drawTraceOnSplitMesh(const Trace &trace, Eigen::MatrixXd &pathStarts, Eigen::MatrixXd &pathEnds) const;    
    
 private:
+    // normalized angle between grad theta and the field on a face (0 on deleted faces)
+    double faceGradThetaDeviation(int face) const;
     double inversePowerIteration(Eigen::SparseMatrix<double> &M, Eigen::VectorXd &evec, int iters);
     void initializeSplitMesh(const Eigen::VectorXi &oldToNewVertMap);
 
-    double barycentric(double val1, double val2, double target);
+    double barycentric(double val1, double val2, double target) const;
     bool crosses(double isoval, double val1, double val2, double minval, 
-        double maxval, double &bary);
+        double maxval, double &bary) const;
+    // for each of numISOLines evenly spaced isovalues in [minval, maxval), the (sorted) faces crossed by that isoline
+    void classifyIsolineFaces(const Eigen::VectorXd &func, int numISOLines,
+        double minval, double maxval, std::vector<std::vector<int> > &crossedFaces) const;
     void extractIsoline(const Eigen::VectorXd &func, 
-        double isoval, double minval, double maxval, std::vector<Trace> &isotrace);
+        double isoval, double minval, double maxval, const std::vector<int> &crossedFaces, std::vector<Trace> &isotrace) const;
     
     std::vector<std::vector<Eigen::Vector3d> > isoNormal;
 
     CoverData data_;
     int ncovers_;
     Surface *originalSurf_;
+    GeometryCache *geomCache_; // geometry of originalSurf_, shared by every sheet of the cover
     double renderScale_;    
     // edges along which the multiple cover is cut to create a topological disk
     std::vector<int> slicedEdges;
@@ -0,0 +1,18 @@
+#include "CsvWriter.h"
+#include <cstdio>
+#include <iostream>
+
+bool CsvWriter::writeToFile(const char *filename) const
+{
+    FILE *f = fopen(filename, "wb");
+    if (!f)
+    {
+        std::cerr << "Couldn't open " << filename << " for writing" << std::endl;
+        return false;
+    }
+    bool ok = fwrite(buf_.data(), 1, buf_.size(), f) == buf_.size();
+    ok = (fclose(f) == 0) && ok;
+    if (!ok)
+        std::cerr << "Error writing " << filename << std::endl;
+    return ok;
+}
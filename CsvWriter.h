@@ -0,0 +1,59 @@
+#ifndef CSVWRITER_H
+#define CSVWRITER_H
+
+#include <string>
+#include <charconv>
+
+// Builds CSV text in one growing buffer. Numbers are formatted with std::to_chars, and nothing is flushed per line.
+// Doubles use iostream's default "%g"-style formatting with 6 significant digits, so output matches the << it replaces.
+// clear() keeps the buffer's capacity, so a writer can be reused across files.
+class CsvWriter
+{
+public:
+    CsvWriter(size_t reserve = 1 << 20, int precision = 6) : precision_(precision)
+    {
+        buf_.reserve(reserve);
+    }
+
+    CsvWriter &operator<<(double v)
+    {
+        char tmp[64];
+        auto res = std::to_chars(tmp, tmp + sizeof(tmp), v, std::chars_format::general, precision_);
+        buf_.append(tmp, res.ptr);
+        return *this;
+    }
+
+    CsvWriter &operator<<(int v)
+    {
+        char tmp[16];
+        auto res = std::to_chars(tmp, tmp + sizeof(tmp), v);
+        buf_.append(tmp, res.ptr);
+        return *this;
+    }
+
+    CsvWriter &operator<<(const char *s)
+    {
+        buf_.append(s);
+        return *this;
+    }
+
+    CsvWriter &operator<<(char c)
+    {
+        buf_.push_back(c);
+        return *this;
+    }
+
+    const std::string &str() const { return buf_; }
+    // hands over the contents (e.g. to a FileWriteQueue), leaving the writer empty
+    std::string release() { return std::move(buf_); }
+    void clear() { buf_.clear(); }
+
+    // writes the contents to filename synchronously
+    bool writeToFile(const char *filename) const;
+
+private:
+    std::string buf_;
+    int precision_;
+};
+
+#endif
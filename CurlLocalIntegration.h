@@ -9,7 +9,7 @@ class CurlLocalIntegration : public LocalFieldIntegration
 public:
     CurlLocalIntegration(double sSmoothnessReg) : sreg_(sSmoothnessReg) {}
 
-    void locallyIntegrateOneComponent(const Surface &surf, const Eigen::MatrixXd &v, Eigen::VectorXd &s);
+    void locallyIntegrateOneComponent(const Surface &surf, const ComponentGeometry &geom, const Eigen::MatrixXd &v, Eigen::VectorXd &s);
 
 private:
     double sreg_;
@@ -0,0 +1,637 @@
+#include "Distance.h"
+#include "Parallel.h"
+#include <vector>
+#include <limits>
+#include <atomic>
+#include <utility>
+#include <cmath>
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
+namespace
+{
+    struct AABB
+    {
+        Eigen::Vector3d lo, hi;
+
+        AABB()
+        {
+            lo.setConstant(std::numeric_limits<double>::infinity());
+            hi.setConstant(-std::numeric_limits<double>::infinity());
+        }
+
+        void grow(const Eigen::Vector3d &p)
+        {
+            lo = lo.cwiseMin(p);
+            hi = hi.cwiseMax(p);
+        }
+
+        void grow(const AABB &b)
+        {
+            lo = lo.cwiseMin(b.lo);
+            hi = hi.cwiseMax(b.hi);
+        }
+
+        double squaredDistance(const Eigen::Vector3d &p) const
+        {
+            Eigen::Vector3d gap = (lo - p).cwiseMax(p - hi).cwiseMax(0.0);
+            return gap.squaredNorm();
+        }
+
+        double squaredDistance(const AABB &b) const
+        {
+            Eigen::Vector3d gap = (lo - b.hi).cwiseMax(b.lo - hi).cwiseMax(0.0);
+            return gap.squaredNorm();
+        }
+    };
+
+    // Axis-aligned bounding box hierarchy over mesh primitives (faces or edges) given by their N vertex indices,
+    // built by median splits. Nodes are stored flat, with the root at index 0.
+    template<int N>
+    class BVH
+    {
+    public:
+        struct Node
+        {
+            AABB box;
+            int left, right; // children, for interior nodes
+            int start, count; // leaves (count > 0) hold primitives prim(start) ... prim(start + count - 1)
+        };
+
+        BVH(const std::vector<Eigen::Vector3d> &pos, const std::vector<Eigen::Matrix<int, N, 1> > &prims)
+        {
+            int nprims = prims.size();
+            order_.resize(nprims);
+            boxes_.resize(nprims);
+            centroids_.resize(nprims);
+            for (int i = 0; i < nprims; i++)
+            {
+                order_[i] = i;
+                centroids_[i].setZero();
+                for (int j = 0; j < N; j++)
+                {
+                    boxes_[i].grow(pos[prims[i][j]]);
+                    centroids_[i] += pos[prims[i][j]];
+                }
+                centroids_[i] /= double(N);
+            }
+            if (nprims > 0)
+                build(0, nprims);
+        }
+
+        const std::vector<Node> &nodes() const { return nodes_; }
+        int prim(int i) const { return order_[i]; }
+        const AABB &primBox(int p) const { return boxes_[p]; }
+
+    private:
+        static const int leafSize = 4;
+
+        int build(int start, int end)
+        {
+            int id = nodes_.size();
+            nodes_.push_back(Node());
+            AABB box, cbox;
+            for (int i = start; i < end; i++)
+            {
+                box.grow(boxes_[order_[i]]);
+                cbox.grow(centroids_[order_[i]]);
+            }
+            nodes_[id].box = box;
+            if (end - start <= leafSize)
+            {
+                nodes_[id].start = start;
+                nodes_[id].count = end - start;
+                nodes_[id].left = nodes_[id].right = -1;
+                return id;
+            }
+            // median split along the longest axis of the centroids
+            int axis;
+            (cbox.hi - cbox.lo).maxCoeff(&axis);
+            int mid = (start + end) / 2;
+            std::nth_element(order_.begin() + start, order_.begin() + mid, order_.begin() + end,
+                [&](int a, int b) { return centroids_[a][axis] < centroids_[b][axis]; });
+            int left = build(start, mid);
+            int right = build(mid, end);
+            nodes_[id].start = 0;
+            nodes_[id].count = 0;
+            nodes_[id].left = left;
+            nodes_[id].right = right;
+            return id;
+        }
+
+        std::vector<int> order_; // primitive ids, permuted so that each leaf's are contiguous
+        std::vector<AABB> boxes_;
+        std::vector<Eigen::Vector3d> centroids_;
+        std::vector<Node> nodes_;
+    };
+
+    // Vertices, faces and unique edges of a mesh in the layout meshSelfDistance takes
+    struct SelfDistanceMesh
+    {
+        SelfDistanceMesh(const Eigen::VectorXd &verts, const Eigen::Matrix3Xi &faces, const std::set<int> &fixedVerts)
+        {
+            int nverts = verts.size() / 3;
+            pos.resize(nverts);
+            fixed.resize(nverts, false);
+            for (int i = 0; i < nverts; i++)
+                pos[i] = verts.segment<3>(3 * i);
+            for (int v : fixedVerts)
+            {
+                if (v >= 0 && v < nverts)
+                    fixed[v] = true;
+            }
+
+            int nfaces = faces.cols();
+            tris.resize(nfaces);
+            std::vector<std::pair<int, int> > edgelist;
+            for (int i = 0; i < nfaces; i++)
+            {
+                tris[i] = faces.col(i);
+                for (int j = 0; j < 3; j++)
+                {
+                    int a = faces((j + 1) % 3, i);
+                    int b = faces((j + 2) % 3, i);
+                    edgelist.push_back(std::make_pair(std::min(a, b), std::max(a, b)));
+                }
+            }
+            std::sort(edgelist.begin(), edgelist.end());
+            edgelist.erase(std::unique(edgelist.begin(), edgelist.end()), edgelist.end());
+            edges.resize(edgelist.size());
+            for (int i = 0; i < (int)edgelist.size(); i++)
+                edges[i] = Eigen::Vector2i(edgelist[i].first, edgelist[i].second);
+        }
+
+        // primitives sharing a vertex, or made up entirely of fixed vertices, are not compared
+        bool skipVertexFace(int v, const Eigen::Vector3i &f) const
+        {
+            if (v == f[0] || v == f[1] || v == f[2])
+                return true;
+            return fixed[v] && fixed[f[0]] && fixed[f[1]] && fixed[f[2]];
+        }
+
+        bool skipEdgeEdge(const Eigen::Vector2i &e1, const Eigen::Vector2i &e2) const
+        {
+            if (e1[0] == e2[0] || e1[0] == e2[1] || e1[1] == e2[0] || e1[1] == e2[1])
+                return true;
+            return fixed[e1[0]] && fixed[e1[1]] && fixed[e2[0]] && fixed[e2[1]];
+        }
+
+        double edgeEdgeDistance(const Eigen::Vector2i &e1, const Eigen::Vector2i &e2) const
+        {
+            double p0, p1, q0, q1;
+            return Distance::edgeEdgeDistance(pos[e1[0]], pos[e1[1]], pos[e2[0]], pos[e2[1]], p0, p1, q0, q1).norm();
+        }
+
+        std::vector<Eigen::Vector3d> pos;
+        std::vector<bool> fixed;
+        std::vector<Eigen::Vector3i> tris;
+        std::vector<Eigen::Vector2i> edges;
+    };
+
+    // A face hierarchy leaf's point-triangle pairs, evaluated together with vertexFaceDistances. One per thread, so the
+    // traversals don't allocate.
+    struct LeafBatch
+    {
+        Distance::PointTriangles pairs;
+        std::vector<double> dist, q1bary, q2bary;
+
+        // the distances of the pairs pushed since pairs.clear()
+        const std::vector<double> &evaluate()
+        {
+            int n = pairs.size();
+            dist.resize(n);
+            q1bary.resize(n);
+            q2bary.resize(n);
+            Distance::vertexFaceDistances(pairs, dist.data(), q1bary.data(), q2bary.data());
+            return dist;
+        }
+    };
+
+    LeafBatch &threadLeafBatch()
+    {
+        static thread_local LeafBatch batch;
+        return batch;
+    }
+
+    // lowers best to value if smaller; best is shared between threads so each one prunes with the tightest bound found so far
+    void atomicMin(std::atomic<double> &best, double value)
+    {
+        double cur = best.load(std::memory_order_relaxed);
+        while (value < cur && !best.compare_exchange_weak(cur, value, std::memory_order_relaxed))
+            ;
+    }
+}
+
+// One pair of edgeEdgeDistances, with every branch of edgeEdgeDistance turned into a select; written so the compiler
+// can vectorize the loop when AVX2 is not available
+static inline void edgeEdgeDistanceBranchless(const Distance::SegmentPairs &pairs, int i, double *dist, double *p1bary, double *q1bary)
+{
+    double d1[3], d2[3], r[3];
+    for (int k = 0; k < 3; k++)
+    {
+        d1[k] = pairs.p1[k][i] - pairs.p0[k][i];
+        d2[k] = pairs.q1[k][i] - pairs.q0[k][i];
+        r[k] = pairs.p0[k][i] - pairs.q0[k][i];
+    }
+    double a = d1[0] * d1[0] + d1[1] * d1[1] + d1[2] * d1[2];
+    double e = d2[0] * d2[0] + d2[1] * d2[1] + d2[2] * d2[2];
+    double f = d2[0] * r[0] + d2[1] * r[1] + d2[2] * r[2];
+    double c = d1[0] * r[0] + d1[1] * r[1] + d1[2] * r[2];
+    double b = d1[0] * d2[0] + d1[1] * d2[1] + d1[2] * d2[2];
+    double denom = a * e - b * b;
+
+    // divisors that are zero only feed lanes the selects below discard
+    double denomsafe = (denom != 0.0) ? denom : 1.0;
+    double asafe = (a != 0.0) ? a : 1.0;
+    double esafe = (e != 0.0) ? e : 1.0;
+
+    double s = (denom != 0.0) ? std::min(1.0, std::max((b * f - c * e) / denomsafe, 0.0)) : 0.0;
+    double tnom = b * s + f;
+    bool low = (tnom < 0) || (e == 0);
+    bool high = !low && (tnom > e);
+    double slow = (a == 0) ? 0.0 : std::min(1.0, std::max(-c / asafe, 0.0));
+    double shigh = (a == 0) ? 0.0 : std::min(1.0, std::max((b - c) / asafe, 0.0));
+    s = low ? slow : (high ? shigh : s);
+    double t = low ? 0.0 : (high ? 1.0 : tnom / esafe);
+
+    double diff2 = 0;
+    for (int k = 0; k < 3; k++)
+    {
+        double diff = (pairs.q0[k][i] + t * d2[k]) - (pairs.p0[k][i] + s * d1[k]);
+        diff2 += diff * diff;
+    }
+    dist[i] = std::sqrt(diff2);
+    p1bary[i] = s;
+    q1bary[i] = t;
+}
+
+#ifdef __AVX2__
+// clamp to [0, 1]
+static inline __m256d clamp01(__m256d x)
+{
+    return _mm256_min_pd(_mm256_set1_pd(1.0), _mm256_max_pd(x, _mm256_setzero_pd()));
+}
+
+// Pairs [i, i + 4) of edgeEdgeDistances, in the same arithmetic as edgeEdgeDistanceBranchless
+static inline void edgeEdgeDistanceAVX2(const Distance::SegmentPairs &pairs, int i, double *dist, double *p1bary, double *q1bary)
+{
+    __m256d d1[3], d2[3], r[3], p0[3], q0[3];
+    for (int k = 0; k < 3; k++)
+    {
+        p0[k] = _mm256_loadu_pd(pairs.p0[k].data() + i);
+        q0[k] = _mm256_loadu_pd(pairs.q0[k].data() + i);
+        d1[k] = _mm256_sub_pd(_mm256_loadu_pd(pairs.p1[k].data() + i), p0[k]);
+        d2[k] = _mm256_sub_pd(_mm256_loadu_pd(pairs.q1[k].data() + i), q0[k]);
+        r[k] = _mm256_sub_pd(p0[k], q0[k]);
+    }
+    auto dot = [](const __m256d *u, const __m256d *v) -> __m256d
+    {
+        return _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(u[0], v[0]), _mm256_mul_pd(u[1], v[1])), _mm256_mul_pd(u[2], v[2]));
+    };
+    __m256d a = dot(d1, d1);
+    __m256d e = dot(d2, d2);
+    __m256d f = dot(d2, r);
+    __m256d c = dot(d1, r);
+    __m256d b = dot(d1, d2);
+    __m256d denom = _mm256_sub_pd(_mm256_mul_pd(a, e), _mm256_mul_pd(b, b));
+
+    const __m256d zero = _mm256_setzero_pd();
+    const __m256d one = _mm256_set1_pd(1.0);
+    __m256d denomzero = _mm256_cmp_pd(denom, zero, _CMP_EQ_OQ);
+    __m256d azero = _mm256_cmp_pd(a, zero, _CMP_EQ_OQ);
+    __m256d ezero = _mm256_cmp_pd(e, zero, _CMP_EQ_OQ);
+    __m256d denomsafe = _mm256_blendv_pd(denom, one, denomzero);
+    __m256d asafe = _mm256_blendv_pd(a, one, azero);
+    __m256d esafe = _mm256_blendv_pd(e, one, ezero);
+
+    __m256d s = clamp01(_mm256_div_pd(_mm256_sub_pd(_mm256_mul_pd(b, f), _mm256_mul_pd(c, e)), denomsafe));
+    s = _mm256_blendv_pd(s, zero, denomzero);
+    __m256d tnom = _mm256_add_pd(_mm256_mul_pd(b, s), f);
+    __m256d low = _mm256_or_pd(_mm256_cmp_pd(tnom, zero, _CMP_LT_OQ), ezero);
+    __m256d high = _mm256_andnot_pd(low, _mm256_cmp_pd(tnom, e, _CMP_GT_OQ));
+    __m256d slow = _mm256_blendv_pd(clamp01(_mm256_div_pd(_mm256_sub_pd(zero, c), asafe)), zero, azero);
+    __m256d shigh = _mm256_blendv_pd(clamp01(_mm256_div_pd(_mm256_sub_pd(b, c), asafe)), zero, azero);
+    s = _mm256_blendv_pd(_mm256_blendv_pd(s, shigh, high), slow, low);
+    __m256d t = _mm256_blendv_pd(_mm256_blendv_pd(_mm256_div_pd(tnom, esafe), one, high), zero, low);
+
+    __m256d diff2 = zero;
+    for (int k = 0; k < 3; k++)
+    {
+        __m256d diff = _mm256_sub_pd(_mm256_add_pd(q0[k], _mm256_mul_pd(t, d2[k])), _mm256_add_pd(p0[k], _mm256_mul_pd(s, d1[k])));
+        diff2 = _mm256_add_pd(diff2, _mm256_mul_pd(diff, diff));
+    }
+    _mm256_storeu_pd(dist + i, _mm256_sqrt_pd(diff2));
+    _mm256_storeu_pd(p1bary + i, s);
+    _mm256_storeu_pd(q1bary + i, t);
+}
+#endif
+
+void Distance::edgeEdgeDistances(const SegmentPairs &pairs, double *dist, double *p1bary, double *q1bary)
+{
+    int n = pairs.size();
+    int i = 0;
+#ifdef __AVX2__
+    for (; i + 4 <= n; i += 4)
+        edgeEdgeDistanceAVX2(pairs, i, dist, p1bary, q1bary);
+#endif
+    for (; i < n; i++)
+        edgeEdgeDistanceBranchless(pairs, i, dist, p1bary, q1bary);
+}
+
+#ifdef __AVX2__
+// Pairs [i, i + 4) of vertexFaceDistances. The regions vertexFaceDistance tests in turn become masks, and the closest
+// point and barycentrics of every region are computed and blended, the first region that holds winning. A division by
+// zero only reaches the output where vertexFaceDistance divides by zero too.
+static inline void vertexFaceDistanceAVX2(const Distance::PointTriangles &pairs, int i, double *dist, double *q1bary, double *q2bary)
+{
+    __m256d p[3], q0[3], q1[3], q2[3], ab[3], ac[3], ap[3], bp[3], cp[3];
+    for (int k = 0; k < 3; k++)
+    {
+        p[k] = _mm256_loadu_pd(pairs.p[k].data() + i);
+        q0[k] = _mm256_loadu_pd(pairs.q0[k].data() + i);
+        q1[k] = _mm256_loadu_pd(pairs.q1[k].data() + i);
+        q2[k] = _mm256_loadu_pd(pairs.q2[k].data() + i);
+        ab[k] = _mm256_sub_pd(q1[k], q0[k]);
+        ac[k] = _mm256_sub_pd(q2[k], q0[k]);
+        ap[k] = _mm256_sub_pd(p[k], q0[k]);
+        bp[k] = _mm256_sub_pd(p[k], q1[k]);
+        cp[k] = _mm256_sub_pd(p[k], q2[k]);
+    }
+    auto dot = [](const __m256d *u, const __m256d *v) -> __m256d
+    {
+        return _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(u[0], v[0]), _mm256_mul_pd(u[1], v[1])), _mm256_mul_pd(u[2], v[2]));
+    };
+    auto cross = [](__m256d a, __m256d b, __m256d c, __m256d d) -> __m256d
+    {
+        return _mm256_sub_pd(_mm256_mul_pd(a, b), _mm256_mul_pd(c, d));
+    };
+    __m256d d1 = dot(ab, ap);
+    __m256d d2 = dot(ac, ap);
+    __m256d d3 = dot(ab, bp);
+    __m256d d4 = dot(ac, bp);
+    __m256d d5 = dot(ab, cp);
+    __m256d d6 = dot(ac, cp);
+    __m256d vc = cross(d1, d4, d3, d2);
+    __m256d vb = cross(d5, d2, d1, d6);
+    __m256d va = cross(d3, d6, d5, d4);
+
+    const __m256d zero = _mm256_setzero_pd();
+    const __m256d one = _mm256_set1_pd(1.0);
+    __m256d d43 = _mm256_sub_pd(d4, d3);
+    __m256d d56 = _mm256_sub_pd(d5, d6);
+    __m256d inA = _mm256_and_pd(_mm256_cmp_pd(d1, zero, _CMP_LE_OQ), _mm256_cmp_pd(d2, zero, _CMP_LE_OQ));
+    __m256d inB = _mm256_and_pd(_mm256_cmp_pd(d3, zero, _CMP_GE_OQ), _mm256_cmp_pd(d4, d3, _CMP_LE_OQ));
+    __m256d inAB = _mm256_and_pd(_mm256_and_pd(_mm256_cmp_pd(vc, zero, _CMP_LE_OQ), _mm256_cmp_pd(d1, zero, _CMP_GE_OQ)),
+        _mm256_cmp_pd(d3, zero, _CMP_LE_OQ));
+    __m256d inC = _mm256_and_pd(_mm256_cmp_pd(d6, zero, _CMP_GE_OQ), _mm256_cmp_pd(d5, d6, _CMP_LE_OQ));
+    __m256d inAC = _mm256_and_pd(_mm256_and_pd(_mm256_cmp_pd(vb, zero, _CMP_LE_OQ), _mm256_cmp_pd(d2, zero, _CMP_GE_OQ)),
+        _mm256_cmp_pd(d6, zero, _CMP_LE_OQ));
+    __m256d inBC = _mm256_and_pd(_mm256_and_pd(_mm256_cmp_pd(va, zero, _CMP_LE_OQ), _mm256_cmp_pd(d43, zero, _CMP_GE_OQ)),
+        _mm256_cmp_pd(d56, zero, _CMP_GE_OQ));
+
+    __m256d vab = _mm256_div_pd(d1, _mm256_sub_pd(d1, d3));
+    __m256d wac = _mm256_div_pd(d2, _mm256_sub_pd(d2, d6));
+    __m256d wbc = _mm256_div_pd(d43, _mm256_add_pd(d43, d56));
+    __m256d denom = _mm256_div_pd(one, _mm256_add_pd(_mm256_add_pd(va, vb), vc));
+    __m256d v = _mm256_mul_pd(vb, denom);
+    __m256d w = _mm256_mul_pd(vc, denom);
+    __m256d u = _mm256_sub_pd(_mm256_sub_pd(one, v), w);
+
+    __m256d diff2 = zero;
+    for (int k = 0; k < 3; k++)
+    {
+        __m256d c = _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(u, q0[k]), _mm256_mul_pd(v, q1[k])), _mm256_mul_pd(w, q2[k]));
+        c = _mm256_blendv_pd(c, _mm256_add_pd(q1[k], _mm256_mul_pd(wbc, _mm256_sub_pd(q2[k], q1[k]))), inBC);
+        c = _mm256_blendv_pd(c, _mm256_add_pd(q0[k], _mm256_mul_pd(wac, ac[k])), inAC);
+        c = _mm256_blendv_pd(c, q2[k], inC);
+        c = _mm256_blendv_pd(c, _mm256_add_pd(q0[k], _mm256_mul_pd(vab, ab[k])), inAB);
+        c = _mm256_blendv_pd(c, q1[k], inB);
+        c = _mm256_blendv_pd(c, q0[k], inA);
+        __m256d diff = _mm256_sub_pd(c, p[k]);
+        diff2 = _mm256_add_pd(diff2, _mm256_mul_pd(diff, diff));
+    }
+    __m256d b1 = _mm256_blendv_pd(v, _mm256_sub_pd(one, wbc), inBC);
+    b1 = _mm256_blendv_pd(b1, zero, _mm256_or_pd(inAC, inC));
+    b1 = _mm256_blendv_pd(b1, vab, inAB);
+    b1 = _mm256_blendv_pd(b1, one, inB);
+    b1 = _mm256_blendv_pd(b1, zero, inA);
+    __m256d b2 = _mm256_blendv_pd(w, wbc, inBC);
+    b2 = _mm256_blendv_pd(b2, wac, inAC);
+    b2 = _mm256_blendv_pd(b2, one, inC);
+    b2 = _mm256_blendv_pd(b2, zero, _mm256_or_pd(_mm256_or_pd(inA, inB), inAB));
+    _mm256_storeu_pd(dist + i, _mm256_sqrt_pd(diff2));
+    _mm256_storeu_pd(q1bary + i, b1);
+    _mm256_storeu_pd(q2bary + i, b2);
+}
+#endif
+
+void Distance::vertexFaceDistances(const PointTriangles &pairs, double *dist, double *q1bary, double *q2bary)
+{
+    int n = pairs.size();
+    int i = 0;
+#ifdef __AVX2__
+    for (; i + 4 <= n; i += 4)
+        vertexFaceDistanceAVX2(pairs, i, dist, q1bary, q2bary);
+#endif
+    // evaluating every region, as above, is slower than branching one pair at a time
+    for (; i < n; i++)
+    {
+        Eigen::Vector3d p(pairs.p[0][i], pairs.p[1][i], pairs.p[2][i]);
+        Eigen::Vector3d q0(pairs.q0[0][i], pairs.q0[1][i], pairs.q0[2][i]);
+        Eigen::Vector3d q1(pairs.q1[0][i], pairs.q1[1][i], pairs.q1[2][i]);
+        Eigen::Vector3d q2(pairs.q2[0][i], pairs.q2[1][i], pairs.q2[2][i]);
+        double b0, b1, b2;
+        dist[i] = vertexFaceDistance(p, q0, q1, q2, b0, b1, b2).norm();
+        q1bary[i] = b1;
+        q2bary[i] = b2;
+    }
+}
+
+double Distance::meshSelfDistance(const Eigen::VectorXd &verts, const Eigen::Matrix3Xi &faces, const std::set<int> &fixedVerts)
+{
+    SelfDistanceMesh mesh(verts, faces, fixedVerts);
+    BVH<3> facebvh(mesh.pos, mesh.tris);
+    BVH<2> edgebvh(mesh.pos, mesh.edges);
+
+    std::atomic<double> best(std::numeric_limits<double>::infinity());
+
+    // vertex-face pairs: branch and bound over the face hierarchy, nearest child first
+    int nverts = mesh.pos.size();
+    parallelFor(0, nverts, [&](int v)
+    {
+        const auto &nodes = facebvh.nodes();
+        if (nodes.empty())
+            return;
+        const Eigen::Vector3d &p = mesh.pos[v];
+        LeafBatch &batch = threadLeafBatch();
+        std::vector<int> stack(1, 0);
+        while (!stack.empty())
+        {
+            int id = stack.back();
+            stack.pop_back();
+            double bound = best.load(std::memory_order_relaxed);
+            if (nodes[id].box.squaredDistance(p) >= bound * bound)
+                continue;
+            if (nodes[id].count > 0)
+            {
+                batch.pairs.clear();
+                for (int i = nodes[id].start; i < nodes[id].start + nodes[id].count; i++)
+                {
+                    const Eigen::Vector3i &f = mesh.tris[facebvh.prim(i)];
+                    if (mesh.skipVertexFace(v, f))
+                        continue;
+                    batch.pairs.push_back(p, mesh.pos[f[0]], mesh.pos[f[1]], mesh.pos[f[2]]);
+                }
+                double leafbest = std::numeric_limits<double>::infinity();
+                for (double d : batch.evaluate())
+                    leafbest = std::min(leafbest, d);
+                atomicMin(best, leafbest);
+                continue;
+            }
+            int l = nodes[id].left, r = nodes[id].right;
+            if (nodes[l].box.squaredDistance(p) < nodes[r].box.squaredDistance(p))
+                std::swap(l, r);
+            stack.push_back(l);
+            stack.push_back(r);
+        }
+    });
+
+    // edge-edge pairs: each edge is tested against the edges after it
+    int nedges = mesh.edges.size();
+    parallelFor(0, nedges, [&](int e)
+    {
+        const auto &nodes = edgebvh.nodes();
+        if (nodes.empty())
+            return;
+        const Eigen::Vector2i &edge = mesh.edges[e];
+        const AABB &ebox = edgebvh.primBox(e);
+        std::vector<int> stack(1, 0);
+        while (!stack.empty())
+        {
+            int id = stack.back();
+            stack.pop_back();
+            double bound = best.load(std::memory_order_relaxed);
+            if (nodes[id].box.squaredDistance(ebox) >= bound * bound)
+                continue;
+            if (nodes[id].count > 0)
+            {
+                for (int i = nodes[id].start; i < nodes[id].start + nodes[id].count; i++)
+                {
+                    int other = edgebvh.prim(i);
+                    if (other <= e || mesh.skipEdgeEdge(edge, mesh.edges[other]))
+                        continue;
+                    atomicMin(best, mesh.edgeEdgeDistance(edge, mesh.edges[other]));
+                }
+                continue;
+            }
+            int l = nodes[id].left, r = nodes[id].right;
+            if (nodes[l].box.squaredDistance(ebox) < nodes[r].box.squaredDistance(ebox))
+                std::swap(l, r);
+            stack.push_back(l);
+            stack.push_back(r);
+        }
+    });
+
+    return best.load();
+}
+
+bool Distance::meshSelfDistanceLessThan(const Eigen::VectorXd &verts, const Eigen::Matrix3Xi &faces, const std::set<int> &fixedVerts, double eta)
+{
+    SelfDistanceMesh mesh(verts, faces, fixedVerts);
+    BVH<3> facebvh(mesh.pos, mesh.tris);
+    BVH<2> edgebvh(mesh.pos, mesh.edges);
+    double eta2 = eta * eta;
+
+    std::atomic<bool> found(false);
+
+    int nverts = mesh.pos.size();
+    parallelFor(0, nverts, [&](int v)
+    {
+        const auto &nodes = facebvh.nodes();
+        if (nodes.empty() || found.load(std::memory_order_relaxed))
+            return;
+        const Eigen::Vector3d &p = mesh.pos[v];
+        LeafBatch &batch = threadLeafBatch();
+        std::vector<int> stack(1, 0);
+        while (!stack.empty() && !found.load(std::memory_order_relaxed))
+        {
+            int id = stack.back();
+            stack.pop_back();
+            if (nodes[id].box.squaredDistance(p) >= eta2)
+                continue;
+            if (nodes[id].count > 0)
+            {
+                batch.pairs.clear();
+                for (int i = nodes[id].start; i < nodes[id].start + nodes[id].count; i++)
+                {
+                    const Eigen::Vector3i &f = mesh.tris[facebvh.prim(i)];
+                    if (mesh.skipVertexFace(v, f))
+                        continue;
+                    // the plane test is a division-free necessary condition; it says nothing for degenerate triangles
+                    Eigen::Vector3d n = (mesh.pos[f[1]] - mesh.pos[f[0]]).cross(mesh.pos[f[2]] - mesh.pos[f[0]]);
+                    if (n.squaredNorm() > 0 && !vertexPlaneDistanceLessThan(p, mesh.pos[f[0]], mesh.pos[f[1]], mesh.pos[f[2]], eta))
+                        continue;
+                    batch.pairs.push_back(p, mesh.pos[f[0]], mesh.pos[f[1]], mesh.pos[f[2]]);
+                }
+                for (double d : batch.evaluate())
+                {
+                    if (d < eta)
+                    {
+                        found = true;
+                        return;
+                    }
+                }
+                continue;
+            }
+            stack.push_back(nodes[id].left);
+            stack.push_back(nodes[id].right);
+        }
+    });
+    if (found)
+        return true;
+
+    int nedges = mesh.edges.size();
+    parallelFor(0, nedges, [&](int e)
+    {
+        const auto &nodes = edgebvh.nodes();
+        if (nodes.empty() || found.load(std::memory_order_relaxed))
+            return;
+        const Eigen::Vector2i &edge = mesh.edges[e];
+        const Eigen::Vector3d &p0 = mesh.pos[edge[0]];
+        const Eigen::Vector3d &p1 = mesh.pos[edge[1]];
+        const AABB &ebox = edgebvh.primBox(e);
+        std::vector<int> stack(1, 0);
+        while (!stack.empty() && !found.load(std::memory_order_relaxed))
+        {
+            int id = stack.back();
+            stack.pop_back();
+            if (nodes[id].box.squaredDistance(ebox) >= eta2)
+                continue;
+            if (nodes[id].count > 0)
+            {
+                for (int i = nodes[id].start; i < nodes[id].start + nodes[id].count; i++)
+                {
+                    int other = edgebvh.prim(i);
+                    const Eigen::Vector2i &oedge = mesh.edges[other];
+                    if (other <= e || mesh.skipEdgeEdge(edge, oedge))
+                        continue;
+                    // likewise the line test says nothing for parallel edges
+                    const Eigen::Vector3d &q0 = mesh.pos[oedge[0]];
+                    const Eigen::Vector3d &q1 = mesh.pos[oedge[1]];
+                    if ((p1 - p0).cross(q1 - q0).squaredNorm() > 0 && !lineLineDistanceLessThan(p0, p1, q0, q1, eta))
+                        continue;
+                    if (mesh.edgeEdgeDistance(edge, oedge) < eta)
+                    {
+                        found = true;
+                        return;
+                    }
+                }
+                continue;
+            }
+            stack.push_back(nodes[id].left);
+            stack.push_back(nodes[id].right);
+        }
+    });
+    return found;
+}
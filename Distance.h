@@ -5,6 +5,7 @@
 #include <Eigen/Geometry>
 #include <algorithm>
 #include <set>
+#include <vector>
 
 class Distance
 {
@@ -173,12 +174,86 @@ class Distance
   return c2-c1;
   }
 
+  // Endpoints of a batch of segment pairs (p0, p1), (q0, q1), stored as structure of arrays (one array per coordinate) for edgeEdgeDistances.
+  struct SegmentPairs
+  {
+    std::vector<double> p0[3], p1[3], q0[3], q1[3];
+
+    int size() const { return p0[0].size(); }
+
+    void clear()
+    {
+      for (int k = 0; k < 3; k++)
+        {
+          p0[k].clear();
+          p1[k].clear();
+          q0[k].clear();
+          q1[k].clear();
+        }
+    }
+
+    void push_back(const Eigen::Vector3d &a0, const Eigen::Vector3d &a1, const Eigen::Vector3d &b0, const Eigen::Vector3d &b1)
+    {
+      for (int k = 0; k < 3; k++)
+        {
+          p0[k].push_back(a0[k]);
+          p1[k].push_back(a1[k]);
+          q0[k].push_back(b0[k]);
+          q1[k].push_back(b1[k]);
+        }
+    }
+  };
+
+  // Batched, branch-free edgeEdgeDistance: for every pair i, dist[i] is the norm of the vector edgeEdgeDistance would return and p1bary[i], q1bary[i]
+  // the barycentric coordinates it would return for p1 and q1 (p0bary = 1 - p1bary, etc). When compiled with AVX2, four pairs are evaluated at a time.
+  static void edgeEdgeDistances(const SegmentPairs &pairs, double *dist, double *p1bary, double *q1bary);
+
+  // Points p and triangles (q0, q1, q2) of a batch of point-triangle pairs, stored as structure of arrays for vertexFaceDistances.
+  struct PointTriangles
+  {
+    std::vector<double> p[3], q0[3], q1[3], q2[3];
+
+    int size() const { return p[0].size(); }
+
+    void clear()
+    {
+      for (int k = 0; k < 3; k++)
+        {
+          p[k].clear();
+          q0[k].clear();
+          q1[k].clear();
+          q2[k].clear();
+        }
+    }
+
+    void push_back(const Eigen::Vector3d &pt, const Eigen::Vector3d &a, const Eigen::Vector3d &b, const Eigen::Vector3d &c)
+    {
+      for (int k = 0; k < 3; k++)
+        {
+          p[k].push_back(pt[k]);
+          q0[k].push_back(a[k]);
+          q1[k].push_back(b[k]);
+          q2[k].push_back(c[k]);
+        }
+    }
+  };
+
+  // Batched vertexFaceDistance: for every pair i, dist[i] is the norm of the vector vertexFaceDistance would return and q1bary[i], q2bary[i]
+  // the barycentric coordinates it would return for q1 and q2 (q0bary = 1 - q1bary - q2bary). When compiled with AVX2, four pairs are evaluated at a time,
+  // branch-free; otherwise (and for the remainder) this is vertexFaceDistance in a loop.
+  static void vertexFaceDistances(const PointTriangles &pairs, double *dist, double *q1bary, double *q2bary);
+
   // Computes the shortest distance between a triangle mesh and itself, i.e. the shortest distance between a vertex and a face that does not contain that vertex, or of an edge and another edge that
   // does not share a vertex. The mesh has verts1.size()/3 vertices, stored as consecutive triplets in the vector verts, and faces stored as vertex indices in the columns of faces. This method assumes
   // that each vertex is part of at least one triangle.
   // Distances between primitives *all* of whose vertices are in fixedVerts are ignored.
+  // Implemented with bounding volume hierarchies over the faces and edges, traversed in parallel.
   static double meshSelfDistance(const Eigen::VectorXd &verts, const Eigen::Matrix3Xi &faces, const std::set<int> &fixedVerts);
 
+  // Returns whether meshSelfDistance(verts, faces, fixedVerts) < eta, stopping at the first such pair of primitives.
+  // Candidate pairs are screened with vertexPlaneDistanceLessThan and lineLineDistanceLessThan before the exact distance.
+  static bool meshSelfDistanceLessThan(const Eigen::VectorXd &verts, const Eigen::Matrix3Xi &faces, const std::set<int> &fixedVerts, double eta);
+
  private:
   static double clamp(double u)
   {
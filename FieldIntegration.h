@@ -2,16 +2,20 @@
 #define FIELDINTEGRATION_H
 
 #include "Surface.h"
+#include "GeometryCache.h"
 #include <Eigen/Core>
 
+class SolverProgress;
+
 class LocalFieldIntegration
 {
 public:
     // Locally integrates a given vector field, assuming:
     // - the surface surf has one connected component
     // - the vector field v has no singularities
+    // - geom holds the cotangent weights, areas and edge metric of surf
     // Result is a rescaling s on the faces of surf.
-    virtual void locallyIntegrateOneComponent(const Surface &surf, const Eigen::MatrixXd &v, Eigen::VectorXd &s) = 0;
+    virtual void locallyIntegrateOneComponent(const Surface &surf, const ComponentGeometry &geom, const Eigen::MatrixXd &v, Eigen::VectorXd &s) = 0;
 };
 
 class GlobalFieldIntegration
@@ -20,15 +24,17 @@ public:
     // Integrates a given vector field, assuming:
     // - the surface surf has one connected component
     // - the vector field v has no singularities
+    // - geom holds the cotangent weights, areas and edge metric of surf
     // Result is a periodic function (values in [0, 2pi)) on the vertices of surf.
-    virtual void globallyIntegrateOneComponent(const Surface &surf, const Eigen::MatrixXd &v, Eigen::VectorXd &s, Eigen::VectorXd &theta) = 0;
+    // Iterative methods report to progress (if not NULL) and stop early, with the last iterate, if it is cancelled.
+    virtual void globallyIntegrateOneComponent(const Surface &surf, const ComponentGeometry &geom, const Eigen::MatrixXd &v, Eigen::VectorXd &s, Eigen::VectorXd &theta, SolverProgress *progress) = 0;
 };
 
 // does nothing except normalize the vector field
 class TrivialLocalIntegration : public LocalFieldIntegration
 {
 public:
-    void locallyIntegrateOneComponent(const Surface &surf, const Eigen::MatrixXd &v, Eigen::VectorXd &s)
+    void locallyIntegrateOneComponent(const Surface &surf, const ComponentGeometry &, const Eigen::MatrixXd &v, Eigen::VectorXd &s)
     {
         int nfaces = surf.nFaces();
         s.resize(nfaces);
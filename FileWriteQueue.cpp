@@ -0,0 +1,61 @@
+#include "FileWriteQueue.h"
+#include <cstdio>
+#include <iostream>
+
+FileWriteQueue::FileWriteQueue() : busy_(false), stopping_(false)
+{
+    worker_ = std::thread(&FileWriteQueue::run, this);
+}
+
+FileWriteQueue::~FileWriteQueue()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    wake_.notify_one();
+    worker_.join();
+}
+
+void FileWriteQueue::write(const std::string &filename, std::string &&contents)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        pending_.push_back(std::make_pair(filename, std::move(contents)));
+    }
+    wake_.notify_one();
+}
+
+void FileWriteQueue::flush()
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    idle_.wait(lock, [this]() { return pending_.empty() && !busy_; });
+}
+
+void FileWriteQueue::run()
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true)
+    {
+        wake_.wait(lock, [this]() { return stopping_ || !pending_.empty(); });
+        if (pending_.empty())
+            break; // stopping, and everything has been written
+
+        std::pair<std::string, std::string> job = std::move(pending_.front());
+        pending_.pop_front();
+        busy_ = true;
+        lock.unlock();
+
+        FILE *f = fopen(job.first.c_str(), "wb");
+        if (!f || fwrite(job.second.data(), 1, job.second.size(), f) != job.second.size())
+            std::cerr << "Error writing " << job.first << std::endl;
+        if (f)
+            fclose(f);
+
+        lock.lock();
+        busy_ = false;
+        if (pending_.empty())
+            idle_.notify_all();
+    }
+    idle_.notify_all();
+}
@@ -0,0 +1,39 @@
+#ifndef FILEWRITEQUEUE_H
+#define FILEWRITEQUEUE_H
+
+#include <string>
+#include <deque>
+#include <utility>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+// Writes whole files on a background thread, in the order they were queued, so exporters return as soon as the
+// contents are formatted. The destructor finishes all pending writes.
+class FileWriteQueue
+{
+public:
+    FileWriteQueue();
+    ~FileWriteQueue();
+
+    FileWriteQueue(const FileWriteQueue &) = delete;
+    FileWriteQueue &operator=(const FileWriteQueue &) = delete;
+
+    void write(const std::string &filename, std::string &&contents);
+
+    // blocks until every queued write has finished
+    void flush();
+
+private:
+    void run();
+
+    std::deque<std::pair<std::string, std::string> > pending_;
+    bool busy_; // the worker is writing a file it has already popped
+    bool stopping_;
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    std::condition_variable idle_;
+    std::thread worker_;
+};
+
+#endif
@@ -1,13 +1,28 @@
 #include "GNGlobalIntegration.h"
 #include <iostream>
 #include <vector>
+#include <algorithm>
+#include <cassert>
 #include <Eigen/Sparse>
 #include <Eigen/Geometry>
+#include "Profiler.h"
+#include "SolverProgress.h"
 
 static const double PI = 3.1415926535898;
 
-void GNGlobalIntegration::globallyIntegrateOneComponent(const Surface &surf, const Eigen::MatrixXd &v, Eigen::VectorXd &scales, Eigen::VectorXd &theta)
+// index into M.valuePtr() of the entry (row, col), which must be part of the sparsity pattern of the compressed matrix M
+static int valueIndex(const Eigen::SparseMatrix<double> &M, int row, int col)
 {
+    const int *begin = M.innerIndexPtr() + M.outerIndexPtr()[col];
+    const int *end = M.innerIndexPtr() + M.outerIndexPtr()[col + 1];
+    const int *it = std::lower_bound(begin, end, row);
+    assert(it != end && *it == row);
+    return int(it - M.innerIndexPtr());
+}
+
+void GNGlobalIntegration::globallyIntegrateOneComponent(const Surface &surf, const ComponentGeometry &, const Eigen::MatrixXd &v, Eigen::VectorXd &scales, Eigen::VectorXd &theta, SolverProgress *progress)
+{
+    PROFILE_SCOPE("GNGlobalIntegration");
     theta.setZero();
 
     int nfaces = surf.nFaces();
@@ -42,64 +57,112 @@ void GNGlobalIntegration::globallyIntegrateOneComponent(const Surface &surf, con
         difVecUnscaled.push_back(e12.dot(faceVec));
         difVecUnscaled.push_back(e20.dot(faceVec));
     }
-    assert((rowsL.size() == 3 * nfaces) && (colsL.size() == 3 * nfaces) && (difVecUnscaled.size() == 3 * nfaces));
+    int nhalfedges = rowsL.size();
+    assert((nhalfedges == 3 * nfaces) && (colsL.size() == 3 * nfaces) && (difVecUnscaled.size() == 3 * nfaces));
     
     assert(scales.size() == nfaces);
 
+    // Everything except the values of the connection Laplacian is independent of the scales, so set it up once:
+    // the vertex degrees, the sparsity pattern of Lmat (and its symbolic factorization), and the scale system matrix.
+    std::vector<double> degree(nverts, 0.0);
+    for (int i = 0; i < nhalfedges; i++)
+    {
+        degree[rowsL[i]] += 1.0;
+        degree[colsL[i]] += 1.0;
+    }
+
+    std::vector<Eigen::Triplet<double> > LPattern;
+    for (int i = 0; i < nhalfedges; i++)
+    {
+        for (int j = 0; j < 2; j++)
+        {
+            for (int k = 0; k < 2; k++)
+            {
+                LPattern.push_back(Eigen::Triplet<double>(2 * rowsL[i] + j, 2 * colsL[i] + k, 0.0));
+                LPattern.push_back(Eigen::Triplet<double>(2 * colsL[i] + k, 2 * rowsL[i] + j, 0.0));
+            }
+        }
+    }
+    for (int i = 0; i < 2 * nverts; i++)
+        LPattern.push_back(Eigen::Triplet<double>(i, i, 0.0));
+    Eigen::SparseMatrix<double> Lmat(2 * nverts, 2 * nverts);
+    Lmat.setFromTriplets(LPattern.begin(), LPattern.end());
+    Lmat.makeCompressed();
+
+    // blockIdx[8*i + 2*j + k] is the slot of entry (2*rowsL[i]+j, 2*colsL[i]+k) in Lmat's value array, blockIdx[8*i + 4 + 2*j + k] that of its transpose
+    std::vector<int> blockIdx(8 * nhalfedges);
+    for (int i = 0; i < nhalfedges; i++)
+    {
+        for (int j = 0; j < 2; j++)
+        {
+            for (int k = 0; k < 2; k++)
+            {
+                blockIdx[8 * i + 2 * j + k] = valueIndex(Lmat, 2 * rowsL[i] + j, 2 * colsL[i] + k);
+                blockIdx[8 * i + 4 + 2 * j + k] = valueIndex(Lmat, 2 * colsL[i] + k, 2 * rowsL[i] + j);
+            }
+        }
+    }
+    std::vector<int> diagIdx(2 * nverts);
+    for (int i = 0; i < 2 * nverts; i++)
+        diagIdx[i] = valueIndex(Lmat, i, i);
+
+    Eigen::SimplicialLDLT<Eigen::SparseMatrix<double> > solverL;
+    solverL.analyzePattern(Lmat);
+
+    // the scale system is diagonal and constant
+    Eigen::VectorXd diagAScales(nfaces);
+    for (int i = 0; i < nhalfedges; i = i + 3)
+    {
+        double diagAVal = 0;
+        for (int j = 0; j < 3; j++)
+            diagAVal += difVecUnscaled[i + j] * difVecUnscaled[i + j];
+        diagAScales(i / 3) = diagAVal;
+    }
+
+    // the eigenvector is warm-started from the previous alternation
+    Eigen::VectorXd eigenVec(2 * nverts);
+    srand(0);
+    eigenVec.setRandom();
+    eigenVec /= eigenVec.norm();
+    double prevEigenVal = 0;
+
+    theta.resize(nverts);
+
     int totalIter = outerIters_;
     for (int iter = 0; iter < totalIter; iter++)
     {
-        std::vector<double> difVec;
-        for (int i = 0; i < difVecUnscaled.size(); i++)
-            difVec.push_back(difVecUnscaled[i] * scales(i / 3));
-        std::vector<Eigen::Triplet<double> > sparseContent;
-        for (int i = 0; i < rowsL.size(); i++)
-            sparseContent.push_back(Eigen::Triplet<double>(rowsL[i], colsL[i], 1));
-        Eigen::SparseMatrix<double> TP(nverts, nverts);
-        Eigen::SparseMatrix<double> TPTran(nverts, nverts);
-        TP.setFromTriplets(sparseContent.begin(), sparseContent.end());
-        TPTran = TP.transpose();
-        TP += TPTran;
-        std::vector<int> degree;
-        for (int i = 0; i < nverts; i++)
-            degree.push_back(TP.row(i).sum());
-        std::vector<Eigen::Triplet<double> > AContent;
-        for (int i = 0; i < rowsL.size(); i++)
+        reportProgress(progress, "global integration", double(iter) / totalIter);
+        // Refresh the values of Lmat = diag(degree) - (A + A^T), where A has the 2x2 rotation block [c -s; s c] at (2*rowsL[i], 2*colsL[i])
+        double *Lvals = Lmat.valuePtr();
+        std::fill(Lvals, Lvals + Lmat.nonZeros(), 0.0);
+        for (int i = 0; i < 2 * nverts; i++)
+            Lvals[diagIdx[i]] += degree[i / 2];
+        for (int i = 0; i < nhalfedges; i++)
         {
-            double cVal = cos(difVec[i]);
-            double sVal = sin(difVec[i]);
-            AContent.push_back(Eigen::Triplet<double>(2 * rowsL[i], 2 * colsL[i], cVal));
-            AContent.push_back(Eigen::Triplet<double>(2 * rowsL[i], 2 * colsL[i] + 1, -sVal));
-            AContent.push_back(Eigen::Triplet<double>(2 * rowsL[i] + 1, 2 * colsL[i], sVal));
-            AContent.push_back(Eigen::Triplet<double>(2 * rowsL[i] + 1, 2 * colsL[i] + 1, cVal));
+            double difVal = difVecUnscaled[i] * scales(i / 3);
+            double cVal = cos(difVal);
+            double sVal = sin(difVal);
+            double block[4] = { cVal, -sVal, sVal, cVal };
+            for (int j = 0; j < 4; j++)
+            {
+                Lvals[blockIdx[8 * i + j]] -= block[j];
+                Lvals[blockIdx[8 * i + 4 + j]] -= block[j];
+            }
         }
-        Eigen::SparseMatrix<double> Amat(2 * nverts, 2 * nverts);
-        Eigen::SparseMatrix<double> Amat_tran(2 * nverts, 2 * nverts);
-        Amat.setFromTriplets(AContent.begin(), AContent.end());
-        Amat_tran = Amat.transpose();
-        Amat += Amat_tran;
-        //
-        std::vector<Eigen::Triplet<double> > LContent;
-        for (int i = 0; i < 2 * nverts; i++)
-            LContent.push_back(Eigen::Triplet<double>(i, i, degree[int(i / 2)]));
-        Eigen::SparseMatrix<double> Lmat(2 * nverts, 2 * nverts);
-        Lmat.setFromTriplets(LContent.begin(), LContent.end());
-        Lmat -= Amat;
         // Eigen Decompose
-        Eigen::SimplicialLDLT<Eigen::SparseMatrix<double> > solverL(Lmat);
-        Eigen::VectorXd eigenVec(Lmat.rows());
-        srand(0);
-        eigenVec.setRandom();
-        eigenVec /= eigenVec.norm();
+        solverL.factorize(Lmat);
         for (int i = 0; i < powerIters_; i++)
         {
-            eigenVec = solverL.solve(eigenVec);
-            eigenVec /= eigenVec.norm();
+            Eigen::VectorXd newVec = solverL.solve(eigenVec);
+            newVec /= newVec.norm();
+            double change = (newVec - eigenVec).norm();
+            eigenVec = newVec;
+            if (change < tol_)
+                break;
         }
         double eigenVal = eigenVec.transpose() * (Lmat * eigenVec);
         std::cout << "Current iteration = " << iter << " currents error is: " << eigenVal << std::endl;
         // Extract the function value
-        theta.resize(nverts);
         for (int i = 0; i < nverts; i++)
         {
             double curCos = eigenVec(2 * i);
@@ -112,42 +175,37 @@ void GNGlobalIntegration::globallyIntegrateOneComponent(const Surface &surf, con
         }
         ////
         //// Re-compute face scales
-        std::vector<double> difVecPred;
-        for (int i = 0; i < rowsL.size(); i++)
-        {
-            double curPred = theta[rowsL[i]] - theta[colsL[i]];
-            if (curPred > PI) curPred -= 2 * PI;
-            if (curPred < -PI) curPred += 2 * PI;
-            difVecPred.push_back(curPred);
-        }
-        Eigen::VectorXd bScales(nfaces);
-        std::vector<double> diagAScales;
-        // TODO: AScalesMat is constant
-        for (int i = 0; i < rowsL.size(); i = i + 3)
+        Eigen::VectorXd curScales(nfaces);
+        for (int i = 0; i < nhalfedges; i = i + 3)
         {
             double bVal = 0;
-            double diagAVal = 0;
             for (int j = 0; j < 3; j++)
             {
-                bVal += difVecPred[i + j] * difVecUnscaled[i + j];
-                diagAVal += difVecUnscaled[i + j] * difVecUnscaled[i + j];
+                double curPred = theta[rowsL[i + j]] - theta[colsL[i + j]];
+                if (curPred > PI) curPred -= 2 * PI;
+                if (curPred < -PI) curPred += 2 * PI;
+                bVal += curPred * difVecUnscaled[i + j];
             }
-            bScales(i / 3) = bVal;
-            diagAScales.push_back(diagAVal);
+            // TODO mu and lambda
+            curScales(i / 3) = bVal / diagAScales(i / 3);
+        }
+
+        double scaleChange = (curScales - scales).norm();
+        scales = curScales;
+
+        if (iter > 0
+            && fabs(eigenVal - prevEigenVal) <= tol_ * std::max(1.0, fabs(eigenVal))
+            && scaleChange <= tol_ * std::max(1.0, scales.norm()))
+        {
+            std::cout << "Converged after " << iter + 1 << " alternations" << std::endl;
+            break;
         }
-        // Construct A
-        // TODO mu and lambda
-        std::vector<Eigen::Triplet<double> > AScalesContent;
-        for (int i = 0; i < nfaces; i++)
-            AScalesContent.push_back(Eigen::Triplet<double>(i, i, diagAScales[i]));
-        Eigen::SparseMatrix<double> AScalesMat(nfaces, nfaces);
-        AScalesMat.setFromTriplets(AScalesContent.begin(), AScalesContent.end());
-        // Solve for scale
-        Eigen::SimplicialLDLT<Eigen::SparseMatrix<double> > solverScales(AScalesMat);
-        Eigen::VectorXd curScales = solverScales.solve(bScales);
-
-        for (int i = 0; i < nfaces; i++)
-            scales(i) = curScales(i);
+        // checked only once theta has been set
+        if (progressCancelled(progress))
+        {
+            std::cout << "Cancelled after " << iter + 1 << " alternations" << std::endl;
+            break;
+        }
+        prevEigenVal = eigenVal;
     }    
 }
-
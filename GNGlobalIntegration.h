@@ -8,13 +8,15 @@
 class GNGlobalIntegration : public  GlobalFieldIntegration
 {
 public:
-    GNGlobalIntegration(int alternationIters, int powerIters) : outerIters_(alternationIters), powerIters_(powerIters) {}
+    // alternations stop early once both the eigenvalue and the scales change by less than (relative) convergenceTol
+    GNGlobalIntegration(int alternationIters, int powerIters, double convergenceTol = 1e-8) : outerIters_(alternationIters), powerIters_(powerIters), tol_(convergenceTol) {}
 
-    void globallyIntegrateOneComponent(const Surface &surf, const Eigen::MatrixXd &v, Eigen::VectorXd &scales, Eigen::VectorXd &theta);
+    void globallyIntegrateOneComponent(const Surface &surf, const ComponentGeometry &geom, const Eigen::MatrixXd &v, Eigen::VectorXd &scales, Eigen::VectorXd &theta, SolverProgress *progress);
     
 private:
     int outerIters_;
     int powerIters_;
+    double tol_;
 };
 
 #endif
@@ -3,6 +3,9 @@
 #include <iostream>
 #include <fstream>
 #include "Surface.h"
+#include "Profiler.h"
+#include "MemoryUsage.h"
+#include "SolverProgress.h"
 #include <igl/cotmatrix.h>
 
 using namespace Eigen;
@@ -355,8 +358,11 @@ void GNtestFiniteDifferences(Weave &weave, SolverParams params)
     }
 }
 
-void oneStep(Weave &weave, SolverParams params)
+void oneStep(Weave &weave, SolverParams params, SolverProgress *progress)
 {    
+    PROFILE_SCOPE("oneStep");
+    if (!reportProgress(progress, "Gauss-Newton step: assembling", 0.0))
+        return;
     int nvars = weave.fs->vectorFields.size();
     Eigen::VectorXd r;
     GNEnergy(weave, params, r);
@@ -386,15 +392,38 @@ void oneStep(Weave &weave, SolverParams params)
     optMat.setFromTriplets(coeffs.begin(), coeffs.end());
     optMat += J.transpose() * M * J;
     std::cout << "Done, " << optMat.nonZeros() << " nonzeros" << std::endl;
+    profileCounter("Gauss-Newton matrix nonzeros", optMat.nonZeros());
     optMat.makeCompressed();
-    Eigen::SimplicialLDLT<Eigen::SparseMatrix<double> > solver;
-    std::cout << "Analyzing" << std::endl;
-    solver.analyzePattern(optMat);
     Eigen::VectorXd rhs = J.transpose() * M * r;
-    std::cout << "Solving" << std::endl;
-    solver.factorize(optMat);
-    Eigen::VectorXd update = solver.solve(rhs);
-    lineSearch(weave, params, update);
+    Eigen::VectorXd update;
+    if (!reportProgress(progress, "Gauss-Newton step: solving", 0.25))
+        return;
+    size_t estimate = estimatedFactorBytes(optMat);
+    if (fitsMemoryBudget(estimate))
+    {
+        Eigen::SimplicialLDLT<Eigen::SparseMatrix<double> > solver;
+        std::cout << "Analyzing" << std::endl;
+        solver.analyzePattern(optMat);
+        std::cout << "Solving" << std::endl;
+        solver.factorize(optMat);
+        update = solver.solve(rhs);
+        if (solver.info() == Eigen::Success)
+        {
+            profileCounter("Gauss-Newton factor nonzeros", solver.matrixL().nestedExpression().nonZeros());
+            profileCounter("Gauss-Newton factor bytes", sparseMatrixBytes(solver.matrixL().nestedExpression()));
+        }
+    }
+    else
+    {
+        std::cout << "LDLT factorization (~" << (estimate >> 20) << " MB) would exceed the memory budget; solving iteratively" << std::endl;
+        Eigen::ConjugateGradient<Eigen::SparseMatrix<double>, Eigen::Lower | Eigen::Upper> solver(optMat);
+        update = solver.solve(rhs);
+    }
+    if (!reportProgress(progress, "Gauss-Newton step: line search", 0.75))
+        return;
+    lineSearch(weave, params, update, progress);
+    if (progressCancelled(progress))
+        return;
     
     GNEnergy(weave, params, r);
     std::cout << "Done, new energy: " << 0.5 * r.transpose()*M*r << std::endl;
@@ -402,8 +431,9 @@ void oneStep(Weave &weave, SolverParams params)
   //  exit(-1);
 }
 
-double lineSearch(Weave &weave, SolverParams params, const Eigen::VectorXd &update)
+double lineSearch(Weave &weave, SolverParams params, const Eigen::VectorXd &update, SolverProgress *progress)
 {
+    PROFILE_SCOPE("lineSearch");
     double t = 1.0;
     double c1 = 0.1;
     double c2 = 0.9;
@@ -432,6 +462,11 @@ double lineSearch(Weave &weave, SolverParams params, const Eigen::VectorXd &upda
 
     while (true)
     {
+        if (progressCancelled(progress))
+        {
+            weave.fs->vectorFields = startVF;
+            return 0;
+        }
         weave.fs->vectorFields = startVF - t * update;
         GNEnergy(weave, params, r);
         double newenergy = 0.5 * r.transpose() * M * r;
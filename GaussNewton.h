@@ -5,6 +5,7 @@
 #include <Eigen/Sparse>
 
 class Weave;
+class SolverProgress;
 
 struct SolverParams
 {
@@ -27,8 +28,10 @@ void GNEnergy(const Weave &weave, SolverParams params, Eigen::VectorXd &E);
 void GNGradient(const Weave &weave, SolverParams params, Eigen::SparseMatrix<double> &J);
 
 void GNtestFiniteDifferences(Weave &weave, SolverParams params);
-double lineSearch(Weave &weave, SolverParams params, const Eigen::VectorXd &update);
-void oneStep(Weave &weave, SolverParams params);
+// If progress is cancelled, restores the fields the search started from and returns 0
+double lineSearch(Weave &weave, SolverParams params, const Eigen::VectorXd &update, SolverProgress *progress = NULL);
+// One Gauss-Newton step; leaves the fields unchanged if progress is cancelled before the line search finishes
+void oneStep(Weave &weave, SolverParams params, SolverProgress *progress = NULL);
 
 /*
  * Computes |F| x m matrix of face energies due to vector field derivative incompatibility, contributed by each vector field on each face.
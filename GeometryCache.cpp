@@ -0,0 +1,32 @@
+#include "GeometryCache.h"
+#include "Surface.h"
+#include <igl/cotmatrix_entries.h>
+#include <igl/doublearea.h>
+
+GeometryCache::GeometryCache(const Surface &base)
+{
+    igl::cotmatrix_entries(base.data().V, base.data().F, cotEntries_);
+    igl::doublearea(base.data().V, base.data().F, faceAreas_);
+    faceAreas_ *= 0.5;
+}
+
+void GeometryCache::gather(const Surface &surf, const Eigen::VectorXi &baseFaces, ComponentGeometry &geom) const
+{
+    int nfaces = surf.nFaces();
+    int nedges = surf.nEdges();
+    geom.cotEntries.resize(nfaces, 3);
+    geom.faceAreas.resize(nfaces);
+    geom.edgeMetric.resize(nedges);
+    geom.edgeMetric.setZero();
+    for (int i = 0; i < nfaces; i++)
+    {
+        int bf = baseFaces[i];
+        geom.cotEntries.row(i) = cotEntries_.row(bf);
+        geom.faceAreas[i] = faceAreas_[bf];
+        // summed over the component's own faces, so an edge on its boundary gets only the one-sided weight
+        for (int j = 0; j < 3; j++)
+        {
+            geom.edgeMetric[surf.data().faceEdges(i, j)] += cotEntries_(bf, j);
+        }
+    }
+}
@@ -0,0 +1,33 @@
+#ifndef GEOMETRYCACHE_H
+#define GEOMETRYCACHE_H
+
+#include <Eigen/Core>
+
+class Surface;
+
+// Geometric operators of one connected component of a covering mesh, gathered from a GeometryCache
+struct ComponentGeometry
+{
+    Eigen::MatrixXd cotEntries; // |F| x 3, cotangent weight of the edge opposite vertex j in triangle i (igl::cotmatrix_entries convention)
+    Eigen::VectorXd faceAreas; // |F|
+    Eigen::VectorXd edgeMetric; // |E|, sum of the cotangent weights of each edge over the component's faces (the face Laplacian entries)
+};
+
+// Per-face geometric quantities of a base surface. Every sheet of a branched cover is geometrically identical to the base
+// mesh, so these are computed once, keyed by base face id, and gathered for any component of the cover.
+class GeometryCache
+{
+public:
+    GeometryCache(const Surface &base);
+
+    int nBaseFaces() const { return faceAreas_.size(); }
+
+    // Gathers the geometry of surf, whose face i lies over base face baseFaces[i] with the same vertex ordering
+    void gather(const Surface &surf, const Eigen::VectorXi &baseFaces, ComponentGeometry &geom) const;
+
+private:
+    Eigen::MatrixXd cotEntries_;
+    Eigen::VectorXd faceAreas_;
+};
+
+#endif
@@ -9,17 +9,38 @@
 #include "GaussNewton.h"
 #include "Weave.h"
 #include "Surface.h"
+#include "Profiler.h"
+#include "MemoryUsage.h"
+#include "SolverProgress.h"
 
 
 
 DualSolver::DualSolver(Eigen::SparseMatrix<double> &M)
 {
-    solver.compute(M);
+    PROFILE_SCOPE("DualSolver::factor");
+    size_t estimate = estimatedFactorBytes(M);
+    iterative = !fitsMemoryBudget(estimate);
+    if (iterative)
+    {
+        std::cout << "QR factorization (~" << (estimate >> 20) << " MB) would exceed the memory budget; solving iteratively" << std::endl;
+        M_ = M;
+        iterativeSolver.compute(M_);
+    }
+    else
+    {
+        solver.compute(M);
+        // SuiteSparse's own peak allocation during the factorization, fill-in included
+        profileCounter("dual QR peak bytes", solver.cholmodCommon()->memory_usage);
+    }
 }
 
 void DualSolver::solve(const Eigen::VectorXd &rhs, Eigen::VectorXd &x)
 {
-    x = solver.solve(rhs);
+    PROFILE_SCOPE("DualSolver::solve");
+    if (iterative)
+        x = iterativeSolver.solve(rhs);
+    else
+        x = solver.solve(rhs);
 }
 
 
@@ -33,11 +54,19 @@ void LinearSolver::clearHandles()
     handles.clear();
 }
 
-void LinearSolver::takeSomeSteps(const Weave &weave, SolverParams params, Eigen::VectorXd &primalVars, Eigen::VectorXd &dualVars, bool isRoSy, int numSteps)
+void LinearSolver::takeSomeSteps(const Weave &weave, SolverParams params, Eigen::VectorXd &primalVars, Eigen::VectorXd &dualVars, bool isRoSy, int numSteps, SolverProgress *progress)
 {
+    PROFILE_SCOPE("LinearSolver::takeSomeSteps");
+    if (!reportProgress(progress, "curl-free solve: factoring", 0.0))
+        return;
     DualSolver *ds = buildDualUpdateSolver(weave, params, isRoSy);
     for(int i=0; i<numSteps; i++)
     {
+        if (!reportProgress(progress, "curl-free solve", double(i) / numSteps))
+        {
+            std::cout << "Cancelled after " << i << " of " << numSteps << " steps" << std::endl;
+            break;
+        }
         std::cout << "###############" << std::endl;
         std::cout << "Step " << i+1 << " of " << numSteps << std::endl;
         std::cout << "###############" << std::endl;
@@ -112,6 +141,7 @@ void LinearSolver::computeEnergy(const Weave &weave, SolverParams params, const
 
 void LinearSolver::updatePrimalVars(const Weave &weave, SolverParams params, Eigen::VectorXd &primalVars, Eigen::VectorXd &dualVars, bool isRoSy )
 {
+    PROFILE_SCOPE("LinearSolver::updatePrimalVars");
     int nfaces = weave.fs->data().F.rows();
     int m = weave.fs->nFields();
     std::cout << " pre-primal update ";
@@ -143,6 +173,7 @@ void LinearSolver::updatePrimalVars(const Weave &weave, SolverParams params, Eig
 
 DualSolver *LinearSolver::buildDualUpdateSolver(const Weave &weave, SolverParams params, bool isRoSy)
 {
+    PROFILE_SCOPE("LinearSolver::buildDualUpdateSolver");
     int nfaces = weave.fs->data().F.rows();
     int m = weave.fs->nFields();
     int nhandles = handles.size();
@@ -226,6 +257,9 @@ DualSolver *LinearSolver::buildDualUpdateSolver(const Weave &weave, SolverParams
     Eigen::SparseMatrix<double> dualMat;
     dualMat.resize(matsize, matsize);
     dualMat.setFromTriplets(dualCoeffs.begin(), dualCoeffs.end());
+    profileCounter("dual matrix size", matsize);
+    profileCounter("dual matrix nonzeros", dualMat.nonZeros());
+    profileCounter("dual matrix bytes", sparseMatrixBytes(dualMat));
     std::cout << "Factoring matrix" << std::endl;
     DualSolver *ds = new DualSolver(dualMat);
     std::cout << "Done" << std::endl;
@@ -241,6 +275,7 @@ void LinearSolver::updateDualVars_new(const Weave &weave, SolverParams params, E
     // LL^T \lambda = Lv
     // delta = - L^T \lambda
     
+    PROFILE_SCOPE("LinearSolver::updateDualVars");
     std::cout << "Building rhs" << std::endl;
 
     int nfaces = weave.fs->data().F.rows();
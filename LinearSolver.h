@@ -5,12 +5,16 @@
 #include <vector>
 #include <Eigen/Sparse>
 #include <Eigen/SPQRSupport>
+#include <Eigen/IterativeLinearSolvers>
 
 class Weave;
 struct SolverParams;
+class SolverProgress;
 
 struct Handle;
 
+// Least-squares solves with the dual update matrix: a sparse QR factorization, or, if that wouldn't fit in the memory
+// budget, conjugate gradients on the normal equations, which only need the matrix itself
 class DualSolver
 {
 public:
@@ -19,13 +23,17 @@ public:
     void solve(const Eigen::VectorXd &rhs, Eigen::VectorXd &x);
     
 private:
+    bool iterative;
     Eigen::SPQR<Eigen::SparseMatrix<double> > solver;
+    Eigen::SparseMatrix<double> M_; // iterativeSolver refers to this
+    Eigen::LeastSquaresConjugateGradient<Eigen::SparseMatrix<double> > iterativeSolver;
 };
 
 class LinearSolver
 {
 public:
-    void takeSomeSteps(const Weave &weave, SolverParams params, Eigen::VectorXd &primalVars, Eigen::VectorXd &dualVars, bool isRoSy, int numSteps);
+    // Stops early, after the last complete step, if progress is cancelled
+    void takeSomeSteps(const Weave &weave, SolverParams params, Eigen::VectorXd &primalVars, Eigen::VectorXd &dualVars, bool isRoSy, int numSteps, SolverProgress *progress = NULL);
 
     void addHandle(const Handle &h);
     void clearHandles();
@@ -5,9 +5,10 @@
 #include <set>
 #include <deque>
 #include <igl/remove_unreferenced.h>
-#include <igl/cotmatrix.h>
 #include <igl/writeOBJ.h>
 #include "CoMISoWrapper.h"
+#include "Profiler.h"
+#include "SolverProgress.h"
 
 static void findCuts(const Eigen::MatrixXd &V, const Eigen::MatrixXi &F,
     std::vector<std::vector<int> > &cuts)
@@ -636,8 +637,11 @@ static void cutMesh(const Eigen::MatrixXd &V, const Eigen::MatrixXi &F,
     delete[] visited;
 }
 
-void MIGlobalIntegration::globallyIntegrateOneComponent(const Surface &surf, const Eigen::MatrixXd &v, Eigen::VectorXd &scales, Eigen::VectorXd &theta)
+void MIGlobalIntegration::globallyIntegrateOneComponent(const Surface &surf, const ComponentGeometry &geom, const Eigen::MatrixXd &v, Eigen::VectorXd &scales, Eigen::VectorXd &theta, SolverProgress *progress)
 {
+    PROFILE_SCOPE("MIGlobalIntegration");
+    // a single mixed-integer solve, which can't be interrupted
+    reportProgress(progress, "global integration (mixed-integer)", 0.0);
     int nverts = surf.nVerts();
     theta.resize(nverts);
     theta.setZero();
@@ -731,7 +735,7 @@ void MIGlobalIntegration::globallyIntegrateOneComponent(const Surface &surf, con
     std::vector<Eigen::Triplet<double> > Minvcoeffs;
     for(int i=0; i<nfaces; i++)
     {
-        double area = s.faceArea(i);
+        double area = geom.faceAreas[i];
         Eigen::Matrix<double, 3, 2> B = s.data().Bs[i];
         Eigen::Matrix2d BTB = area * B.transpose()*B;
         Eigen::Matrix2d BTBinv = BTB.inverse();
@@ -763,7 +767,7 @@ void MIGlobalIntegration::globallyIntegrateOneComponent(const Surface &surf, con
         Eigen::Vector3d vec = B*v.row(i).transpose();
         vec.normalize();
         Eigen::Vector3d n = s.faceNormal(i);
-        double area = s.faceArea(i);
+        double area = geom.faceAreas[i];
         totarea += area;
         Eigen::Vector3d vecperp = n.cross(vec);
         Eigen::Matrix3d metric = vec * vec.transpose() + aniso_*vecperp * vecperp.transpose();
@@ -786,14 +790,19 @@ void MIGlobalIntegration::globallyIntegrateOneComponent(const Surface &surf, con
     Eigen::VectorXd rhs = A.transpose() * D.transpose() * Minv.transpose() * M * projvf;
     Eigen::SparseMatrix<double> Mat = A.transpose()  * D.transpose() * Minv.transpose() * M * Minv * D * A;
 
-    Eigen::SparseMatrix<double> L;
-    igl::cotmatrix(s.data().V, s.data().F, L);
+    // cotan Laplacian of the cut mesh, assembled from the cached cotangent weights (same convention as igl::cotmatrix)
     std::vector<Eigen::Triplet<double> > Laugcoeffs;
-    for (int k = 0; k < L.outerSize(); ++k)
+    for (int i = 0; i < nfaces; i++)
     {
-        for (Eigen::SparseMatrix<double>::InnerIterator it(L, k); it; ++it)
+        for (int j = 0; j < 3; j++)
         {
-            Laugcoeffs.push_back(Eigen::Triplet<double>(it.row(), it.col(), -smoothreg_ * totarea * it.value()));
+            int source = newF(i, (j + 1) % 3);
+            int dest = newF(i, (j + 2) % 3);
+            double weight = -smoothreg_ * totarea * geom.cotEntries(i, j);
+            Laugcoeffs.push_back(Eigen::Triplet<double>(source, dest, weight));
+            Laugcoeffs.push_back(Eigen::Triplet<double>(dest, source, weight));
+            Laugcoeffs.push_back(Eigen::Triplet<double>(source, source, -weight));
+            Laugcoeffs.push_back(Eigen::Triplet<double>(dest, dest, -weight));
         }
     }
     
@@ -812,7 +821,7 @@ void MIGlobalIntegration::globallyIntegrateOneComponent(const Surface &surf, con
     {
         toRound[i] = newverts + i;
     }
-    ComisoWrapper(C, Mat, result, rhs, toRound, 1e-6);
+    ComisoWrapper(C, Mat, result, rhs, toRound, comiso_);
     std::cout << "residual: " << (Mat*result - rhs).norm() << std::endl;
 
     Eigen::SimplicialLDLT<Eigen::SparseMatrix<double> > solver(Mat);
@@ -2,21 +2,24 @@
 #define MIGLOBALINTEGRATION_H
 
 #include "FieldIntegration.h"
+#include "CoMISoWrapper.h"
 #include <Eigen/Sparse>
 
 class MIGlobalIntegration : public GlobalFieldIntegration
 {
 public:
-    MIGlobalIntegration(double anisotropy, double smoothnessReg) :
+    MIGlobalIntegration(double anisotropy, double smoothnessReg, const ComisoParams &comiso = ComisoParams()) :
         aniso_(anisotropy),
-        smoothreg_(smoothnessReg)
+        smoothreg_(smoothnessReg),
+        comiso_(comiso)
     {}
 
-    virtual void globallyIntegrateOneComponent(const Surface &surf, const Eigen::MatrixXd &v, Eigen::VectorXd &s, Eigen::VectorXd &theta);
+    virtual void globallyIntegrateOneComponent(const Surface &surf, const ComponentGeometry &geom, const Eigen::MatrixXd &v, Eigen::VectorXd &s, Eigen::VectorXd &theta, SolverProgress *progress);
 
 private:
     double aniso_;
     double smoothreg_;
+    ComisoParams comiso_;
 };
 
 #endif
\ No newline at end of file
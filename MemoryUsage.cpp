@@ -0,0 +1,118 @@
+#include "MemoryUsage.h"
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <iostream>
+
+#if defined(_WIN32)
+#define NOMINMAX
+#include <windows.h>
+#include <psapi.h>
+#pragma comment(lib, "psapi.lib")
+#else
+#include <sys/resource.h>
+#include <unistd.h>
+#include <cstdio>
+#endif
+#if defined(__linux__)
+#include <fstream>
+#endif
+#if defined(__APPLE__)
+#include <mach/mach.h>
+#endif
+
+size_t currentResidentBytes()
+{
+#if defined(_WIN32)
+    PROCESS_MEMORY_COUNTERS pmc;
+    if (!GetProcessMemoryInfo(GetCurrentProcess(), &pmc, sizeof(pmc)))
+        return 0;
+    return pmc.WorkingSetSize;
+#elif defined(__APPLE__)
+    mach_task_basic_info info;
+    mach_msg_type_number_t count = MACH_TASK_BASIC_INFO_COUNT;
+    if (task_info(mach_task_self(), MACH_TASK_BASIC_INFO, (task_info_t)&info, &count) != KERN_SUCCESS)
+        return 0;
+    return info.resident_size;
+#else
+    // second field of statm: resident pages
+    FILE *f = std::fopen("/proc/self/statm", "r");
+    if (!f)
+        return 0;
+    long size = 0, resident = 0;
+    int read = std::fscanf(f, "%ld %ld", &size, &resident);
+    std::fclose(f);
+    if (read != 2)
+        return 0;
+    return size_t(resident) * size_t(sysconf(_SC_PAGESIZE));
+#endif
+}
+
+size_t peakResidentBytes()
+{
+#if defined(_WIN32)
+    PROCESS_MEMORY_COUNTERS pmc;
+    if (!GetProcessMemoryInfo(GetCurrentProcess(), &pmc, sizeof(pmc)))
+        return 0;
+    return pmc.PeakWorkingSetSize;
+#else
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0)
+        return 0;
+#if defined(__APPLE__)
+    return size_t(usage.ru_maxrss); // bytes on macOS
+#else
+    return size_t(usage.ru_maxrss) * 1024; // kilobytes on Linux
+#endif
+#endif
+}
+
+bool resetPeakResidentBytes()
+{
+#if defined(__linux__)
+    // writing 5 to clear_refs resets the kernel's VmHWM (and getrusage's ru_maxrss) to the current RSS
+    std::ofstream ofs("/proc/self/clear_refs");
+    ofs << "5";
+    ofs.flush();
+    return bool(ofs);
+#else
+    return false;
+#endif
+}
+
+static std::atomic<size_t> budgetBytes(0);
+
+void setMemoryBudget(size_t bytes)
+{
+    budgetBytes = bytes;
+}
+
+size_t memoryBudget()
+{
+    return budgetBytes;
+}
+
+bool fitsMemoryBudget(size_t bytes)
+{
+    size_t budget = budgetBytes;
+    return budget == 0 || currentResidentBytes() + bytes <= budget;
+}
+
+bool overMemoryBudget(const std::string &stage)
+{
+    size_t budget = budgetBytes;
+    if (budget == 0)
+        return false;
+    size_t resident = currentResidentBytes();
+    if (resident <= budget)
+        return false;
+    std::cerr << "Out of memory budget after " << stage << ": " << (resident >> 20) << " MB resident, budget is "
+        << (budget >> 20) << " MB" << std::endl;
+    return true;
+}
+
+size_t estimatedFactorBytes(const Eigen::SparseMatrix<double> &M)
+{
+    double n = std::max<double>(2.0, double(M.rows()));
+    return size_t(double(sparseMatrixBytes(M)) * std::log2(n));
+}
@@ -0,0 +1,38 @@
+#ifndef MEMORYUSAGE_H
+#define MEMORYUSAGE_H
+
+#include <Eigen/Sparse>
+#include <cstddef>
+#include <string>
+
+// Resident set size of this process, in bytes (0 where the platform offers no way to ask)
+size_t currentResidentBytes();
+// High-water mark of the resident set size since the process started, or since the last successful
+// resetPeakResidentBytes(), in bytes
+size_t peakResidentBytes();
+// Restarts the high-water mark at the current resident set size. Only supported on Linux; returns false elsewhere, in
+// which case peakResidentBytes() keeps covering the whole process lifetime.
+bool resetPeakResidentBytes();
+
+// Memory budget of the pipeline, in bytes; 0 (the default) for none. Stages that have a choice switch to their
+// lower-memory strategy when the usual one would not fit, and the pipeline stops with an error once a stage leaves the
+// process over budget.
+void setMemoryBudget(size_t bytes);
+size_t memoryBudget();
+// true if there is no budget or the process can grow by bytes without exceeding it
+bool fitsMemoryBudget(size_t bytes);
+// prints an error and returns true if the process has outgrown the budget; stage names what it was doing
+bool overMemoryBudget(const std::string &stage);
+
+// bytes held by a compressed sparse matrix
+template<typename Scalar, int Options, typename StorageIndex>
+size_t sparseMatrixBytes(const Eigen::SparseMatrix<Scalar, Options, StorageIndex> &M)
+{
+    return size_t(M.nonZeros()) * (sizeof(Scalar) + sizeof(StorageIndex)) + size_t(M.outerSize() + 1) * sizeof(StorageIndex);
+}
+
+// Rough guess at the size of a sparse direct factorization of M, used to decide whether to factor at all. The
+// operators here live on 2D meshes, for which fill-reducing orderings leave O(n log n) nonzeros in the factor.
+size_t estimatedFactorBytes(const Eigen::SparseMatrix<double> &M);
+
+#endif
@@ -0,0 +1,374 @@
+#include "MeshCache.h"
+#include "Checkpoint.h"
+#include "Parallel.h"
+#include "Profiler.h"
+#include <igl/read_triangle_mesh.h>
+#include <fstream>
+#include <iostream>
+#include <filesystem>
+#include <charconv>
+#include <cstring>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+static const char meshMagic[8] = { 'W', 'E', 'A', 'V', 'E', 'M', 'S', 'H' };
+static const int32_t meshVersion = 1;
+
+namespace {
+
+// What one chunk of the OBJ file contributes. Negative (relative) face indices can only be resolved once the number of
+// vertices before the chunk is known, so they are stored relative to the chunk's first vertex and listed in relative.
+struct OBJChunk
+{
+    const char *begin;
+    const char *end;
+    std::vector<double> verts; // x, y, z of each vertex
+    std::vector<int> faces; // three 0-based vertex indices per triangle
+    std::vector<int> relative; // entries of faces still missing the chunk's vertex offset
+    const char *badLine = NULL; // first malformed line, if any
+};
+
+const char *skipSpace(const char *p, const char *end)
+{
+    while (p < end && (*p == ' ' || *p == '\t'))
+        p++;
+    return p;
+}
+
+bool parseDouble(const char *&p, const char *end, double &d)
+{
+    p = skipSpace(p, end);
+    if (p < end && *p == '+')
+        p++;
+    std::from_chars_result res = std::from_chars(p, end, d);
+    if (res.ec != std::errc())
+        return false;
+    p = res.ptr;
+    return true;
+}
+
+bool parseInt(const char *&p, const char *end, int &i)
+{
+    if (p < end && *p == '+')
+        p++;
+    std::from_chars_result res = std::from_chars(p, end, i);
+    if (res.ec != std::errc())
+        return false;
+    p = res.ptr;
+    return true;
+}
+
+// true if the line starting at p (after leading whitespace) is of the given one-letter type
+bool isLineType(const char *p, const char *end, char type)
+{
+    return p + 1 < end && p[0] == type && (p[1] == ' ' || p[1] == '\t');
+}
+
+void parseChunk(OBJChunk &chunk)
+{
+    std::vector<std::pair<int, bool> > poly; // vertex index, and whether it is relative
+    const char *p = chunk.begin;
+    while (p < chunk.end)
+    {
+        const char *eol = (const char *)std::memchr(p, '\n', chunk.end - p);
+        if (!eol)
+            eol = chunk.end;
+        const char *q = skipSpace(p, eol);
+        if (isLineType(q, eol, 'v'))
+        {
+            q++;
+            double x[3];
+            for (int k = 0; k < 3; k++)
+            {
+                if (!parseDouble(q, eol, x[k]))
+                {
+                    chunk.badLine = p;
+                    return;
+                }
+            }
+            // anything after the position (a w coordinate, vertex colors) is ignored
+            chunk.verts.insert(chunk.verts.end(), x, x + 3);
+        }
+        else if (isLineType(q, eol, 'f'))
+        {
+            q++;
+            int nverts = int(chunk.verts.size() / 3);
+            poly.clear();
+            while (true)
+            {
+                q = skipSpace(q, eol);
+                if (q == eol || *q == '\r')
+                    break;
+                int idx;
+                if (!parseInt(q, eol, idx) || idx == 0)
+                {
+                    chunk.badLine = p;
+                    return;
+                }
+                // skip the texture coordinate and normal indices
+                while (q < eol && *q != ' ' && *q != '\t' && *q != '\r')
+                    q++;
+                if (idx > 0)
+                    poly.push_back(std::make_pair(idx - 1, false));
+                else
+                    poly.push_back(std::make_pair(nverts + idx, true));
+            }
+            if (poly.size() < 3)
+            {
+                chunk.badLine = p;
+                return;
+            }
+            for (int i = 1; i + 1 < (int)poly.size(); i++)
+            {
+                const int corners[3] = { 0, i, i + 1 };
+                for (int k = 0; k < 3; k++)
+                {
+                    const std::pair<int, bool> &c = poly[corners[k]];
+                    if (c.second)
+                        chunk.relative.push_back(int(chunk.faces.size()));
+                    chunk.faces.push_back(c.first);
+                }
+            }
+        }
+        p = eol + 1;
+    }
+}
+
+// FNV-1a of blocks of the arrays in parallel, then of the blocks' hashes, so checking a cache costs far less than parsing
+std::string meshHash(const Eigen::MatrixXd &V, const Eigen::MatrixXi &F)
+{
+    const size_t blockSize = 1 << 20;
+    std::vector<std::pair<const char *, size_t> > blocks;
+    auto addBlocks = [&](const char *data, size_t len)
+    {
+        for (size_t start = 0; start < len; start += blockSize)
+            blocks.push_back(std::make_pair(data + start, std::min(blockSize, len - start)));
+    };
+    addBlocks((const char *)V.data(), V.size() * sizeof(double));
+    addBlocks((const char *)F.data(), F.size() * sizeof(int));
+    std::vector<CheckpointKey> blockKeys(blocks.size());
+    parallelFor(0, int(blocks.size()), [&](int i)
+    {
+        blockKeys[i].add(blocks[i].first, blocks[i].second);
+    });
+    CheckpointKey key;
+    key.add(int(V.rows())).add(int(F.rows()));
+    for (const CheckpointKey &k : blockKeys)
+        key.add(k);
+    return key.hex();
+}
+
+}
+
+bool readOBJFast(const std::string &filename, Eigen::MatrixXd &V, Eigen::MatrixXi &F)
+{
+    PROFILE_SCOPE("readOBJFast");
+    std::ifstream ifs(filename, std::ios::binary);
+    if (!ifs)
+        return false;
+    ifs.seekg(0, std::ios::end);
+    size_t size = size_t(ifs.tellg());
+    ifs.seekg(0);
+    std::vector<char> text(size);
+    ifs.read(text.data(), size);
+    if (!ifs)
+    {
+        std::cerr << "Error reading " << filename << std::endl;
+        return false;
+    }
+
+    // chunks of about a megabyte, each starting at the beginning of a line
+    const size_t chunkSize = 1 << 20;
+    const char *begin = text.data();
+    const char *end = begin + size;
+    std::vector<OBJChunk> chunks;
+    const char *start = begin;
+    while (start < end)
+    {
+        const char *stop = (size_t(end - start) <= chunkSize) ? end : start + chunkSize;
+        if (stop < end)
+        {
+            const char *eol = (const char *)std::memchr(stop, '\n', end - stop);
+            stop = eol ? eol + 1 : end;
+        }
+        chunks.push_back(OBJChunk());
+        chunks.back().begin = start;
+        chunks.back().end = stop;
+        start = stop;
+    }
+    parallelFor(0, int(chunks.size()), [&](int i)
+    {
+        parseChunk(chunks[i]);
+    });
+
+    std::vector<int> vertOffsets(chunks.size() + 1, 0);
+    std::vector<int> faceOffsets(chunks.size() + 1, 0);
+    for (int i = 0; i < (int)chunks.size(); i++)
+    {
+        if (chunks[i].badLine)
+        {
+            const char *eol = (const char *)std::memchr(chunks[i].badLine, '\n', end - chunks[i].badLine);
+            std::cerr << "Can't parse line \"" << std::string(chunks[i].badLine, eol ? eol : end) << "\" of " << filename << std::endl;
+            return false;
+        }
+        vertOffsets[i + 1] = vertOffsets[i] + int(chunks[i].verts.size() / 3);
+        faceOffsets[i + 1] = faceOffsets[i] + int(chunks[i].faces.size() / 3);
+    }
+    int nverts = vertOffsets.back();
+    int nfaces = faceOffsets.back();
+
+    Eigen::MatrixXd newV(nverts, 3);
+    Eigen::MatrixXi newF(nfaces, 3);
+    std::vector<char> badIndex(chunks.size(), 0);
+    parallelFor(0, int(chunks.size()), [&](int i)
+    {
+        OBJChunk &chunk = chunks[i];
+        for (int idx : chunk.relative)
+            chunk.faces[idx] += vertOffsets[i];
+        int chunkverts = int(chunk.verts.size() / 3);
+        for (int j = 0; j < chunkverts; j++)
+        {
+            for (int k = 0; k < 3; k++)
+                newV(vertOffsets[i] + j, k) = chunk.verts[3 * j + k];
+        }
+        int chunkfaces = int(chunk.faces.size() / 3);
+        for (int j = 0; j < chunkfaces; j++)
+        {
+            for (int k = 0; k < 3; k++)
+            {
+                int v = chunk.faces[3 * j + k];
+                if (v < 0 || v >= nverts)
+                    badIndex[i] = 1;
+                newF(faceOffsets[i] + j, k) = v;
+            }
+        }
+    });
+    for (char bad : badIndex)
+    {
+        if (bad)
+        {
+            std::cerr << filename << " has faces referring to vertices that don't exist" << std::endl;
+            return false;
+        }
+    }
+    V.swap(newV);
+    F.swap(newF);
+    return true;
+}
+
+bool meshSourceStamp(const std::string &filename, MeshSourceStamp &stamp)
+{
+    std::error_code ec;
+    uint64_t size = std::filesystem::file_size(filename, ec);
+    if (ec)
+        return false;
+    std::filesystem::file_time_type mtime = std::filesystem::last_write_time(filename, ec);
+    if (ec)
+        return false;
+    stamp.size = size;
+    stamp.mtime = int64_t(mtime.time_since_epoch().count());
+    return true;
+}
+
+bool writeMeshCache(const std::string &filename, const MeshSourceStamp &source, const Eigen::MatrixXd &V, const Eigen::MatrixXi &F)
+{
+    std::ofstream ofs(filename, std::ios::binary);
+    if (!ofs)
+        return false;
+    int32_t header[4] = { meshVersion, int32_t(V.rows()), int32_t(F.rows()), 0 };
+    std::string hash = meshHash(V, F);
+    ofs.write(meshMagic, sizeof(meshMagic));
+    ofs.write((const char *)header, sizeof(header));
+    ofs.write((const char *)&source.size, sizeof(uint64_t));
+    ofs.write((const char *)&source.mtime, sizeof(int64_t));
+    ofs.write(hash.data(), 16);
+    ofs.write((const char *)V.data(), V.size() * sizeof(double));
+    ofs.write((const char *)F.data(), F.size() * sizeof(int32_t));
+    ofs.flush();
+    return bool(ofs);
+}
+
+bool readMeshCache(const std::string &filename, const MeshSourceStamp &source, Eigen::MatrixXd &V, Eigen::MatrixXi &F)
+{
+    std::ifstream ifs(filename, std::ios::binary);
+    if (!ifs)
+        return false;
+    char magic[8];
+    int32_t header[4];
+    MeshSourceStamp stamp;
+    char hash[16];
+    ifs.read(magic, sizeof(magic));
+    ifs.read((char *)header, sizeof(header));
+    ifs.read((char *)&stamp.size, sizeof(uint64_t));
+    ifs.read((char *)&stamp.mtime, sizeof(int64_t));
+    ifs.read(hash, sizeof(hash));
+    if (!ifs || std::memcmp(magic, meshMagic, sizeof(magic)) != 0 || header[0] != meshVersion)
+    {
+        std::cerr << filename << " is not a mesh cache" << std::endl;
+        return false;
+    }
+    // the mesh changed since the cache was written
+    if (stamp.size != source.size || stamp.mtime != source.mtime)
+        return false;
+    if (header[1] < 0 || header[2] < 0)
+        return false;
+    // a damaged header must not allocate for counts the file can't hold
+    std::streamoff arrays = ifs.tellg();
+    ifs.seekg(0, std::ios::end);
+    if (size_t(ifs.tellg() - arrays) != 3 * size_t(header[1]) * sizeof(double) + 3 * size_t(header[2]) * sizeof(int32_t))
+    {
+        std::cerr << "Error reading mesh cache " << filename << ": file size doesn't match its header" << std::endl;
+        return false;
+    }
+    ifs.seekg(arrays);
+    Eigen::MatrixXd newV(header[1], 3);
+    Eigen::MatrixXi newF(header[2], 3);
+    ifs.read((char *)newV.data(), newV.size() * sizeof(double));
+    ifs.read((char *)newF.data(), newF.size() * sizeof(int32_t));
+    if (!ifs)
+    {
+        std::cerr << "Error reading mesh cache " << filename << ": file is truncated" << std::endl;
+        return false;
+    }
+    if (meshHash(newV, newF) != std::string(hash, sizeof(hash)))
+    {
+        std::cerr << "Mesh cache " << filename << " is corrupt" << std::endl;
+        return false;
+    }
+    V.swap(newV);
+    F.swap(newF);
+    return true;
+}
+
+bool loadTriangleMesh(const std::string &filename, Eigen::MatrixXd &V, Eigen::MatrixXi &F)
+{
+    PROFILE_SCOPE("loadTriangleMesh");
+    MeshSourceStamp stamp;
+    if (!meshSourceStamp(filename, stamp))
+        return false;
+    std::string cachename = filename + ".vfcache";
+    if (readMeshCache(cachename, stamp, V, F))
+        return true;
+
+    std::string ext = std::filesystem::path(filename).extension().string();
+    bool isOBJ = (ext == ".obj" || ext == ".OBJ");
+    if (!(isOBJ && readOBJFast(filename, V, F)) && !igl::read_triangle_mesh(filename, V, F))
+        return false;
+
+    // several batch jobs may load the same mesh at once, so each writes its own temporary file before renaming it into place
+    std::string tmpname = cachename + ".tmp" + std::to_string(std::random_device()());
+    if (!writeMeshCache(tmpname, stamp, V, F))
+    {
+        std::remove(tmpname.c_str());
+        std::cerr << "Couldn't write mesh cache " << cachename << std::endl;
+        return true;
+    }
+    std::remove(cachename.c_str());
+    if (std::rename(tmpname.c_str(), cachename.c_str()) != 0)
+    {
+        std::remove(tmpname.c_str());
+        std::cerr << "Couldn't move mesh cache into place at " << cachename << std::endl;
+    }
+    return true;
+}
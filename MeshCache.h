@@ -0,0 +1,35 @@
+#ifndef MESHCACHE_H
+#define MESHCACHE_H
+
+#include <Eigen/Core>
+#include <string>
+#include <cstdint>
+
+// Reads the v and f lines of an OBJ file, parsing chunks of the file in parallel. Polygons are split into triangle fans,
+// as libigl does; every other kind of line (normals, texture coordinates, groups, materials) is skipped. False, with a
+// message, if the file can't be read, a v or f line is malformed, or a face refers to a vertex that doesn't exist.
+bool readOBJFast(const std::string &filename, Eigen::MatrixXd &V, Eigen::MatrixXi &F);
+
+// Identifies the version of a mesh file a cache was made from
+struct MeshSourceStamp
+{
+    uint64_t size;
+    int64_t mtime; // modification time, in the filesystem clock's ticks
+};
+
+// false if the file doesn't exist
+bool meshSourceStamp(const std::string &filename, MeshSourceStamp &stamp);
+
+// Binary V/F cache. Layout, little-endian, with every array 8-byte aligned so the file can be memory-mapped:
+//   char[8] "WEAVEMSH", int32 version, int32 nverts, int32 nfaces, int32 padding,
+//   uint64 source size, int64 source mtime, char[16] hex FNV-1a hash of the two arrays
+//   float64 V[3 * nverts], int32 F[3 * nfaces] (column-major, i.e. all x, then all y, then all z, as Eigen stores them)
+bool writeMeshCache(const std::string &filename, const MeshSourceStamp &source, const Eigen::MatrixXd &V, const Eigen::MatrixXi &F);
+// fails, without modifying V and F, unless the file is complete, was made from source, and its arrays match their hash
+bool readMeshCache(const std::string &filename, const MeshSourceStamp &source, Eigen::MatrixXd &V, Eigen::MatrixXi &F);
+
+// Loads a triangle mesh from its cache, filename + ".vfcache", if that is up to date. Otherwise parses the mesh (OBJ
+// with readOBJFast, other formats, or OBJs it rejects, through libigl) and rewrites the cache for the next load.
+bool loadTriangleMesh(const std::string &filename, Eigen::MatrixXd &V, Eigen::MatrixXi &F);
+
+#endif
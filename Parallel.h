@@ -0,0 +1,65 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include <thread>
+#include <vector>
+#include <algorithm>
+
+// Maximum number of threads parallelFor may use when called from this thread; 0 (the default) for one per hardware
+// thread. Lets several pipelines share a machine without each assuming it owns every core.
+inline int &threadBudget()
+{
+    thread_local int budget = 0;
+    return budget;
+}
+
+inline void setThreadBudget(int threads)
+{
+    threadBudget() = std::max(0, threads);
+}
+
+// Number of worker threads to use for n independent work items
+inline int numWorkerThreads(int n)
+{
+    int hw = std::max(1, int(std::thread::hardware_concurrency()));
+    if (threadBudget() > 0)
+        hw = std::min(hw, threadBudget());
+    return std::max(1, std::min(n, hw));
+}
+
+// Calls f(i) for every i in [begin, end), splitting the range into one contiguous block per thread.
+// f must be safe to call concurrently for different i.
+template<typename Func>
+void parallelFor(int begin, int end, Func f)
+{
+    int n = end - begin;
+    if (n <= 0)
+        return;
+    int nthreads = numWorkerThreads(n);
+    if (nthreads == 1)
+    {
+        for (int i = begin; i < end; i++)
+            f(i);
+        return;
+    }
+    std::vector<std::thread> threads;
+    int blocksize = (n + nthreads - 1) / nthreads;
+    for (int t = 0; t < nthreads; t++)
+    {
+        int blockbegin = begin + t * blocksize;
+        int blockend = std::min(end, blockbegin + blocksize);
+        if (blockbegin >= blockend)
+            break;
+        threads.push_back(std::thread([blockbegin, blockend, &f]()
+        {
+            // the caller's budget is already spent on these threads; nested loops run serially
+            setThreadBudget(1);
+            for (int i = blockbegin; i < blockend; i++)
+                f(i);
+        }));
+    }
+    for (auto &t : threads)
+        t.join();
+}
+
+#endif
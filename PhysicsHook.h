@@ -3,13 +3,49 @@
 
 #include <mutex>
 #include <thread>
+#include <memory>
+#include <cstdint>
+#include "SolverProgress.h"
 #include <igl/opengl/glfw/Viewer.h>
 #include <igl/opengl/glfw/imgui/ImGuiMenu.h>
 
+/*
+ * Hands immutable render snapshots from whichever thread builds them to the render thread. publish() swaps in a new
+ * snapshot, stamped with an increasing version; the renderer holds on to the last one it picked up for as long as it
+ * draws it, so nobody waits for more than a pointer swap, and comparing versions tells the renderer when to re-upload.
+ * Stamping and storing happen under one lock, so with several publishing threads the stored snapshot is always the one
+ * with the newest version. Snapshot needs a uint64_t version member.
+ */
+template<typename Snapshot>
+class SnapshotBuffer
+{
+public:
+    SnapshotBuffer() : version_(0) {}
+
+    void publish(std::shared_ptr<Snapshot> snapshot)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        snapshot->version = ++version_;
+        latest_ = std::move(snapshot);
+    }
+
+    // NULL until the first publish()
+    std::shared_ptr<const Snapshot> latest() const
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return latest_;
+    }
+
+private:
+    mutable std::mutex mutex_;
+    uint64_t version_;
+    std::shared_ptr<const Snapshot> latest_;
+};
+
 class PhysicsHook
 {
 public:
-    PhysicsHook() : sim_thread(NULL), please_pause(false), please_die(false), running(false) 
+    PhysicsHook() : sim_thread(NULL), please_pause(false), please_die(false), running(false), stepping(false) 
     {
     }
 
@@ -41,7 +77,8 @@ public:
 
     /*
      * Takes one simulation "step." You can do whatever you want here, but the granularity of your computation should 
-     * be small enough that the user can view/pause/kill the simulation at interactive rates.
+     * be small enough that the user can view/pause/kill the simulation at interactive rates: either keep steps short,
+     * or pass simProgress down into the long computations, which pausing, resetting or killing cancels.
      * This method *must* be thread-safe with respect to renderRenderGeometry() (easiest is to not touch any rendering
      * data structures at all).
      */
@@ -49,16 +86,17 @@ public:
 
     /*
      * Update the rendering data structures here. This method will be called in alternation with simulateOneStep().
-     * This method blocks rendering in the viewer, so do *not* do extensive computation here (leave it to 
-     * simulateOneStep()).
+     * It runs concurrently with renderRenderGeometry(), so it should build a fresh snapshot of everything to be drawn and
+     * publish it through a SnapshotBuffer rather than modify data the renderer may be reading.
      */
     virtual void updateRenderGeometry() = 0;
 
     /*
-     * Perform any actual rendering here. This method *must* be thread-safe with respect to simulateOneStep().
-     * This method runs in the same thread as the viewer and blocks user IO, so there really should not be any
-     * extensive computation here or the UI will lag/become unresponsive (the whole reason the simulation itself
-     * is in its own thread.)
+     * Perform any actual rendering here. This method *must* be thread-safe with respect to simulateOneStep() and
+     * updateRenderGeometry(). It is called every frame, in the same thread as the viewer, and blocks user IO, so
+     * there really should not be any extensive computation here or the UI will lag/become unresponsive (the whole
+     * reason the simulation itself is in its own thread); in particular, only re-upload to the viewer when the latest
+     * snapshot or the display settings changed.
      */
     virtual void renderRenderGeometry(igl::opengl::glfw::Viewer &viewer) = 0;
 
@@ -101,19 +139,22 @@ public:
         killSimThread();
         please_die = running = false;
         please_pause = true;
+        simProgress.reset();
         initSimulation();
         updateRenderGeometry();
         sim_thread = new std::thread(&PhysicsHook::runSimThread, this);
     }
 
     /*
-     * Pause a running simulation. The simulation will pause at the end of its current "step"; this method will not
-     * interrupt simulateOneStep mid-processing.
+     * Pause a running simulation. The simulation will pause at the end of its current "step", which is cut short if
+     * it checks simProgress.
      */
     void pause()
     {
         status_mutex.lock();
         please_pause = true;
+        if (stepping)
+            simProgress.cancel();
         status_mutex.unlock();
     }
 
@@ -129,9 +170,13 @@ public:
 
     void render(igl::opengl::glfw::Viewer &viewer)
     {
-        render_mutex.lock();
         renderRenderGeometry(viewer);
-        render_mutex.unlock();
+    }
+
+    // what the current (or last) step reported, for a progress bar
+    const SolverProgress &stepProgress() const
+    {
+        return simProgress;
     }
     
 protected:
@@ -148,6 +193,7 @@ protected:
 
             status_mutex.lock();
             bool pausenow = please_pause;
+            stepping = !pausenow;
             status_mutex.unlock();
             if (pausenow)
             {
@@ -156,11 +202,12 @@ protected:
             else
             {
                 done = simulateOneStep();
-                render_mutex.lock();
                 updateRenderGeometry();
-                render_mutex.unlock();
             }
             status_mutex.lock();
+            // a pause or kill that cancelled this step is still pending; only the step itself needed stopping
+            stepping = false;
+            simProgress.reset();
             if (please_die)
                 done = true;
             status_mutex.unlock();
@@ -177,6 +224,8 @@ protected:
         {
             status_mutex.lock();
             please_die = true;
+            if (stepping)
+                simProgress.cancel();
             status_mutex.unlock();
             sim_thread->join();
             delete sim_thread;
@@ -188,8 +237,11 @@ protected:
     bool please_pause;
     bool please_die;
     bool running;
-    std::mutex render_mutex;
+    bool stepping; // simulateOneStep() is running; cancel simProgress to cut it short
     std::mutex status_mutex;
+    // simulateOneStep() should report to and check this; it is only ever cancelled mid-step, so computations started
+    // from the GUI thread through the same object run to completion
+    SolverProgress simProgress;
 };
 
 #endif
@@ -0,0 +1,227 @@
+#include "PipelineOptions.h"
+#include <iostream>
+#include <fstream>
+#include <sstream>
+
+PipelineRunOptions::PipelineRunOptions() : threads(0), memoryBudget(0)
+{
+}
+
+void setWholePipelineDefaults(WeavePipeline &pipeline)
+{
+    pipeline.desiredRoSyN = 6;
+    pipeline.targetResolution = 30000;
+}
+
+void printPipelineOptions(std::ostream &os)
+{
+    os << "Input:" << std::endl
+        << "  mesh FILE             surface mesh to weave" << std::endl
+        << "  field FILE            start from this .rlx field instead of designing one" << std::endl
+        << "Field design:" << std::endl
+        << "  resolution N          target face count after resampling (30000)" << std::endl
+        << "  write-resampled 0|1   save the resampled mesh to resampled.obj (1; batch jobs default to 0)" << std::endl
+        << "  rosy N                symmetry degree of the designed field (6)" << std::endl
+        << "  solver curlfree|smooth" << std::endl
+        << "  lambdacompat X        compatibility weight of the initial RoSy solve" << std::endl
+        << "  lambdareg X           Tikhonov regularization" << std::endl
+        << "  soft-handles 0|1      soft handle constraints" << std::endl
+        << "  disable-curl 0|1      drop the curl constraint" << std::endl
+        << "Integration:" << std::endl
+        << "  local trivial|curl|spectral" << std::endl
+        << "  local-reg X           regularization of the local integration" << std::endl
+        << "  global gn|mi" << std::endl
+        << "  global-scale X        global rescaling" << std::endl
+        << "  alternations N        Gauss-Newton alternations" << std::endl
+        << "  power-iters N         Gauss-Newton power iterations" << std::endl
+        << "  tolerance X           Gauss-Newton convergence tolerance" << std::endl
+        << "  aniso X               mixed-integer anisotropy" << std::endl
+        << "  theta-reg X           mixed-integer regularization" << std::endl
+        << "  isolines N            isolines per cover sheet" << std::endl
+        << "CoMISo (mixed-integer integration and rounding of the covers):" << std::endl
+        << "  comiso-reg X          regularization of the quadratic system (1e-6)" << std::endl
+        << "  comiso-direct-rounding 0|1, comiso-multiple-rounding 0|1, comiso-rounding-threshold X" << std::endl
+        << "  comiso-local-iters N, comiso-local-error X, comiso-cg-iters N, comiso-cg-error X" << std::endl
+        << "  comiso-final-full 0|1, comiso-verbose 0|1" << std::endl
+        << "Rods:" << std::endl
+        << "  max-curvature X, extend X, seg-len X, min-rod-len X" << std::endl
+        << "Output:" << std::endl
+        << "  export PREFIX         prefix of the exported rods, field, meshes and CSVs" << std::endl
+        << "  checkpoints DIR       save each stage's outputs under DIR and resume from them on reruns" << std::endl
+        << "Resources:" << std::endl
+        << "  threads N             threads for the run's parallel loops (0 for all cores)" << std::endl
+        << "  memory-budget MB      solve iteratively where a factorization wouldn't fit, and stop once a stage exceeds this" << std::endl
+        << "  profile FILE          write a Chrome trace of the run to FILE and print a per-scope summary" << std::endl;
+}
+
+static bool parseDouble(const std::string &value, double &result)
+{
+    std::istringstream ss(value);
+    char extra;
+    return (ss >> result) && !(ss >> extra);
+}
+
+static bool parseInt(const std::string &value, int &result)
+{
+    std::istringstream ss(value);
+    char extra;
+    return (ss >> result) && !(ss >> extra);
+}
+
+static bool parseBool(const std::string &value, bool &result)
+{
+    int i;
+    if (!parseInt(value, i))
+        return false;
+    result = (i != 0);
+    return true;
+}
+
+bool setPipelineOption(WeavePipeline &pipeline, PipelineRunOptions &run, const std::string &key, const std::string &value)
+{
+    if (key == "mesh")
+        pipeline.meshName = value;
+    else if (key == "field")
+        run.fieldName = value;
+    else if (key == "profile")
+        run.profileName = value;
+    else if (key == "export")
+        pipeline.exportPrefix = value;
+    else if (key == "checkpoints")
+        pipeline.checkpointDir = value;
+    else if (key == "memory-budget")
+    {
+        double mb;
+        if (!parseDouble(value, mb) || mb < 0)
+            return false;
+        run.memoryBudget = size_t(mb * 1024 * 1024);
+    }
+    else if (key == "threads")
+        return parseInt(value, run.threads) && run.threads >= 0;
+    else if (key == "resolution")
+        return parseInt(value, pipeline.targetResolution);
+    else if (key == "write-resampled")
+        return parseBool(value, pipeline.writeResampled);
+    else if (key == "rosy")
+        return parseInt(value, pipeline.desiredRoSyN);
+    else if (key == "solver")
+    {
+        if (value == "curlfree")
+            pipeline.solver_mode = CURLFREE;
+        else if (value == "smooth")
+            pipeline.solver_mode = SMOOTH;
+        else
+            return false;
+    }
+    else if (key == "lambdacompat")
+        return parseDouble(value, pipeline.params.lambdacompat);
+    else if (key == "lambdareg")
+        return parseDouble(value, pipeline.params.lambdareg);
+    else if (key == "soft-handles")
+        return parseBool(value, pipeline.params.softHandleConstraint);
+    else if (key == "disable-curl")
+        return parseBool(value, pipeline.params.disableCurlConstraint);
+    else if (key == "local")
+    {
+        if (value == "trivial")
+            pipeline.local_field_integration_method = LFI_TRIVIAL;
+        else if (value == "curl")
+            pipeline.local_field_integration_method = LFI_CURLCORRECT;
+        else if (value == "spectral")
+            pipeline.local_field_integration_method = LFI_SPECTRAL;
+        else
+            return false;
+    }
+    else if (key == "local-reg")
+        return parseDouble(value, pipeline.initSReg);
+    else if (key == "global")
+    {
+        if (value == "gn")
+            pipeline.global_field_integration_method = GFI_GN;
+        else if (value == "mi")
+            pipeline.global_field_integration_method = GFI_MI;
+        else
+            return false;
+    }
+    else if (key == "global-scale")
+        return parseDouble(value, pipeline.globalSScale);
+    else if (key == "alternations")
+        return parseInt(value, pipeline.globalAlternations);
+    else if (key == "power-iters")
+        return parseInt(value, pipeline.globalPowerIters);
+    else if (key == "tolerance")
+        return parseDouble(value, pipeline.globalConvergenceTol);
+    else if (key == "aniso")
+        return parseDouble(value, pipeline.bommesAniso);
+    else if (key == "theta-reg")
+        return parseDouble(value, pipeline.globalThetaReg);
+    else if (key == "isolines")
+        return parseInt(value, pipeline.numISOLines);
+    else if (key == "comiso-reg")
+        return parseDouble(value, pipeline.comisoParams.reg);
+    else if (key == "comiso-direct-rounding")
+        return parseBool(value, pipeline.comisoParams.directRounding);
+    else if (key == "comiso-multiple-rounding")
+        return parseBool(value, pipeline.comisoParams.multipleRounding);
+    else if (key == "comiso-rounding-threshold")
+        return parseDouble(value, pipeline.comisoParams.multipleRoundingThreshold);
+    else if (key == "comiso-local-iters" || key == "comiso-cg-iters")
+    {
+        int iters;
+        if (!parseInt(value, iters) || iters < 0)
+            return false;
+        (key == "comiso-local-iters" ? pipeline.comisoParams.localIters : pipeline.comisoParams.cgIters) = iters;
+    }
+    else if (key == "comiso-local-error")
+        return parseDouble(value, pipeline.comisoParams.localError);
+    else if (key == "comiso-cg-error")
+        return parseDouble(value, pipeline.comisoParams.cgError);
+    else if (key == "comiso-final-full")
+        return parseBool(value, pipeline.comisoParams.finalFull);
+    else if (key == "comiso-verbose")
+        return parseBool(value, pipeline.comisoParams.verbose);
+    else if (key == "max-curvature")
+        return parseDouble(value, pipeline.maxCurvature);
+    else if (key == "extend")
+        return parseDouble(value, pipeline.extendTrace);
+    else if (key == "seg-len")
+        return parseDouble(value, pipeline.segLen);
+    else if (key == "min-rod-len")
+        return parseDouble(value, pipeline.minRodLen);
+    else
+        return false;
+    return true;
+}
+
+bool readPipelineConfig(const char *filename, PipelineOptionList &options)
+{
+    std::ifstream ifs(filename);
+    if (!ifs)
+    {
+        std::cerr << "Couldn't open config file " << filename << std::endl;
+        return false;
+    }
+    // options are checked against a scratch pipeline here, so errors can point at their line
+    WeavePipeline scratch;
+    PipelineRunOptions scratchRun;
+    std::string line;
+    int lineno = 0;
+    while (std::getline(ifs, line))
+    {
+        lineno++;
+        line = line.substr(0, line.find('#'));
+        std::istringstream ss(line);
+        std::string key, value;
+        if (!(ss >> key))
+            continue;
+        std::getline(ss >> std::ws, value);
+        value = value.substr(0, value.find_last_not_of(" \t\r") + 1);
+        if (!setPipelineOption(scratch, scratchRun, key, value))
+        {
+            std::cerr << filename << ":" << lineno << ": bad option \"" << key << " " << value << "\"" << std::endl;
+            return false;
+        }
+        options.push_back(std::make_pair(key, value));
+    }
+    return true;
+}
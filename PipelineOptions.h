@@ -0,0 +1,39 @@
+#ifndef PIPELINEOPTIONS_H
+#define PIPELINEOPTIONS_H
+
+#include "WeavePipeline.h"
+#include <ostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Options of the command-line front ends (headless and batch runs), as "option value" pairs: on the command line as
+// --option value, in config files one pair per line.
+
+// Settings of a run that live outside the WeavePipeline itself
+struct PipelineRunOptions
+{
+    PipelineRunOptions();
+
+    std::string fieldName;   // start from this .rlx field instead of designing one
+    std::string profileName; // write a Chrome trace of the run here
+    int threads;             // thread budget of the run's parallel loops; 0 for all cores
+    size_t memoryBudget;     // bytes; 0 for none
+};
+
+typedef std::vector<std::pair<std::string, std::string> > PipelineOptionList;
+
+// the settings of the GUI's Whole Pipeline button, which the front ends start from
+void setWholePipelineDefaults(WeavePipeline &pipeline);
+
+// the list of options, for usage messages
+void printPipelineOptions(std::ostream &os);
+
+// Applies one option to pipeline or run; false if the option is unknown or its value malformed
+bool setPipelineOption(WeavePipeline &pipeline, PipelineRunOptions &run, const std::string &key, const std::string &value);
+
+// Appends the options in a config file (one "option value" pair per line, # starts a comment) to options. Fails, with
+// a message naming the offending line, if the file can't be read or holds a bad option.
+bool readPipelineConfig(const char *filename, PipelineOptionList &options);
+
+#endif
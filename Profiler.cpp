@@ -0,0 +1,263 @@
+#include "Profiler.h"
+#include <vector>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <iomanip>
+
+std::atomic<bool> profilingEnabledFlag(false);
+
+namespace {
+
+struct ProfileEvent
+{
+    const char *name;
+    bool counter;
+    double start; // microseconds since the profiler's epoch
+    double value; // duration in microseconds for spans
+};
+
+// Events recorded by one thread at a time. Owned by the registry so they outlive the (often short-lived) worker
+// threads; when a thread exits its buffer goes back to the registry for the next new thread, so a buffer's tid is a
+// lane of non-overlapping threads rather than one OS thread, and parallel regions don't keep adding buffers.
+struct ProfileBuffer
+{
+    int tid;
+    std::mutex mutex; // only contended while a report is being written
+    std::vector<ProfileEvent> events;
+};
+
+struct ProfileRegistry
+{
+    std::mutex mutex;
+    std::vector<std::unique_ptr<ProfileBuffer> > buffers;
+    std::vector<ProfileBuffer *> freeBuffers; // buffers of threads that have exited
+    // steady_clock ticks; read by every recording thread without the lock
+    std::atomic<std::chrono::steady_clock::rep> epoch{std::chrono::steady_clock::now().time_since_epoch().count()};
+};
+
+ProfileRegistry &registry()
+{
+    static ProfileRegistry reg;
+    return reg;
+}
+
+// Hands the calling thread's buffer back to the registry when the thread exits
+struct ThreadBufferHandle
+{
+    ProfileBuffer *buffer = NULL;
+
+    ~ThreadBufferHandle()
+    {
+        if (!buffer)
+            return;
+        ProfileRegistry &reg = registry();
+        std::lock_guard<std::mutex> lock(reg.mutex);
+        reg.freeBuffers.push_back(buffer);
+    }
+};
+
+ProfileBuffer &threadBuffer()
+{
+    thread_local ThreadBufferHandle handle;
+    if (!handle.buffer)
+    {
+        ProfileRegistry &reg = registry();
+        std::lock_guard<std::mutex> lock(reg.mutex);
+        if (!reg.freeBuffers.empty())
+        {
+            handle.buffer = reg.freeBuffers.back();
+            reg.freeBuffers.pop_back();
+        }
+        else
+        {
+            reg.buffers.push_back(std::unique_ptr<ProfileBuffer>(new ProfileBuffer));
+            handle.buffer = reg.buffers.back().get();
+            handle.buffer->tid = int(reg.buffers.size());
+        }
+    }
+    return *handle.buffer;
+}
+
+double sinceEpoch(std::chrono::steady_clock::time_point t)
+{
+    std::chrono::steady_clock::duration epoch(registry().epoch.load(std::memory_order_relaxed));
+    return std::chrono::duration<double, std::micro>(t.time_since_epoch() - epoch).count();
+}
+
+void record(const ProfileEvent &ev)
+{
+    ProfileBuffer &buffer = threadBuffer();
+    std::lock_guard<std::mutex> lock(buffer.mutex);
+    buffer.events.push_back(ev);
+}
+
+// copies of every buffer's events, tagged with the buffer's thread id
+std::vector<std::pair<int, ProfileEvent> > snapshot()
+{
+    std::vector<std::pair<int, ProfileEvent> > all;
+    ProfileRegistry &reg = registry();
+    std::lock_guard<std::mutex> lock(reg.mutex);
+    for (auto &buffer : reg.buffers)
+    {
+        std::lock_guard<std::mutex> bufferLock(buffer->mutex);
+        for (auto &ev : buffer->events)
+            all.push_back(std::make_pair(buffer->tid, ev));
+    }
+    return all;
+}
+
+void writeJsonString(std::ostream &os, const char *s)
+{
+    os << '"';
+    for (; *s; s++)
+    {
+        if (*s == '"' || *s == '\\')
+            os << '\\' << *s;
+        else if ((unsigned char)*s < 0x20)
+            os << ' ';
+        else
+            os << *s;
+    }
+    os << '"';
+}
+
+}
+
+void setProfilingEnabled(bool enabled)
+{
+    profilingEnabledFlag.store(enabled, std::memory_order_relaxed);
+}
+
+void clearProfile()
+{
+    ProfileRegistry &reg = registry();
+    std::lock_guard<std::mutex> lock(reg.mutex);
+    for (auto &buffer : reg.buffers)
+    {
+        std::lock_guard<std::mutex> bufferLock(buffer->mutex);
+        buffer->events.clear();
+    }
+    reg.epoch.store(std::chrono::steady_clock::now().time_since_epoch().count(), std::memory_order_relaxed);
+}
+
+ProfileScope::~ProfileScope()
+{
+    if (!name_)
+        return;
+    auto end = std::chrono::steady_clock::now();
+    ProfileEvent ev;
+    ev.name = name_;
+    ev.counter = false;
+    ev.start = sinceEpoch(start_);
+    ev.value = std::chrono::duration<double, std::micro>(end - start_).count();
+    record(ev);
+}
+
+void profileCounter(const char *name, double value)
+{
+    if (!profilingEnabled())
+        return;
+    ProfileEvent ev;
+    ev.name = name;
+    ev.counter = true;
+    ev.start = sinceEpoch(std::chrono::steady_clock::now());
+    ev.value = value;
+    record(ev);
+}
+
+bool writeChromeTrace(const char *filename)
+{
+    std::ofstream ofs(filename);
+    if (!ofs)
+    {
+        std::cerr << "Couldn't open trace file " << filename << " for writing" << std::endl;
+        return false;
+    }
+    auto events = snapshot();
+    ofs << std::setprecision(15);
+    ofs << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n";
+    bool first = true;
+    for (auto &it : events)
+    {
+        const ProfileEvent &ev = it.second;
+        if (!first)
+            ofs << ",\n";
+        first = false;
+        ofs << "{\"name\": ";
+        writeJsonString(ofs, ev.name);
+        if (ev.counter)
+            ofs << ", \"ph\": \"C\", \"pid\": 1, \"tid\": " << it.first << ", \"ts\": " << ev.start << ", \"args\": {\"value\": " << ev.value << "}}";
+        else
+            ofs << ", \"ph\": \"X\", \"pid\": 1, \"tid\": " << it.first << ", \"ts\": " << ev.start << ", \"dur\": " << ev.value << "}";
+    }
+    ofs << "\n]}\n";
+    ofs.flush();
+    return bool(ofs);
+}
+
+void printProfileSummary(std::ostream &os)
+{
+    struct Stats
+    {
+        int calls = 0;
+        double total = 0;
+        double max = 0;
+    };
+    std::map<std::string, Stats> spans;
+    std::map<std::string, std::pair<double, double> > counters; // name -> (time, last value)
+    for (auto &it : snapshot())
+    {
+        const ProfileEvent &ev = it.second;
+        if (ev.counter)
+        {
+            auto c = counters.find(ev.name);
+            if (c == counters.end() || c->second.first <= ev.start)
+                counters[ev.name] = std::make_pair(ev.start, ev.value);
+        }
+        else
+        {
+            Stats &s = spans[ev.name];
+            s.calls++;
+            s.total += ev.value;
+            s.max = std::max(s.max, ev.value);
+        }
+    }
+    std::vector<std::pair<std::string, Stats> > sorted(spans.begin(), spans.end());
+    std::sort(sorted.begin(), sorted.end(), [](const std::pair<std::string, Stats> &a, const std::pair<std::string, Stats> &b)
+    {
+        return a.second.total > b.second.total;
+    });
+
+    size_t width = 5;
+    for (auto &it : sorted)
+        width = std::max(width, it.first.size());
+    for (auto &it : counters)
+        width = std::max(width, it.first.size());
+
+    std::ios::fmtflags flags = os.flags();
+    std::streamsize precision = os.precision();
+    os << std::left << std::setw(width) << "scope" << std::right
+        << std::setw(10) << "calls" << std::setw(14) << "total (s)" << std::setw(14) << "mean (ms)" << std::setw(14) << "max (ms)" << std::endl;
+    os << std::fixed;
+    for (auto &it : sorted)
+    {
+        const Stats &s = it.second;
+        os << std::left << std::setw(width) << it.first << std::right << std::setw(10) << s.calls
+            << std::setprecision(4) << std::setw(14) << s.total * 1e-6
+            << std::setprecision(3) << std::setw(14) << s.total * 1e-3 / s.calls << std::setw(14) << s.max * 1e-3 << std::endl;
+    }
+    os.flags(flags);
+    os.precision(precision);
+    if (!counters.empty())
+    {
+        os << std::left << std::setw(width) << "counter" << std::right << std::setw(10) << "value" << std::endl;
+        for (auto &it : counters)
+            os << std::left << std::setw(width) << it.first << std::right << std::setw(10) << it.second.second << std::endl;
+        os.flags(flags);
+    }
+}
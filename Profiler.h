@@ -0,0 +1,62 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <chrono>
+#include <ostream>
+#include <atomic>
+
+/*
+ * Lightweight instrumentation: timed scopes and counters recorded into per-thread buffers, written out as Chrome
+ * trace-event JSON (chrome://tracing, Perfetto) or summarized per scope name. While disabled (the default) a
+ * ProfileScope costs one relaxed atomic load; nothing is timed or stored.
+ *
+ * Names must be string literals (or otherwise outlive the profiler); only the pointer is stored.
+ */
+
+void setProfilingEnabled(bool enabled);
+
+extern std::atomic<bool> profilingEnabledFlag; // use profilingEnabled() and setProfilingEnabled()
+
+inline bool profilingEnabled()
+{
+    return profilingEnabledFlag.load(std::memory_order_relaxed);
+}
+
+// drops everything recorded so far
+void clearProfile();
+
+// Records the time from construction to destruction as a span named name, nested inside whatever spans are open on
+// the same thread
+class ProfileScope
+{
+public:
+    explicit ProfileScope(const char *name) : name_(profilingEnabled() ? name : NULL)
+    {
+        if (name_)
+            start_ = std::chrono::steady_clock::now();
+    }
+    ~ProfileScope();
+
+    ProfileScope(const ProfileScope &) = delete;
+    ProfileScope &operator=(const ProfileScope &) = delete;
+
+private:
+    const char *name_; // NULL if profiling was off when the scope opened
+    std::chrono::steady_clock::time_point start_;
+};
+
+#define PROFILE_CONCAT_(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_(a, b)
+// times the rest of the enclosing block
+#define PROFILE_SCOPE(name) ProfileScope PROFILE_CONCAT(profileScope_, __LINE__)(name)
+
+// Records the current value of a counter (matrix nonzeros, number of traces, ...)
+void profileCounter(const char *name, double value);
+
+// Chrome trace-event JSON: spans as complete ("X") events, counters as "C" events, timestamps in microseconds
+bool writeChromeTrace(const char *filename);
+
+// Per scope name: number of calls, total, mean and max time, sorted by total time; then the last value of each counter
+void printProfileSummary(std::ostream &os);
+
+#endif
@@ -0,0 +1,272 @@
+#include "RodFile.h"
+#include <fstream>
+#include <iostream>
+#include <cstring>
+#include <cstdint>
+
+static const char rodMagic[8] = { 'W', 'E', 'A', 'V', 'E', 'R', 'O', 'D' };
+static const int32_t rodVersion = 1;
+
+// on-disk collision record; four ints followed by two doubles packs without padding
+struct RodCollisionRecord
+{
+    int32_t rod1, rod2, seg1, seg2;
+    double bary1, bary2;
+};
+static_assert(sizeof(RodCollisionRecord) == 32, "unexpected padding in RodCollisionRecord");
+
+bool writeRodFile(const char *filename, const RodFile &rods)
+{
+    std::ofstream myfile(filename);
+    if (!myfile)
+    {
+        std::cerr << "Couldn't open rod file " << filename << " for writing" << std::endl;
+        return false;
+    }
+    // Write Header
+    myfile << -217 << '\n';
+    myfile << 2 << '\n';
+    myfile << rods.rods.size() << '\n';
+    myfile << rods.collisions.size() << '\n';
+    myfile << "0.001" << '\n';
+    myfile << "1e+08" << '\n';
+    myfile << "1" << '\n' << '\n' << '\n';
+
+    for (auto &it : rods.rods)
+    {
+        int nverts = it.pts.rows();
+        int nsegs = it.normals.rows();
+        myfile << nverts << '\n';
+        myfile << 0 << '\n';
+        myfile << 1 << '\n';
+        myfile << it.color << '\n';
+
+        for (int i = 0; i < nverts; i++)
+        {
+            myfile << it.pts(i, 0) << " " << it.pts(i, 1) << " " << it.pts(i, 2) << " ";
+        }
+        myfile << '\n';
+
+        for (int i = 0; i < nsegs; i++)
+        {
+            myfile << it.normals(i, 0) << " " << it.normals(i, 1) << " " << it.normals(i, 2) << " ";
+        }
+        myfile << '\n';
+
+        for (int i = 0; i < nsegs; i++)
+        {
+            myfile << "0 ";
+        }
+        myfile << '\n';
+
+        for (int i = 0; i < nsegs; i++)
+        {
+            myfile << "0.02 ";
+        }
+        myfile << '\n';
+
+        for (int i = 0; i < nsegs; i++)
+        {
+            myfile << it.materials[i] << " ";
+        }
+        myfile << '\n';
+        myfile << '\n';
+    }
+
+    for (auto &col : rods.collisions)
+    {
+        myfile << col.rod1 << '\n';
+        myfile << col.rod2 << '\n';
+        myfile << col.seg1 << '\n';
+        myfile << col.seg2 << '\n';
+        myfile << col.bary1 << '\n';
+        myfile << col.bary2 << '\n';
+        myfile << "1000." << '\n';
+    }
+    myfile.flush();
+    return bool(myfile);
+}
+
+bool writeBinaryRodFile(const char *filename, const RodFile &rods)
+{
+    std::ofstream ofs(filename, std::ios::binary);
+    if (!ofs)
+    {
+        std::cerr << "Couldn't open rod file " << filename << " for writing" << std::endl;
+        return false;
+    }
+
+    int32_t nrods = rods.rods.size();
+    int32_t ncollisions = rods.collisions.size();
+    ofs.write(rodMagic, sizeof(rodMagic));
+    ofs.write((const char *)&rodVersion, sizeof(int32_t));
+    ofs.write((const char *)&nrods, sizeof(int32_t));
+    ofs.write((const char *)&ncollisions, sizeof(int32_t));
+
+    std::vector<int32_t> table(2 * nrods);
+    for (int i = 0; i < nrods; i++)
+    {
+        table[2 * i] = rods.rods[i].pts.rows();
+        table[2 * i + 1] = rods.rods[i].color;
+    }
+    ofs.write((const char *)table.data(), table.size() * sizeof(int32_t));
+
+    for (auto &it : rods.rods)
+    {
+        int nverts = it.pts.rows();
+        int nsegs = nverts - 1;
+        if (it.pts.cols() != 3 || it.normals.rows() != nsegs || it.normals.cols() != 3 || it.materials.size() != nsegs)
+        {
+            std::cerr << "Malformed rod with " << nverts << " vertices; not writing " << filename << std::endl;
+            return false;
+        }
+        ofs.write((const char *)it.pts.data(), it.pts.size() * sizeof(double));
+        ofs.write((const char *)it.normals.data(), it.normals.size() * sizeof(double));
+        std::vector<int32_t> materials(it.materials.data(), it.materials.data() + nsegs);
+        ofs.write((const char *)materials.data(), materials.size() * sizeof(int32_t));
+    }
+
+    std::vector<RodCollisionRecord> cols(ncollisions);
+    for (int i = 0; i < ncollisions; i++)
+    {
+        const Collision &col = rods.collisions[i];
+        cols[i].rod1 = col.rod1;
+        cols[i].rod2 = col.rod2;
+        cols[i].seg1 = col.seg1;
+        cols[i].seg2 = col.seg2;
+        cols[i].bary1 = col.bary1;
+        cols[i].bary2 = col.bary2;
+    }
+    ofs.write((const char *)cols.data(), cols.size() * sizeof(RodCollisionRecord));
+    ofs.flush();
+    return bool(ofs);
+}
+
+bool readBinaryRodFile(const char *filename, RodFile &rods)
+{
+    rods.rods.clear();
+    rods.collisions.clear();
+
+    std::ifstream ifs(filename, std::ios::binary);
+    if (!ifs)
+    {
+        std::cerr << "Couldn't open rod file " << filename << std::endl;
+        return false;
+    }
+
+    char magic[8];
+    int32_t version, nrods, ncollisions;
+    ifs.read(magic, sizeof(magic));
+    ifs.read((char *)&version, sizeof(int32_t));
+    ifs.read((char *)&nrods, sizeof(int32_t));
+    ifs.read((char *)&ncollisions, sizeof(int32_t));
+    if (!ifs || std::memcmp(magic, rodMagic, sizeof(magic)) != 0)
+    {
+        std::cerr << filename << " is not a binary rod file" << std::endl;
+        return false;
+    }
+    if (version != rodVersion || nrods < 0 || ncollisions < 0)
+    {
+        std::cerr << "Unsupported binary rod file " << filename << " (version " << version << ")" << std::endl;
+        return false;
+    }
+
+    // the counts are checked against what is left of the file before anything is allocated for them, so a corrupt
+    // header fails cleanly instead of asking for gigabytes
+    std::streamoff header = ifs.tellg();
+    ifs.seekg(0, std::ios::end);
+    size_t remaining = size_t(ifs.tellg() - header);
+    ifs.seekg(header);
+    auto consume = [&remaining](size_t bytes)
+    {
+        if (bytes > remaining)
+            return false;
+        remaining -= bytes;
+        return true;
+    };
+
+    size_t tablesize = 2 * size_t(nrods);
+    if (!consume(tablesize * sizeof(int32_t)))
+    {
+        std::cerr << "Error reading rod file " << filename << ": truncated rod table" << std::endl;
+        return false;
+    }
+    std::vector<int32_t> table(tablesize);
+    ifs.read((char *)table.data(), table.size() * sizeof(int32_t));
+    if (!ifs)
+    {
+        std::cerr << "Error reading rod file " << filename << std::endl;
+        return false;
+    }
+
+    rods.rods.resize(nrods);
+    for (int i = 0; i < nrods; i++)
+    {
+        int nverts = table[2 * i];
+        if (nverts < 1)
+        {
+            std::cerr << "Error reading rod file " << filename << ": rod " << i << " has " << nverts << " vertices" << std::endl;
+            rods.rods.clear();
+            return false;
+        }
+        int nsegs = nverts - 1;
+        if (!consume(size_t(nverts) * 3 * sizeof(double) + size_t(nsegs) * (3 * sizeof(double) + sizeof(int32_t))))
+        {
+            std::cerr << "Error reading rod file " << filename << ": truncated at rod " << i << std::endl;
+            rods.rods.clear();
+            return false;
+        }
+        RodFileRod &rod = rods.rods[i];
+        rod.color = table[2 * i + 1];
+        rod.pts.resize(nverts, 3);
+        rod.normals.resize(nsegs, 3);
+        ifs.read((char *)rod.pts.data(), rod.pts.size() * sizeof(double));
+        ifs.read((char *)rod.normals.data(), rod.normals.size() * sizeof(double));
+        std::vector<int32_t> materials(nsegs);
+        ifs.read((char *)materials.data(), materials.size() * sizeof(int32_t));
+        rod.materials.resize(nsegs);
+        for (int j = 0; j < nsegs; j++)
+            rod.materials[j] = materials[j];
+        if (!ifs)
+        {
+            std::cerr << "Error reading rod file " << filename << ": truncated at rod " << i << std::endl;
+            rods.rods.clear();
+            return false;
+        }
+    }
+
+    if (!consume(size_t(ncollisions) * sizeof(RodCollisionRecord)))
+    {
+        std::cerr << "Error reading rod file " << filename << ": truncated collision table" << std::endl;
+        rods.rods.clear();
+        return false;
+    }
+    std::vector<RodCollisionRecord> cols(ncollisions);
+    ifs.read((char *)cols.data(), cols.size() * sizeof(RodCollisionRecord));
+    if (!ifs)
+    {
+        std::cerr << "Error reading rod file " << filename << ": truncated collision table" << std::endl;
+        rods.rods.clear();
+        return false;
+    }
+    rods.collisions.resize(ncollisions);
+    for (int i = 0; i < ncollisions; i++)
+    {
+        Collision &col = rods.collisions[i];
+        col.rod1 = cols[i].rod1;
+        col.rod2 = cols[i].rod2;
+        col.seg1 = cols[i].seg1;
+        col.seg2 = cols[i].seg2;
+        col.bary1 = cols[i].bary1;
+        col.bary2 = cols[i].bary2;
+    }
+    return true;
+}
+
+bool convertBinaryRodFile(const char *binaryFilename, const char *textFilename)
+{
+    RodFile rods;
+    if (!readBinaryRodFile(binaryFilename, rods))
+        return false;
+    return writeRodFile(textFilename, rods);
+}
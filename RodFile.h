@@ -0,0 +1,40 @@
+#ifndef RODFILE_H
+#define RODFILE_H
+
+#include <Eigen/Core>
+#include <vector>
+#include "Traces.h"
+
+// One rod of a rod file
+struct RodFileRod
+{
+    Eigen::MatrixXd pts; // nverts x 3
+    Eigen::MatrixXd normals; // nsegs x 3, nsegs = nverts - 1
+    Eigen::VectorXi materials; // nsegs, material group of each segment
+    int color;
+};
+
+// Contents of a rod file for the rod simulator: rods plus the crossings between them
+struct RodFile
+{
+    std::vector<RodFileRod> rods;
+    std::vector<Collision> collisions;
+};
+
+// Text .rod format read by the simulator. Every rod gets zero twist and width 0.02, and every collision stiffness 1000.
+bool writeRodFile(const char *filename, const RodFile &rods);
+
+// Binary format, for dense weaves where the text format gets slow and huge. Layout, little-endian:
+//   char[8] "WEAVEROD", int32 version, int32 nrods, int32 ncollisions
+//   nrods x { int32 nverts, int32 color }
+//   per rod: float64 pts[3 * nverts], float64 normals[3 * nsegs], int32 materials[nsegs]
+//     (pts and normals column-major, i.e. all x, then all y, then all z, exactly as Eigen stores them)
+//   ncollisions x { int32 rod1, rod2, seg1, seg2; float64 bary1, bary2 }
+// Every array is written and read with one bulk call.
+bool writeBinaryRodFile(const char *filename, const RodFile &rods);
+bool readBinaryRodFile(const char *filename, RodFile &rods);
+
+// Rewrites a binary rod file in the text format
+bool convertBinaryRodFile(const char *binaryFilename, const char *textFilename);
+
+#endif
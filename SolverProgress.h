@@ -0,0 +1,67 @@
+#ifndef SOLVERPROGRESS_H
+#define SOLVERPROGRESS_H
+
+#include <atomic>
+#include <functional>
+
+/*
+ * Cooperative cancellation and progress reporting for the long-running stages (design solves, integration, rod
+ * rationalization). Any thread may cancel(); the computation checks between iterations or sub-stages and returns
+ * early, leaving its outputs consistent (the iterations done so far) rather than converged. Functions taking a
+ * SolverProgress * accept NULL, for neither reporting nor cancellation.
+ */
+
+// Called on the computing thread with the running sub-stage and how far along it is, in [0, 1]
+typedef std::function<void(const char *stage, double fraction)> ProgressCallback;
+
+class SolverProgress
+{
+public:
+    SolverProgress() : cancelled_(false), stage_(""), fraction_(0) {}
+
+    SolverProgress(const SolverProgress &) = delete;
+    SolverProgress &operator=(const SolverProgress &) = delete;
+
+    // the computation stops at its next check
+    void cancel() { cancelled_.store(true); }
+    // clears a cancellation, so the next computation runs to completion
+    void reset() { cancelled_.store(false); }
+    bool cancelled() const { return cancelled_.load(); }
+
+    // not synchronized with report(); set it before starting the computation
+    void setCallback(ProgressCallback callback) { callback_ = callback; }
+
+    // Records that stage (a string literal) is fraction done; false if the computation should stop
+    bool report(const char *stage, double fraction)
+    {
+        stage_.store(stage);
+        fraction_.store(fraction);
+        if (callback_)
+            callback_(stage, fraction);
+        return !cancelled();
+    }
+
+    // the last report, for polling from another thread (a progress bar)
+    const char *stage() const { return stage_.load(); }
+    double fraction() const { return fraction_.load(); }
+
+private:
+    std::atomic<bool> cancelled_;
+    std::atomic<const char *> stage_;
+    std::atomic<double> fraction_;
+    ProgressCallback callback_;
+};
+
+// false if progress is NULL
+inline bool progressCancelled(const SolverProgress *progress)
+{
+    return progress && progress->cancelled();
+}
+
+// reports to progress, if any; false if the computation should stop
+inline bool reportProgress(SolverProgress *progress, const char *stage, double fraction)
+{
+    return !progress || progress->report(stage, fraction);
+}
+
+#endif
@@ -0,0 +1,44 @@
+#include "SpatialHash.h"
+#include <limits>
+
+void SpatialHash::insert(const Eigen::Vector3d &pt, int tag)
+{
+    Entry e;
+    e.pt = pt;
+    e.tag = tag;
+    cells_[key(cellCoord(pt[0]), cellCoord(pt[1]), cellCoord(pt[2]))].push_back(e);
+}
+
+int SpatialHash::nearest(const Eigen::Vector3d &pt, double radius) const
+{
+    int best = -1;
+    double bestdist = std::numeric_limits<double>::infinity();
+    int lo[3], hi[3];
+    for (int k = 0; k < 3; k++)
+    {
+        lo[k] = cellCoord(pt[k] - radius);
+        hi[k] = cellCoord(pt[k] + radius);
+    }
+    for (int i = lo[0]; i <= hi[0]; i++)
+    {
+        for (int j = lo[1]; j <= hi[1]; j++)
+        {
+            for (int k = lo[2]; k <= hi[2]; k++)
+            {
+                auto it = cells_.find(key(i, j, k));
+                if (it == cells_.end())
+                    continue;
+                for (const Entry &e : it->second)
+                {
+                    double dist = (e.pt - pt).squaredNorm();
+                    if (dist <= radius * radius && dist < bestdist)
+                    {
+                        bestdist = dist;
+                        best = e.tag;
+                    }
+                }
+            }
+        }
+    }
+    return best;
+}
@@ -0,0 +1,75 @@
+#ifndef SPATIALHASH_H
+#define SPATIALHASH_H
+
+#include <Eigen/Core>
+#include <vector>
+#include <unordered_map>
+#include <cmath>
+#include <cstdint>
+
+// Uniform grid over R^3 bucketing tagged points into cubic cells, for fixed-radius neighbor queries
+class SpatialHash
+{
+public:
+    SpatialHash(double cellSize) : cellSize_(cellSize) {}
+
+    void insert(const Eigen::Vector3d &pt, int tag);
+    void clear() { cells_.clear(); }
+
+    // returns true if some point within radius of pt has a tag for which pred(tag) is true
+    template<typename Pred>
+    bool findWithin(const Eigen::Vector3d &pt, double radius, Pred pred) const
+    {
+        int lo[3], hi[3];
+        for (int k = 0; k < 3; k++)
+        {
+            lo[k] = cellCoord(pt[k] - radius);
+            hi[k] = cellCoord(pt[k] + radius);
+        }
+        double r2 = radius * radius;
+        for (int i = lo[0]; i <= hi[0]; i++)
+        {
+            for (int j = lo[1]; j <= hi[1]; j++)
+            {
+                for (int k = lo[2]; k <= hi[2]; k++)
+                {
+                    auto it = cells_.find(key(i, j, k));
+                    if (it == cells_.end())
+                        continue;
+                    for (const Entry &e : it->second)
+                    {
+                        if ((e.pt - pt).squaredNorm() <= r2 && pred(e.tag))
+                            return true;
+                    }
+                }
+            }
+        }
+        return false;
+    }
+
+    bool anyWithin(const Eigen::Vector3d &pt, double radius) const
+    {
+        return findWithin(pt, radius, [](int) { return true; });
+    }
+
+    // tag of the point closest to pt among those within radius, or -1 if there is none
+    int nearest(const Eigen::Vector3d &pt, double radius) const;
+
+private:
+    struct Entry
+    {
+        Eigen::Vector3d pt;
+        int tag;
+    };
+
+    int cellCoord(double x) const { return int(std::floor(x / cellSize_)); }
+    static int64_t key(int i, int j, int k)
+    {
+        return ((int64_t(i) & 0x1FFFFF) << 42) | ((int64_t(j) & 0x1FFFFF) << 21) | (int64_t(k) & 0x1FFFFF);
+    }
+
+    double cellSize_;
+    std::unordered_map<int64_t, std::vector<Entry> > cells_;
+};
+
+#endif
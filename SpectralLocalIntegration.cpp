@@ -1,30 +1,17 @@
 #include "SpectralLocalIntegration.h"
-#include <igl/cotmatrix_entries.h>
 #include <vector>
+#include <iostream>
 #include <Eigen/Sparse>
+#include "Profiler.h"
 
-void SpectralLocalIntegration::locallyIntegrateOneComponent(const Surface &surf, const Eigen::MatrixXd &v, Eigen::VectorXd &s)
+void SpectralLocalIntegration::locallyIntegrateOneComponent(const Surface &surf, const ComponentGeometry &geom, const Eigen::MatrixXd &v, Eigen::VectorXd &s)
 {
-    // build edge metric matrix and inverse (cotan weights)
-    Eigen::MatrixXd C;
-    igl::cotmatrix_entries(surf.data().V, surf.data().F, C);
+    PROFILE_SCOPE("SpectralLocalIntegration");
+    // edge metric (cotan weights) and face areas, gathered from the base mesh
     int nedges = surf.nEdges();
-    Eigen::VectorXd edgeMetric(nedges);
-    edgeMetric.setZero();
     int nfaces = surf.nFaces();
-    for(int i=0; i<nfaces; i++)
-    {
-        for (int j = 0; j < 3; j++)
-        {
-            int eidx = surf.data().faceEdges(i, j);
-            edgeMetric[eidx] += C(i,j);
-        }                
-    } 
-
-    // face mass matrix
-    Eigen::VectorXd faceAreas;
-    igl::doublearea(surf.data().V, surf.data().F, faceAreas);
-    faceAreas *= 0.5;
+    const Eigen::VectorXd &edgeMetric = geom.edgeMetric;
+    const Eigen::VectorXd &faceAreas = geom.faceAreas;
 
     std::cout << "Built mass matrices" << std::endl;
 
@@ -9,7 +9,7 @@ class SpectralLocalIntegration : public LocalFieldIntegration
 public:
     SpectralLocalIntegration(double sSmoothnessReg) : sreg_(sSmoothnessReg) {}
 
-    void locallyIntegrateOneComponent(const Surface &surf, const Eigen::MatrixXd &v, Eigen::VectorXd &s);
+    void locallyIntegrateOneComponent(const Surface &surf, const ComponentGeometry &geom, const Eigen::MatrixXd &v, Eigen::VectorXd &s);
 
 private:
     double sreg_;
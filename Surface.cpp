@@ -4,9 +4,11 @@
 #include <Eigen/Dense>
 
 #include <iostream>
+#include "Profiler.h"
 
 Surface::Surface(const Eigen::MatrixXd &V, const Eigen::MatrixXi &F)
 {
+    PROFILE_SCOPE("Surface::Surface");
     data_.V = V;
     data_.F = F;
     buildConnectivityStructures();
@@ -127,6 +129,17 @@ Eigen::Vector3d Surface::faceNormal(int face) const
 }
 
 
+size_t Surface::dataBytes() const
+{
+    size_t bytes = sizeof(double) * (data_.V.size() + data_.cDiffs.size() + data_.Ts.size() + data_.Ts_rosy.size() + data_.Js.size());
+    bytes += sizeof(int) * (data_.F.size() + data_.E.size() + data_.edgeVerts.size() + data_.faceEdges.size() + data_.faceNeighbors.size() + data_.faceWings.size());
+    bytes += data_.Bs.capacity() * sizeof(Eigen::Matrix<double, 3, 2>);
+    bytes += data_.vertEdges.capacity() * sizeof(std::vector<int>);
+    for (const std::vector<int> &edges : data_.vertEdges)
+        bytes += edges.capacity() * sizeof(int);
+    return bytes;
+}
+
 double Surface::faceArea(int face) const
 {
     Eigen::Vector3d e1 = (data_.V.row(data_.F(face, 1)) - data_.V.row(data_.F(face, 0)));
@@ -45,6 +45,9 @@ public:
     Eigen::Vector3d faceNormal(int face) const;
     double faceArea(int face) const;
 
+    // bytes held by the combinatorial and geometric data structures
+    size_t dataBytes() const;
+
     // Finds shortest (combinatorial) path from start to end vertex. Each path entry is a combination of (1) the edge index along the path, and (2) the orientation: the jth path segment goes from
     // edgeVerts(path[j].first, path[j].second) to edgeVerts(path[j].first, 1 - path[j].second).
     // List will be empty if no path exists (vertices lie on disconnected components).
@@ -0,0 +1,226 @@
+#include "TraceStore.h"
+#include "FieldSurface.h"
+#include <fstream>
+#include <iostream>
+#include <cstring>
+
+static const char traceMagic[8] = { 'W', 'E', 'A', 'V', 'E', 'T', 'R', 'C' };
+static const int32_t traceVersion = 1;
+
+// FNV-1a over raw bytes
+static uint64_t hashBytes(uint64_t h, const void *data, size_t len)
+{
+    const unsigned char *p = (const unsigned char *)data;
+    for (size_t i = 0; i < len; i++)
+    {
+        h ^= p[i];
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+MeshKey meshKey(const Surface &surf)
+{
+    MeshKey key;
+    key.nverts = surf.nVerts();
+    key.nfaces = surf.nFaces();
+    uint64_t h = 14695981039346656037ULL;
+    h = hashBytes(h, surf.data().V.data(), surf.data().V.size() * sizeof(double));
+    h = hashBytes(h, surf.data().F.data(), surf.data().F.size() * sizeof(int));
+    key.hash = h;
+    return key;
+}
+
+TraceStore::TraceStore(bool singlePrecision) : single_(singlePrecision)
+{
+    offsets_.push_back(0);
+}
+
+void TraceStore::clear()
+{
+    offsets_.assign(1, 0);
+    types_.clear();
+    surfaces_.clear();
+    packed_.clear();
+    for (int k = 0; k < 2; k++)
+    {
+        baryf_[k].clear();
+        baryd_[k].clear();
+    }
+}
+
+void TraceStore::add(const Trace &tr, int surface)
+{
+    types_.push_back(uint8_t(tr.type_));
+    surfaces_.push_back(uint8_t(surface));
+    for (auto &seg : tr.segs)
+    {
+        assert(seg.face >= 0 && seg.face < (1 << 28));
+        packed_.push_back((uint32_t(seg.face) << 4) | (uint32_t(seg.side[0]) << 2) | uint32_t(seg.side[1]));
+        for (int k = 0; k < 2; k++)
+        {
+            if (single_)
+                baryf_[k].push_back(float(seg.bary[k]));
+            else
+                baryd_[k].push_back(seg.bary[k]);
+        }
+    }
+    offsets_.push_back(packed_.size());
+}
+
+size_t TraceStore::memoryBytes() const
+{
+    size_t barybytes = single_ ? sizeof(float) : sizeof(double);
+    return offsets_.size() * sizeof(int32_t) + types_.size() + surfaces_.size() + packed_.size() * (sizeof(uint32_t) + 2 * barybytes);
+}
+
+bool TraceStore::extract(int trace, const FieldSurface *parent, const Eigen::VectorXd &faceBending, Trace &tr) const
+{
+    tr = Trace(parent, Trace_Mode(types_[trace]));
+    int begin = offsets_[trace];
+    int end = offsets_[trace + 1];
+    tr.segs.resize(end - begin);
+    for (int i = begin; i < end; i++)
+    {
+        TraceSegment &seg = tr.segs[i - begin];
+        seg.face = packed_[i] >> 4;
+        if (seg.face >= parent->nFaces() || seg.face >= faceBending.size())
+            return false;
+        seg.side[0] = (packed_[i] >> 2) & 3;
+        seg.side[1] = packed_[i] & 3;
+        seg.bary[0] = bary(i, 0);
+        seg.bary[1] = bary(i, 1);
+        seg.inplanebending = faceBending[seg.face];
+    }
+    return true;
+}
+
+bool TraceStore::save(const char *filename, const std::vector<MeshKey> &keys) const
+{
+    std::ofstream ofs(filename, std::ios::binary);
+    if (!ofs)
+    {
+        std::cerr << "Couldn't open trace file " << filename << " for writing" << std::endl;
+        return false;
+    }
+    int32_t header[5] = { traceVersion, single_ ? 1 : 0, int32_t(keys.size()), int32_t(nTraces()), int32_t(nSegments()) };
+    ofs.write(traceMagic, sizeof(traceMagic));
+    ofs.write((const char *)header, sizeof(header));
+    for (auto &key : keys)
+    {
+        ofs.write((const char *)&key.nverts, sizeof(int32_t));
+        ofs.write((const char *)&key.nfaces, sizeof(int32_t));
+        ofs.write((const char *)&key.hash, sizeof(uint64_t));
+    }
+    ofs.write((const char *)offsets_.data(), offsets_.size() * sizeof(int32_t));
+    ofs.write((const char *)types_.data(), types_.size());
+    ofs.write((const char *)surfaces_.data(), surfaces_.size());
+    ofs.write((const char *)packed_.data(), packed_.size() * sizeof(uint32_t));
+    for (int k = 0; k < 2; k++)
+    {
+        if (single_)
+            ofs.write((const char *)baryf_[k].data(), baryf_[k].size() * sizeof(float));
+        else
+            ofs.write((const char *)baryd_[k].data(), baryd_[k].size() * sizeof(double));
+    }
+    ofs.flush();
+    return bool(ofs);
+}
+
+bool TraceStore::load(const char *filename, std::vector<MeshKey> &keys)
+{
+    clear();
+    keys.clear();
+
+    std::ifstream ifs(filename, std::ios::binary);
+    if (!ifs)
+    {
+        std::cerr << "Couldn't open trace file " << filename << std::endl;
+        return false;
+    }
+    char magic[8];
+    int32_t header[5];
+    ifs.read(magic, sizeof(magic));
+    ifs.read((char *)header, sizeof(header));
+    if (!ifs || std::memcmp(magic, traceMagic, sizeof(magic)) != 0)
+    {
+        std::cerr << filename << " is not a trace file" << std::endl;
+        return false;
+    }
+    int32_t nsurfaces = header[2];
+    int32_t ntraces = header[3];
+    int32_t nsegs = header[4];
+    if (header[0] != traceVersion || nsurfaces < 0 || ntraces < 0 || nsegs < 0)
+    {
+        std::cerr << "Unsupported trace file " << filename << " (version " << header[0] << ")" << std::endl;
+        return false;
+    }
+    single_ = (header[1] & 1) != 0;
+
+    // check the counts against the rest of the file before allocating anything for them, so a corrupt header is
+    // rejected instead of asking for gigabytes
+    size_t barysize = single_ ? sizeof(float) : sizeof(double);
+    size_t needed = size_t(nsurfaces) * (2 * sizeof(int32_t) + sizeof(uint64_t))
+        + (size_t(ntraces) + 1) * sizeof(int32_t) + size_t(ntraces) * 2 * sizeof(uint8_t)
+        + size_t(nsegs) * (sizeof(uint32_t) + 2 * barysize);
+    std::streamoff start = ifs.tellg();
+    ifs.seekg(0, std::ios::end);
+    size_t remaining = size_t(ifs.tellg() - start);
+    ifs.seekg(start);
+    if (needed > remaining)
+    {
+        std::cerr << "Error reading trace file " << filename << ": file is truncated" << std::endl;
+        return false;
+    }
+
+    keys.resize(nsurfaces);
+    for (auto &key : keys)
+    {
+        ifs.read((char *)&key.nverts, sizeof(int32_t));
+        ifs.read((char *)&key.nfaces, sizeof(int32_t));
+        ifs.read((char *)&key.hash, sizeof(uint64_t));
+    }
+    offsets_.resize(ntraces + 1);
+    types_.resize(ntraces);
+    surfaces_.resize(ntraces);
+    packed_.resize(nsegs);
+    ifs.read((char *)offsets_.data(), offsets_.size() * sizeof(int32_t));
+    ifs.read((char *)types_.data(), types_.size());
+    ifs.read((char *)surfaces_.data(), surfaces_.size());
+    ifs.read((char *)packed_.data(), packed_.size() * sizeof(uint32_t));
+    for (int k = 0; k < 2; k++)
+    {
+        if (single_)
+        {
+            baryf_[k].resize(nsegs);
+            ifs.read((char *)baryf_[k].data(), baryf_[k].size() * sizeof(float));
+        }
+        else
+        {
+            baryd_[k].resize(nsegs);
+            ifs.read((char *)baryd_[k].data(), baryd_[k].size() * sizeof(double));
+        }
+    }
+    if (!ifs)
+    {
+        std::cerr << "Error reading trace file " << filename << ": file is truncated" << std::endl;
+        clear();
+        keys.clear();
+        return false;
+    }
+
+    // sanity-check the indexing so a corrupt file can't send extract() out of bounds
+    bool ok = offsets_[0] == 0 && offsets_[ntraces] == nsegs;
+    for (int i = 0; ok && i < ntraces; i++)
+        ok = offsets_[i] <= offsets_[i + 1] && surfaces_[i] < nsurfaces && types_[i] <= FIELD;
+    for (int i = 0; ok && i < nsegs; i++)
+        ok = (packed_[i] & 3) != 3 && ((packed_[i] >> 2) & 3) != 3;
+    if (!ok)
+    {
+        std::cerr << "Error reading trace file " << filename << ": inconsistent trace table" << std::endl;
+        clear();
+        keys.clear();
+        return false;
+    }
+    return true;
+}
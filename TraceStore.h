@@ -0,0 +1,68 @@
+#ifndef TRACESTORE_H
+#define TRACESTORE_H
+
+#include <Eigen/Core>
+#include <vector>
+#include <cstdint>
+#include "Traces.h"
+
+class Surface;
+
+// Identifies a mesh by its size and a hash of its vertex positions and faces, so stored traces are only ever
+// reattached to the surface they were traced on
+struct MeshKey
+{
+    int32_t nverts;
+    int32_t nfaces;
+    uint64_t hash;
+
+    bool operator==(const MeshKey &other) const { return nverts == other.nverts && nfaces == other.nfaces && hash == other.hash; }
+};
+
+MeshKey meshKey(const Surface &surf);
+
+// Compact, columnar copy of a set of traces. Each segment's face and two sides are packed into one 32-bit word,
+// with the face in the upper 28 bits and the sides in 2 bits each. The two barycentric coordinates are kept as
+// separate columns, in float32 if singlePrecision and float64 otherwise. Segment bending is not stored: it is
+// restored from the surface's per-face curl energy when a trace is extracted, as integrateTrace sets it.
+class TraceStore
+{
+public:
+    TraceStore(bool singlePrecision = false);
+
+    void clear();
+    // appends tr; surface identifies tr's parent among the surfaces later passed to extract/save
+    void add(const Trace &tr, int surface);
+
+    int nTraces() const { return types_.size(); }
+    int nSegments() const { return packed_.size(); }
+    int traceSurface(int trace) const { return surfaces_[trace]; }
+    bool singlePrecision() const { return single_; }
+    size_t memoryBytes() const;
+
+    // rebuilds trace i on parent, which must be the surface the trace was added with. faceBending holds
+    // parent->faceCurlEnergy(f, 0) for every face f. Returns false if a face is out of range.
+    bool extract(int trace, const FieldSurface *parent, const Eigen::VectorXd &faceBending, Trace &tr) const;
+
+    // binary format, little-endian:
+    //   char[8] "WEAVETRC", int32 version, int32 flags (1 = float32 barycentrics), int32 nsurfaces, int32 ntraces, int32 nsegs
+    //   nsurfaces x MeshKey (int32 nverts, int32 nfaces, uint64 hash)
+    //   int32 offsets[ntraces + 1], uint8 types[ntraces], uint8 surfaces[ntraces]
+    //   uint32 packed[nsegs], bary0[nsegs], bary1[nsegs]
+    // keys[i] identifies surface i
+    bool save(const char *filename, const std::vector<MeshKey> &keys) const;
+    bool load(const char *filename, std::vector<MeshKey> &keys);
+
+private:
+    double bary(int seg, int end) const { return single_ ? baryf_[end][seg] : baryd_[end][seg]; }
+
+    bool single_;
+    std::vector<int32_t> offsets_; // ntraces + 1; segments of trace i are [offsets_[i], offsets_[i+1])
+    std::vector<uint8_t> types_;
+    std::vector<uint8_t> surfaces_;
+    std::vector<uint32_t> packed_;
+    std::vector<float> baryf_[2];
+    std::vector<double> baryd_[2];
+};
+
+#endif
@@ -3,6 +3,20 @@
 #include "Distance.h"
 #include <algorithm>
 #include <fstream>
+#include <array>
+#include <map>
+#include "Parallel.h"
+#include "SpatialHash.h"
+#include "RodFile.h"
+#include "CsvWriter.h"
+#include "TraceStore.h"
+#include <deque>
+#include <cassert>
+#include <limits>
+#include <chrono>
+#include <iostream>
+#include "Profiler.h"
+#include "SolverProgress.h"
 
 void TraceSet::addTrace(const Trace &tr)
 {
@@ -62,158 +76,131 @@ void TraceSet::popLastCurve()
 }
 
 
-void TraceSet::findTraceStart(const FieldSurface &parent,
-    int curr_face_id, 
-    const Eigen::Vector3d startpoint, 
-    const Eigen::Vector3d curr_dir, int &startEdge, double &startBary)
+// Position of the point at bary along side `side` of a face, in the face's barycentric frame: the point
+// V0 + a (V1 - V0) + b (V2 - V0) has coordinates (a, b), so the corners sit at (0,0), (1,0) and (0,1)
+static Eigen::Vector2d framePoint(int side, double bary)
 {
-
-    // Project backwards to initialize.  Kinda hacky.
-    double min_dist = std::numeric_limits<double>::infinity();
-
-    startEdge = -1;    
-
-    for (int i = 0; i < 3; i++)
-    {        
-        Eigen::Vector3d op_v1 = parent.data().V.row(parent.data().F(curr_face_id, (i + 1) % 3)).transpose();
-        Eigen::Vector3d op_v2 = parent.data().V.row(parent.data().F(curr_face_id, (i + 2) % 3)).transpose();
-        
-        double p0bary, p1bary, q0bary, q1bary;
-        Eigen::Vector3d dist = Distance::edgeEdgeDistance(startpoint,
-            startpoint - curr_dir,
-            op_v1, op_v2,
-            p0bary, p1bary, q0bary, q1bary);
-        if (dist.norm() < min_dist)
-        {
-            min_dist = dist.norm();
-            startBary = q1bary;
-            startEdge = i;
-        }
-    }
+    static const double corners[3][2] = { {0, 0}, {1, 0}, {0, 1} };
+    int v0 = (side + 1) % 3;
+    int v1 = (side + 2) % 3;
+    return Eigen::Vector2d((1.0 - bary) * corners[v0][0] + bary * corners[v1][0], (1.0 - bary) * corners[v0][1] + bary * corners[v1][1]);
 }
 
-void TraceSet::getNextTracePoint(const FieldSurface &parent,
-    int curr_face_id,
-    int curr_edge_id,
-    double curr_bary,
-    const Eigen::Vector3d curr_dir,
-    int &next_edge_id,
-    double &next_bary,
-    int &opp_face_id,
-    int &opp_edge_id) const
+// Finds where the ray p + t dir, t > 0, leaves a face. Works in the face's barycentric frame, where straight lines
+// on the face stay straight, so the exit is found in closed form. p lies on side entryEdge, or inside the face
+// when entryEdge is -1. Fails if dir is degenerate or points back out through entryEdge. Exits that land within
+// vertexEps of a corner are nudged onto the edge interior. That way the walk continues into the next face
+// instead of stalling on the vertex.
+static bool exitFace(const Eigen::Vector2d &p, const Eigen::Vector2d &dir, int entryEdge, int &exitEdge, double &exitBary)
 {
-    Eigen::Vector3d op_vertex = parent.data().V.row(parent.data().F(curr_face_id,curr_edge_id)).transpose();
-    Eigen::Vector3d prev_point = pointFromBary(parent, curr_face_id, curr_edge_id, curr_bary);
-    Eigen::Vector3d split = op_vertex - prev_point;
-
-    double split_len = split.norm();
-    split = split / split_len;
-    Eigen::Vector3d n = parent.faceNormal(curr_face_id);
-    Eigen::Vector3d perp = split.cross(n);    
-
-    int op_edge_id = -1;
+    const double vertexEps = 1e-8;
+    // for each side, the barycentric coordinate vanishing on it at p, and the rate at which the ray decreases it
+    double gap[3] = { 1.0 - p[0] - p[1], p[0], p[1] };
+    double rate[3] = { dir[0] + dir[1], -dir[0], -dir[1] };
+    if (entryEdge != -1 && rate[entryEdge] > 0)
+        return false;
+
+    exitEdge = -1;
+    double tmin = std::numeric_limits<double>::infinity();
     for (int j = 0; j < 3; j++)
     {
-        if (j == curr_edge_id)
+        if (j == entryEdge || !(rate[j] > 0))
             continue;
-        int v0 = parent.data().F(curr_face_id, (j + 1) % 3);
-        int v1 = parent.data().F(curr_face_id, (j + 2) % 3);
-            
-        Eigen::Vector3d e_test = (parent.data().V.row(v0) + parent.data().V.row(v1)) * .5;
-        e_test -= prev_point;
-        if (e_test.dot(perp) * curr_dir.dot(perp) > 0.)
+        double t = std::max(gap[j], 0.0) / rate[j];
+        if (t < tmin)
         {
-            op_edge_id = j;
-            break;
+            tmin = t;
+            exitEdge = j;
         }
     }
-    // stop if we hit vertex
-    if (op_edge_id == -1)
-    {
-        next_edge_id = -1;
-        next_bary = 0.0;
-        opp_face_id = -1;
-        opp_edge_id = -1;
-        return;
-    }
+    if (exitEdge == -1)
+        return false;
 
-    // Find intersection point.
-    next_edge_id = op_edge_id;
-    Eigen::Vector3d op_v1 = parent.data().V.row(parent.data().F(curr_face_id, (next_edge_id + 1) % 3));
-    Eigen::Vector3d op_v2 = parent.data().V.row(parent.data().F(curr_face_id, (next_edge_id + 2) % 3));
-    
-    double p0bary, p1bary, q0bary, q1bary;
-    Eigen::Vector3d dist = Distance::edgeEdgeDistance(prev_point,
-        prev_point + curr_dir,
-        op_v1, op_v2,
-        p0bary, p1bary, q0bary, q1bary);
-
-    if (dist.norm() > 1e-6)
-    {
-        next_edge_id = -1;
-        next_bary = 0.0;
-        opp_face_id = -1;
-        opp_edge_id = -1;
-        return;
-    }
-    next_bary = q1bary;
-
-    opp_face_id = parent.data().E(parent.data().faceEdges(curr_face_id, next_edge_id), 0);
-    if (opp_face_id == curr_face_id)
-    {
-        opp_face_id = parent.data().E(parent.data().faceEdges(curr_face_id, next_edge_id), 1);
-    }    
+    Eigen::Vector2d q = p + tmin * dir;
+    double bary = (exitEdge == 0) ? q[1] : (exitEdge == 1 ? 1.0 - q[1] : q[0]);
+    exitBary = std::min(std::max(bary, vertexEps), 1.0 - vertexEps);
+    return true;
+}
 
-    if (opp_face_id != -1)
+// face and side on the other side of side `side` of face; false on a boundary edge
+static bool crossEdge(const FieldSurface &parent, int face, int side, int &oppFace, int &oppSide)
+{
+    int edgeid = parent.data().faceEdges(face, side);
+    oppFace = parent.data().E(edgeid, 0);
+    if (oppFace == face)
+        oppFace = parent.data().E(edgeid, 1);
+    if (oppFace == -1)
+        return false;
+    oppSide = -1;
+    for (int i = 0; i < 3; i++)
     {
-        for (int i = 0; i < 3; i++)
-        {
-            if (parent.data().faceEdges(curr_face_id, next_edge_id) == parent.data().faceEdges(opp_face_id, i))
-                opp_edge_id = i;
-        }
-    }    
+        if (parent.data().faceEdges(oppFace, i) == edgeid)
+            oppSide = i;
+    }
+    return oppSide != -1;
 }
 
+// carries a direction in face's barycentric frame across side `side` into the neighboring face's frame
+static Eigen::Vector2d transportDirection(const FieldSurface &parent, int face, int side, const Eigen::Vector2d &dir)
+{
+    int edgeid = parent.data().faceEdges(face, side);
+    int eside = 0;
+    if (parent.data().E(edgeid, eside) != face)
+        eside = 1;
+    return parent.data().Ts.block<2, 2>(2 * edgeid, 2 * eside) * dir;
+}
 
 void TraceSet::traceCurve(const FieldSurface &parent, const Trace_Mode trace_state,
     int traceIdx, int sign, int faceId, int steps)
 {
-    int curr_dir_idx = abs(traceIdx);
-    double coeff_dir = sign > 0 ? 1 : -1;
-    Eigen::Vector3d curr_dir = coeff_dir * parent.data().Bs[faceId] * parent.v(faceId, curr_dir_idx);
-
-    // assumes roughly delaunay    
-    curr_dir = curr_dir.normalized() * parent.data().averageEdgeLength * 1000.;
-
-    int curr_face_id = faceId;
+    Trace t(&parent, trace_state);
+    integrateTrace(parent, trace_state, traceIdx, sign, faceId, steps, t);
+    addTrace(t);
+}
 
-    Eigen::Vector3d startpoint;
-    startpoint.setZero();
-    for (int i = 0; i < 3; i++)
+void TraceSet::traceCurves(const FieldSurface &parent, const Trace_Mode trace_state,
+    const std::vector<TraceSeed> &seeds, int steps)
+{
+    PROFILE_SCOPE("TraceSet::traceCurves");
+    // traces are independent given the surface, so each is integrated into its own buffer and appended in seed order
+    int nseeds = seeds.size();
+    std::vector<Trace> batch(nseeds, Trace(&parent, trace_state));
+    parallelFor(0, nseeds, [&](int i)
     {
-        startpoint += parent.data().V.row(parent.data().F(faceId, i));
-    }
-    startpoint /= 3.0;
+        integrateTrace(parent, trace_state, seeds[i].field, seeds[i].sign, seeds[i].face, steps, batch[i]);
+    });
+    traces_.insert(traces_.end(), batch.begin(), batch.end());
+}
 
+void TraceSet::integrateTrace(const FieldSurface &parent, const Trace_Mode trace_state,
+    int traceIdx, int sign, int faceId, int steps, Trace &t,
+    const std::function<bool(const Eigen::Vector3d &)> &stop) const
+{
+    t.segs.clear();
 
+    int curr_dir_idx = abs(traceIdx);
+    double coeff_dir = sign > 0 ? 1 : -1;
+    // the direction is kept in the current face's barycentric frame, in which the trace is a straight line
+    Eigen::Vector2d curr_dir = coeff_dir * parent.v(faceId, curr_dir_idx);
+
+    int curr_face_id = faceId;
     int curr_edge_id;
     double curr_bary;
-    findTraceStart(parent, curr_face_id, startpoint, curr_dir, curr_edge_id, curr_bary); 
-    
-    Trace t(&parent, trace_state);
+    // start where the line through the centroid enters the face
+    if (!exitFace(Eigen::Vector2d(1.0 / 3.0, 1.0 / 3.0), -curr_dir, -1, curr_edge_id, curr_bary))
+        return;
 
-    assert(curr_edge_id > -1);
     for (int i = 0; i < steps; i++)
     {
         int next_edge_id;
         double next_bary;
         int opp_face_id;
         int opp_edge_id;
-        getNextTracePoint(parent, curr_face_id, curr_edge_id, curr_bary, curr_dir, next_edge_id, next_bary, opp_face_id, opp_edge_id);  
-        
-        if (next_edge_id == -1)
+        if (!exitFace(framePoint(curr_edge_id, curr_bary), curr_dir, curr_edge_id, next_edge_id, next_bary))
+            break;
+        if (!crossEdge(parent, curr_face_id, next_edge_id, opp_face_id, opp_edge_id))
             break;
-        if (opp_face_id == -1)
+        if (stop && stop(pointFromBary(parent, curr_face_id, next_edge_id, next_bary)))
             break;
 
         TraceSegment seg;
@@ -222,25 +209,14 @@ void TraceSet::traceCurve(const FieldSurface &parent, const Trace_Mode trace_sta
         seg.side[1] = next_edge_id;
         seg.bary[0] = curr_bary;
         seg.bary[1] = next_bary;
-    //    std::cout << parent.faceCurlEnergy(curr_face_id, 0) << std::endl;
         seg.inplanebending = parent.faceCurlEnergy(curr_face_id, 0);
         t.segs.push_back(seg);
 
         switch (trace_state)
         {
         case GEODESIC:
-        {
-            // projet vector into barycentric coordinates
-            Eigen::Matrix<double, 3, 2> B = parent.data().Bs[curr_face_id];
-            Eigen::Vector2d barys = (B.transpose()*B).inverse() * B.transpose() * curr_dir;
-            int edgeid = parent.data().faceEdges(curr_face_id, next_edge_id);
-            int side = 0;
-            if (parent.data().E(edgeid, side) != curr_face_id)
-                side = 1;
-            Eigen::Vector2d nextbarys = parent.data().Ts.block<2, 2>(2 * edgeid, 2 * side) * barys;
-            curr_dir = parent.data().Bs[opp_face_id] * nextbarys;
-        }
-        break;
+            curr_dir = transportDirection(parent, curr_face_id, next_edge_id, curr_dir);
+            break;
         case FIELD:
         {
             int edgeid = parent.data().faceEdges(curr_face_id, next_edge_id);
@@ -252,7 +228,7 @@ void TraceSet::traceCurve(const FieldSurface &parent, const Trace_Mode trace_sta
             Eigen::VectorXi curr_vec(parent.nFields());
             curr_vec.setZero();
             curr_vec(curr_dir_idx) = 1;
-            Eigen::VectorXi next_vec = perm * curr_vec;            
+            Eigen::VectorXi next_vec = perm * curr_vec;
             for (int idx = 0; idx < parent.nFields(); idx++)
             {
                 if (next_vec(idx) != 0)
@@ -261,23 +237,147 @@ void TraceSet::traceCurve(const FieldSurface &parent, const Trace_Mode trace_sta
                     {
                         coeff_dir *= -1.;
                     }
-                    curr_dir = parent.data().Bs[opp_face_id] * parent.v(opp_face_id, idx);
+                    curr_dir = parent.v(opp_face_id, idx);
                     curr_dir_idx = idx;
                     break;
                 }
             }
-            curr_dir = coeff_dir * curr_dir.normalized() * parent.data().averageEdgeLength * 1000.;
-            
+            curr_dir *= coeff_dir;
         }
             break;
         }
 
         curr_face_id = opp_face_id;
         curr_edge_id = opp_edge_id;
-        curr_bary = 1.0 - next_bary;                
+        curr_bary = 1.0 - next_bary;
+    }
+}
+
+// Joins the halves traced both ways from a seed face into line, running from the end of backward to the end of forward.
+// Both halves start by crossing the seed face, so backward's crossing is dropped, unless forward is empty (it stopped
+// at once, e.g. on the boundary), in which case backward's crossing is the only one.
+static void stitchTraceHalves(const Trace &forward, const Trace &backward, Trace &line)
+{
+    int skip = forward.segs.empty() ? 0 : 1;
+    for (int i = int(backward.segs.size()) - 1; i >= skip; i--)
+    {
+        TraceSegment rev = backward.segs[i];
+        std::swap(rev.side[0], rev.side[1]);
+        std::swap(rev.bary[0], rev.bary[1]);
+        line.segs.push_back(rev);
+    }
+    line.segs.insert(line.segs.end(), forward.segs.begin(), forward.segs.end());
+}
+
+void TraceSet::traceEvenlySpaced(const FieldSurface &parent, const Trace_Mode trace_state,
+    int field, int seedFace, double dsep, double dtest, int steps)
+{
+    PROFILE_SCOPE("TraceSet::traceEvenlySpaced");
+    int nfaces = parent.nFaces();
+    if (seedFace < 0 || seedFace >= nfaces || dsep <= 0)
+        return;
+    double avgedge = parent.data().averageEdgeLength;
+
+    // candidate seed points are snapped to the nearest face centroid
+    std::vector<Eigen::Vector3d> centroids(nfaces);
+    SpatialHash centroidHash(std::max(dsep, avgedge));
+    for (int i = 0; i < nfaces; i++)
+    {
+        centroids[i].setZero();
+        for (int j = 0; j < 3; j++)
+            centroids[i] += parent.data().V.row(parent.data().F(i, j)).transpose();
+        centroids[i] /= 3.0;
+        if (!parent.isFaceDeleted(i))
+            centroidHash.insert(centroids[i], i);
     }
+    // snapping moves a seed by up to about an edge length, which the separation test allows for
+    double seeddist = std::max(dtest, dsep - avgedge);
+
+    // samples of the traces made by this call only: the separation is per field, and traces of other fields (or random
+    // traces) on the same surface cross these freely
+    SpatialHash occupied(dsep);
+    auto addSamples = [&](const Trace &tr)
+    {
+        for (auto &seg : tr.segs)
+        {
+            occupied.insert(pointFromBary(parent, seg.face, seg.side[0], seg.bary[0]), 0);
+            occupied.insert(pointFromBary(parent, seg.face, seg.side[1], seg.bary[1]), 0);
+        }
+    };
+    // traces whose neighborhoods still have to be seeded
+    std::deque<int> queue;
+
+    auto traceFromSeed = [&](int face)
+    {
+        if (occupied.anyWithin(centroids[face], seeddist))
+            return;
 
-    addTrace(t);    
+        // the trace stops when it comes within dtest of another trace, or of a part of itself more than 2*dsep away
+        // along the trace (i.e. it closes up into a loop)
+        SpatialHash self(dsep);
+        std::vector<double> selfs;
+        Eigen::Vector3d prev;
+        double s = 0;
+        double dirsign = 1;
+        auto stop = [&](const Eigen::Vector3d &pt) -> bool
+        {
+            if (occupied.anyWithin(pt, dtest))
+                return true;
+            s += (pt - prev).norm();
+            prev = pt;
+            double signeds = dirsign * s;
+            if (self.findWithin(pt, dtest, [&](int tag) { return fabs(selfs[tag] - signeds) > 2.0 * dsep; }))
+                return true;
+            self.insert(pt, selfs.size());
+            selfs.push_back(signeds);
+            return false;
+        };
+
+        Trace forward(&parent, trace_state);
+        prev = centroids[face];
+        integrateTrace(parent, trace_state, field, 1, face, steps, forward, stop);
+        Trace backward(&parent, trace_state);
+        prev = centroids[face];
+        s = 0;
+        dirsign = -1;
+        integrateTrace(parent, trace_state, field, -1, face, steps, backward, stop);
+
+        Trace line(&parent, trace_state);
+        stitchTraceHalves(forward, backward, line);
+        if (line.segs.empty())
+            return;
+        // whichever half got going, the seed face's crossing survives the stitch (also when seeded on the boundary)
+        assert(std::any_of(line.segs.begin(), line.segs.end(), [&](const TraceSegment &seg) { return seg.face == face; }));
+
+        addTrace(line);
+        addSamples(line);
+        queue.push_back(traces_.size() - 1);
+    };
+
+    traceFromSeed(seedFace);
+    while (!queue.empty())
+    {
+        int tr = queue.front();
+        queue.pop_front();
+        // copy, since seeding appends to traces_
+        std::vector<TraceSegment> segs = traces_[tr].segs;
+        for (auto &seg : segs)
+        {
+            Eigen::Vector3d p0 = pointFromBary(parent, seg.face, seg.side[0], seg.bary[0]);
+            Eigen::Vector3d p1 = pointFromBary(parent, seg.face, seg.side[1], seg.bary[1]);
+            Eigen::Vector3d tangent = p1 - p0;
+            if (tangent.norm() == 0)
+                continue;
+            Eigen::Vector3d perp = parent.faceNormal(seg.face).cross(tangent).normalized();
+            Eigen::Vector3d mid = 0.5 * (p0 + p1);
+            for (int side = -1; side <= 1; side += 2)
+            {
+                int candidate = centroidHash.nearest(mid + side * dsep * perp, dsep);
+                if (candidate != -1)
+                    traceFromSeed(candidate);
+            }
+        }
+    }
 }
 
 Eigen::Vector3d TraceSet::pointFromBary(const FieldSurface &parent, int faceId, int faceEdge, double bary) const
@@ -312,9 +412,73 @@ void TraceSet::findCurvedVerts(const Trace &tr, double maxcurvature, std::set<in
     }
 }
 
-void TraceSet::exportForRendering(const char *filename)
+bool TraceSet::saveTraces(const char *filename, const std::vector<const FieldSurface *> &surfaces, bool singlePrecision) const
+{
+    TraceStore store(singlePrecision);
+    int skipped = 0;
+    for (auto &tr : traces_)
+    {
+        auto it = std::find(surfaces.begin(), surfaces.end(), tr.parent_);
+        if (it == surfaces.end())
+        {
+            skipped++;
+            continue;
+        }
+        store.add(tr, it - surfaces.begin());
+    }
+    if (skipped > 0)
+        std::cerr << "Skipped " << skipped << " traces not lying on any of the given surfaces" << std::endl;
+
+    std::vector<MeshKey> keys;
+    for (auto surf : surfaces)
+        keys.push_back(meshKey(*surf));
+    return store.save(filename, keys);
+}
+
+bool TraceSet::loadTraces(const char *filename, const std::vector<const FieldSurface *> &surfaces)
+{
+    TraceStore store;
+    std::vector<MeshKey> keys;
+    if (!store.load(filename, keys))
+        return false;
+
+    std::vector<MeshKey> surfkeys;
+    for (auto surf : surfaces)
+        surfkeys.push_back(meshKey(*surf));
+    std::vector<const FieldSurface *> parents(keys.size());
+    std::vector<Eigen::VectorXd> bending(keys.size());
+    for (int i = 0; i < keys.size(); i++)
+    {
+        auto it = std::find(surfkeys.begin(), surfkeys.end(), keys[i]);
+        if (it == surfkeys.end())
+        {
+            std::cerr << "Traces in " << filename << " were computed on a different mesh (" << keys[i].nverts << " vertices, " << keys[i].nfaces << " faces)" << std::endl;
+            return false;
+        }
+        parents[i] = surfaces[it - surfkeys.begin()];
+        int nfaces = parents[i]->nFaces();
+        bending[i].resize(nfaces);
+        for (int j = 0; j < nfaces; j++)
+            bending[i][j] = parents[i]->faceCurlEnergy(j, 0);
+    }
+
+    int ntraces = store.nTraces();
+    std::vector<Trace> loaded(ntraces, Trace(NULL, GEODESIC));
+    for (int i = 0; i < ntraces; i++)
+    {
+        int surf = store.traceSurface(i);
+        if (!store.extract(i, parents[surf], bending[surf], loaded[i]))
+        {
+            std::cerr << "Error reading trace file " << filename << ": face index out of range" << std::endl;
+            return false;
+        }
+    }
+    traces_.insert(traces_.end(), loaded.begin(), loaded.end());
+    return true;
+}
+
+void TraceSet::exportForRendering(CsvWriter &csv) const
 {
-    std::ofstream ofs(filename);
     int counter = 0;
     for(auto &it : rattraces_)
     {   
@@ -335,16 +499,22 @@ void TraceSet::exportForRendering(const char *filename)
         {
             Eigen::Vector3d v0 = it.pts.row(i);
             Eigen::Vector3d v1 = it.pts.row(i+1);
-            ofs << v0[0] << ",\t" << v0[1] << ",\t" << v0[2] << ",\t" 
+            csv << v0[0] << ",\t" << v0[1] << ",\t" << v0[2] << ",\t" 
                 << v1[0] << ",\t" << v1[1] << ",\t" << v1[2] << ",\t" 
-                << curvatures[i] << ",\t" << curvatures[i+1] << ",\t" << it.curlbending(i) << ",\t" << counter <<  ",\t" << it.origface[i] << std::endl;        
+                << curvatures[i] << ",\t" << curvatures[i+1] << ",\t" << it.curlbending(i) << ",\t" << counter <<  ",\t" << it.origface[i] << '\n';
         }
     }
 }
 
-void TraceSet::exportTraces(const char *filename)
+void TraceSet::exportForRendering(const char *filename)
+{
+    CsvWriter csv;
+    exportForRendering(csv);
+    csv.writeToFile(filename);
+}
+
+void TraceSet::exportTraces(CsvWriter &csv) const
 {
-    std::ofstream ofs(filename);
     int cnt=0;
     for(auto &tr : traces_)
     {
@@ -353,32 +523,70 @@ void TraceSet::exportTraces(const char *filename)
         {
             Eigen::Vector3d v0 = pointFromBary(*tr.parent_, tr.segs[i].face, tr.segs[i].side[0], tr.segs[i].bary[0]);
             Eigen::Vector3d v1 = pointFromBary(*tr.parent_, tr.segs[i].face, tr.segs[i].side[1], tr.segs[i].bary[1]);
-            ofs << v0[0] << ",\t" << v0[1] << ",\t" << v0[2] << ",\t" << v1[0] << ",\t" << v1[1] << ",\t" << v1[2] << ",\t" << cnt << std::endl;
+            csv << v0[0] << ",\t" << v0[1] << ",\t" << v0[2] << ",\t" << v1[0] << ",\t" << v1[1] << ",\t" << v1[2] << ",\t" << cnt << '\n';
         }
         cnt++;
     }
 }
 
-void TraceSet::splitTrace(const Trace &tr, const std::set<int> &badverts, std::vector<Trace> &splittr) const
+void TraceSet::exportTraces(const char *filename)
 {
-    splittr.clear();
+    CsvWriter csv;
+    exportTraces(csv);
+    csv.writeToFile(filename);
+}
+
+void TraceSet::splitTrace(const Trace &tr, const std::set<int> &badverts, std::vector<std::pair<int, int> > &pieces) const
+{
+    pieces.clear();
     std::vector<int> splitsegs;
     for (auto it : badverts)
         splitsegs.push_back(it-1);
     std::sort(splitsegs.begin(), splitsegs.end());
-    splittr.push_back(Trace(tr.parent_, tr.type_));
     int nsegs = tr.segs.size();
-    splitsegs.push_back(nsegs);
-    int idx = 0;
-    for (int i = 0; i < nsegs; i++)
+    int begin = 0;
+    for (auto it : splitsegs)
     {
-        splittr.back().segs.push_back(tr.segs[i]);
-        if (i == splitsegs[idx])
-        {
-            splittr.push_back(Trace(tr.parent_, tr.type_));
-            idx++;
-        }
+        pieces.push_back(std::make_pair(begin, it + 1));
+        begin = it + 1;
+    }
+    pieces.push_back(std::make_pair(begin, nsegs));
+}
+
+double TraceSet::walkGeodesic(const FieldSurface &parent, int face, int exitEdge, double exitBary, Eigen::Vector2d dir,
+    double length, std::vector<TraceSegment> &segs) const
+{
+    double covered = 0;
+    while (covered < length)
+    {
+        int oppface, oppedge;
+        if (!crossEdge(parent, face, exitEdge, oppface, oppedge))
+            break;
+        dir = transportDirection(parent, face, exitEdge, dir);
+        double entrybary = 1.0 - exitBary;
+        int nextedge;
+        double nextbary;
+        if (!exitFace(framePoint(oppedge, entrybary), dir, oppedge, nextedge, nextbary))
+            break;
+
+        TraceSegment seg;
+        seg.face = oppface;
+        seg.side[0] = oppedge;
+        seg.bary[0] = entrybary;
+        seg.side[1] = nextedge;
+        seg.bary[1] = nextbary;
+        seg.inplanebending = parent.faceCurlEnergy(oppface, 0);
+        segs.push_back(seg);
+
+        Eigen::Vector3d pt0 = pointFromBary(parent, oppface, seg.side[0], seg.bary[0]);
+        Eigen::Vector3d pt1 = pointFromBary(parent, oppface, seg.side[1], seg.bary[1]);
+        covered += (pt1 - pt0).norm();
+
+        face = oppface;
+        exitEdge = nextedge;
+        exitBary = nextbary;
     }
+    return covered;
 }
 
 void TraceSet::extendTrace(Trace &tr, double extbeginning, double extend, double &actualextbeginning, double &actualextend) const
@@ -388,116 +596,25 @@ void TraceSet::extendTrace(Trace &tr, double extbeginning, double extend, double
     if (tr.segs.size() == 0)
         return;
 
-    // extend beginning
-    std::vector<TraceSegment> toprepend;
-    int begface = tr.segs[0].face;
-    int begedge = tr.segs[0].side[1];
-    double begbary = tr.segs[0].bary[1];
-    Eigen::Vector3d v0 = pointFromBary(*tr.parent_, begface, begedge, begbary);
-    Eigen::Vector3d v1 = pointFromBary(*tr.parent_, begface, tr.segs[0].side[0], tr.segs[0].bary[0]);
-    Eigen::Vector3d dir = v1 - v0;
-    dir *= 1e3 / dir.norm();
-    int nextedge, oppface, oppedge;
-    double nextbary;
-    getNextTracePoint(*tr.parent_, begface, begedge, begbary, dir, nextedge, nextbary, oppface, oppedge);    
-    while (extbeginning > 0)
-    {
-        if (nextedge == -1 || oppface == -1)
-        {
-            // failed to extend
-            break;
-        }
-
-        // projet vector into barycentric coordinates
-        Eigen::Matrix<double, 3, 2> B = tr.parent_->data().Bs[begface];
-        Eigen::Vector2d barys = (B.transpose()*B).inverse() * B.transpose() * dir;
-        int edgeid = tr.parent_->data().faceEdges(begface, nextedge);
-        int side = 0;
-        if (tr.parent_->data().E(edgeid, side) != begface)
-            side = 1;
-        Eigen::Vector2d nextbarys = tr.parent_->data().Ts.block<2, 2>(2 * edgeid, 2 * side) * barys;
-        dir = tr.parent_->data().Bs[oppface] * nextbarys;
-
-        begface = oppface;
-        begedge = oppedge;
-        begbary = 1.0 - nextbary;
-
-        getNextTracePoint(*tr.parent_, begface, begedge, begbary, dir, nextedge, nextbary, oppface, oppedge);
+    const FieldSurface &parent = *tr.parent_;
 
-        if (nextedge == -1)
-        {
-            // failed to extend
-            break;
-        }
-        TraceSegment seg;
-        seg.face = begface;
-        seg.side[0] = nextedge;
-        seg.bary[0] = nextbary;
-        seg.side[1] = begedge;
-        seg.bary[1] = begbary;
-        toprepend.push_back(seg);
-
-        Eigen::Vector3d pt0 = pointFromBary(*tr.parent_, begface, seg.side[0], seg.bary[0]);
-        Eigen::Vector3d pt1 = pointFromBary(*tr.parent_, begface, seg.side[1], seg.bary[1]);
-        double dist = (pt1 - pt0).norm();
-        extbeginning -= dist;
-        actualextbeginning += dist;
+    // extend beginning, walking backwards along the first segment's direction
+    TraceSegment first = tr.segs[0];
+    Eigen::Vector2d begdir = framePoint(first.side[0], first.bary[0]) - framePoint(first.side[1], first.bary[1]);
+    std::vector<TraceSegment> toprepend;
+    actualextbeginning = walkGeodesic(parent, first.face, first.side[0], first.bary[0], begdir, extbeginning, toprepend);
+    // these were walked away from the trace, so flip them to run towards it
+    for (auto &seg : toprepend)
+    {
+        std::swap(seg.side[0], seg.side[1]);
+        std::swap(seg.bary[0], seg.bary[1]);
     }
 
     // extend end
+    TraceSegment last = tr.segs.back();
+    Eigen::Vector2d enddir = framePoint(last.side[1], last.bary[1]) - framePoint(last.side[0], last.bary[0]);
     std::vector<TraceSegment> toappend;
-    int endface = tr.segs.back().face;
-    int endedge = tr.segs.back().side[0];
-    double endbary = tr.segs.back().bary[0];
-    v0 = pointFromBary(*tr.parent_, endface, endedge, endbary);
-    v1 = pointFromBary(*tr.parent_, endface, tr.segs.back().side[1], tr.segs.back().bary[1]);
-    dir = v1 - v0;
-    dir *= 1e3 / dir.norm();
-    getNextTracePoint(*tr.parent_, endface, endedge, endbary, dir, nextedge, nextbary, oppface, oppedge);    
-
-    while (extend > 0)
-    {
-        if (nextedge == -1 || oppface == -1)
-        {
-            // failed to extend
-            break;
-        }
-
-        // project vector into barycentric coordinates
-        Eigen::Matrix<double, 3, 2> B = tr.parent_->data().Bs[endface];
-        Eigen::Vector2d barys = (B.transpose()*B).inverse() * B.transpose() * dir;
-        int edgeid = tr.parent_->data().faceEdges(endface, nextedge);
-        int side = 0;
-        if (tr.parent_->data().E(edgeid, side) != endface)
-            side = 1;
-        Eigen::Vector2d nextbarys = tr.parent_->data().Ts.block<2, 2>(2 * edgeid, 2 * side) * barys;
-        dir = tr.parent_->data().Bs[oppface] * nextbarys;
-
-        endface = oppface;
-        endedge = oppedge;
-        endbary = 1.0 - nextbary;
-
-        getNextTracePoint(*tr.parent_, endface, endedge, endbary, dir, nextedge, nextbary, oppface, oppedge);
-
-        if (nextedge == -1)
-        {
-            // failed to extend
-            break;
-        }
-        TraceSegment seg;
-        seg.face = endface;
-        seg.side[0] = endedge;
-        seg.bary[0] = endbary;
-        seg.side[1] = nextedge;
-        seg.bary[1] = nextbary;
-        toappend.push_back(seg);
-
-        Eigen::Vector3d pt0 = pointFromBary(*tr.parent_, endface, seg.side[0], seg.bary[0]);
-        Eigen::Vector3d pt1 = pointFromBary(*tr.parent_, endface, seg.side[1], seg.bary[1]);
-        double dist = (pt1 - pt0).norm();
-        extend -= dist;
-        actualextend += dist;
-    }
+    actualextend = walkGeodesic(parent, last.face, last.side[1], last.bary[1], enddir, extend, toappend);
 
     std::reverse(toprepend.begin(), toprepend.end());
     for (auto &it : tr.segs)
@@ -507,11 +624,10 @@ void TraceSet::extendTrace(Trace &tr, double extbeginning, double extend, double
     tr.segs = toprepend;
 }
 
-double TraceSet::arclength(const Trace &tr) const
+double TraceSet::arclength(const Trace &tr, int begin, int end) const
 {
     double result = 0;
-    int nsegs = tr.segs.size();
-    for (int i = 0; i < nsegs; i++)
+    for (int i = begin; i < end; i++)
     {
         Eigen::Vector3d pt0 = pointFromBary(*tr.parent_, tr.segs[i].face, tr.segs[i].side[0], tr.segs[i].bary[0]);
         Eigen::Vector3d pt1 = pointFromBary(*tr.parent_, tr.segs[i].face, tr.segs[i].side[1], tr.segs[i].bary[1]);
@@ -534,10 +650,23 @@ Eigen::Vector3d parallelTransport(const Eigen::Vector3d &v, const Eigen::Vector3
     return v.dot(n)*n + v.dot(t1)*t2 + v.dot(p1)*p2;
 }
 
-void TraceSet::findPointOnTrace(const Trace &tr, double s, int &seg, double &bary)
+void TraceSet::arclengths(const Trace &tr, std::vector<double> &svals) const
 {
-    // this should be rewritten to be O(log n) using binary search
+    int nsegs = tr.segs.size();
+    svals.resize(nsegs + 1);
+    svals[0] = 0;
+    double curs = 0;
+    for (int i = 0; i < nsegs; i++)
+    {
+        Eigen::Vector3d pt0 = pointFromBary(*tr.parent_, tr.segs[i].face, tr.segs[i].side[0], tr.segs[i].bary[0]);
+        Eigen::Vector3d pt1 = pointFromBary(*tr.parent_, tr.segs[i].face, tr.segs[i].side[1], tr.segs[i].bary[1]);
+        curs += (pt1 - pt0).norm();
+        svals[i + 1] = curs;
+    }
+}
 
+void TraceSet::findPointOnTrace(const Trace &tr, const std::vector<double> &svals, double s, int &seg, double &bary) const
+{
     if (s < 0)
     {
         seg = 0;
@@ -545,27 +674,35 @@ void TraceSet::findPointOnTrace(const Trace &tr, double s, int &seg, double &bar
         return;
     }
 
-    double curs = 0;
     int nsegs = tr.segs.size();
-    for (int i = 0; i < nsegs; i++)
+    // the segment i with svals[i] <= s < svals[i+1]
+    int i = int(std::upper_bound(svals.begin(), svals.end(), s) - svals.begin()) - 1;
+    if (i >= 0 && i < nsegs)
     {
         Eigen::Vector3d pt0 = pointFromBary(*tr.parent_, tr.segs[i].face, tr.segs[i].side[0], tr.segs[i].bary[0]);
         Eigen::Vector3d pt1 = pointFromBary(*tr.parent_, tr.segs[i].face, tr.segs[i].side[1], tr.segs[i].bary[1]);
         double dist = (pt1 - pt0).norm();
-        if (curs <= s && s < curs + dist)
-        {
-            bary = (s - curs) / dist;
-            seg = i;
-            return;
-        }
-        curs += dist;
+        bary = (s - svals[i]) / dist;
+        seg = i;
+        return;
     }
     // past end of rod
     seg = nsegs - 1;
     bary = 1.0;
 }
 
-void TraceSet::sampleTrace(const Trace &tr, double start, double end, int nsegs, RationalizedTrace &rattrace, std::vector<double> &samples)
+// finds the interval [samples[seg], samples[seg+1]) of the (nondecreasing) samples containing s; returns false if there is none
+static bool findSampleInterval(const std::vector<double> &samples, double s, int &seg, double &bary)
+{
+    int i = int(std::upper_bound(samples.begin(), samples.end(), s) - samples.begin()) - 1;
+    if (i < 0 || i >= int(samples.size()) - 1)
+        return false;
+    seg = i;
+    bary = (s - samples[i]) / (samples[i + 1] - samples[i]);
+    return true;
+}
+
+void TraceSet::sampleTrace(const Trace &tr, const std::vector<double> &svals, double start, double end, int nsegs, RationalizedTrace &rattrace, std::vector<double> &samples) const
 {
     samples.clear();
     rattrace.normals.resize(nsegs, 3);
@@ -578,7 +715,7 @@ void TraceSet::sampleTrace(const Trace &tr, double start, double end, int nsegs,
         samples.push_back(s);
         int seg;
         double bary;
-        findPointOnTrace(tr, s, seg, bary);
+        findPointOnTrace(tr, svals, s, seg, bary);
         Eigen::Vector3d pt0 = pointFromBary(*tr.parent_, tr.segs[seg].face, tr.segs[seg].side[0], tr.segs[seg].bary[0]);
         Eigen::Vector3d pt1 = pointFromBary(*tr.parent_, tr.segs[seg].face, tr.segs[seg].side[1], tr.segs[seg].bary[1]);
         Eigen::Vector3d interp = (1.0 - bary)*pt0 + bary*pt1;
@@ -590,7 +727,7 @@ void TraceSet::sampleTrace(const Trace &tr, double start, double end, int nsegs,
         double s = start + (end - start)*double(2*i+1) / (2.0*nsegs);
         int seg;
         double bary;
-        findPointOnTrace(tr, s, seg, bary);
+        findPointOnTrace(tr, svals, s, seg, bary);
         Eigen::Vector3d oldpt0 = pointFromBary(*tr.parent_, tr.segs[seg].face, tr.segs[seg].side[0], tr.segs[seg].bary[0]);
         Eigen::Vector3d oldpt1 = pointFromBary(*tr.parent_, tr.segs[seg].face, tr.segs[seg].side[1], tr.segs[seg].bary[1]);
         Eigen::Vector3d normal = tr.parent_->faceNormal(tr.segs[seg].face);
@@ -669,45 +806,71 @@ void TraceSet::smoothRationalizedTraces(double amount)
     }
 }
 
-void TraceSet::rationalizeTraces(double maxcurvature, double extenddist, double seglen, double minlen)
+void TraceSet::rationalizeTraces(double maxcurvature, double extenddist, double seglen, double minlen, SolverProgress *progress)
 {
+    PROFILE_SCOPE("TraceSet::rationalizeTraces");
     rattraces_.clear();
     collisions_.clear();
+    if (!reportProgress(progress, "rationalize: split", 0.0))
+        return;
 
-    std::vector<Trace> cleanedtraces;
-    for (int i = 0; i < traces_.size(); i++)
+    // every stage below works on one trace at a time, so each runs in parallel over traces. Pieces and reorderings are
+    // tracked by segment ranges and index permutations; traces are only ever moved, never copied wholesale
+    auto splitStart = std::chrono::steady_clock::now();
+
+    // split at sharp bends, keeping only the pieces longer than minlen
+    int ninput = traces_.size();
+    std::vector<std::vector<Trace> > pieces(ninput);
+    parallelFor(0, ninput, [&](int i)
     {
+        const Trace &tr = traces_[i];
         std::set<int> badverts;
-        findCurvedVerts(traces_[i], maxcurvature, badverts);        
-        std::vector<Trace> splittr;
-        splitTrace(traces_[i], badverts, splittr);
-        for (auto &it : splittr)
+        findCurvedVerts(tr, maxcurvature, badverts);
+        std::vector<std::pair<int, int> > ranges;
+        splitTrace(tr, badverts, ranges);
+        for (auto &it : ranges)
         {
-            if (minlen < arclength(it))
-                cleanedtraces.push_back(it);
+            if (minlen < arclength(tr, it.first, it.second))
+            {
+                pieces[i].push_back(Trace(tr.parent_, tr.type_));
+                pieces[i].back().segs.assign(tr.segs.begin() + it.first, tr.segs.begin() + it.second);
+            }
         }
+    });
+    std::vector<Trace> cleanedtraces;
+    for (auto &it : pieces)
+    {
+        for (auto &tr : it)
+            cleanedtraces.push_back(std::move(tr));
     }
-    
+    pieces.clear();
+    if (!reportProgress(progress, "rationalize: extend", 0.25))
+        return;
+
+    auto extendStart = std::chrono::steady_clock::now();
+
     // extend traces if desired
-    std::vector<double> starts;
-    std::vector<double> ends;
-    for (auto &it : cleanedtraces)
+    int ntraces = cleanedtraces.size();
+    std::vector<double> starts(ntraces);
+    std::vector<double> ends(ntraces);
+    std::vector<std::vector<double> > svals(ntraces);
+    parallelFor(0, ntraces, [&](int i)
     {
         double actualextbeginning;
         double actualextend;
-        extendTrace(it, extenddist, extenddist, actualextbeginning, actualextend);
-        double len = arclength(it);
+        extendTrace(cleanedtraces[i], extenddist, extenddist, actualextbeginning, actualextend);
+        arclengths(cleanedtraces[i], svals[i]);
+        double len = svals[i].back();
         double start = actualextbeginning - extenddist;
         start = std::max(start, 0.0);
         start = std::min(start, len);
-        starts.push_back(start);
+        starts[i] = start;
         double end = len + extenddist - actualextend;
         end = std::max(end, 0.0);
         end = std::min(end, len);
-        ends.push_back(end);
-    }
+        ends[i] = end;
+    });
 
-    int ntraces = cleanedtraces.size();
     std::vector<int> permutation;
     for (int i = 0; i < ntraces; i++)
     {
@@ -717,7 +880,7 @@ void TraceSet::rationalizeTraces(double maxcurvature, double extenddist, double
     // sort traces by length
 
     std::sort(permutation.begin(), permutation.end(),
-        [ends, starts](int a, int b) -> bool
+        [&ends, &starts](int a, int b) -> bool
     {
         return (ends[a] - starts[a]) < (ends[b] - starts[b]);
     });
@@ -725,45 +888,25 @@ void TraceSet::rationalizeTraces(double maxcurvature, double extenddist, double
     std::vector<Trace> orderedtraces;
     std::vector<double> orderedstarts;
     std::vector<double> orderedends;
+    std::vector<std::vector<double> > orderedsvals;
     for (int i = 0; i < ntraces; i++)
     {
-        orderedtraces.push_back(cleanedtraces[permutation[i]]);
+        orderedtraces.push_back(std::move(cleanedtraces[permutation[i]]));
         orderedstarts.push_back(starts[permutation[i]]);
         orderedends.push_back(ends[permutation[i]]);
+        orderedsvals.push_back(std::move(svals[permutation[i]]));
     }
-    
-    // find collisions
-    
+    cleanedtraces.clear();
+    if (!reportProgress(progress, "rationalize: collisions", 0.5))
+        return;
+
+    auto collisionStart = std::chrono::steady_clock::now();
 
+    // find collisions
     std::map<std::pair<int, int>, std::vector<TraceCollision> > cols;
-    for (int i = 0; i < ntraces; i++)
-    {
-        for (int j = i; j < ntraces; j++)
-        {
-            bool self = i == j;
-            std::vector<TraceCollision> paircols;
-            computeIntersections(orderedtraces[i], orderedtraces[j], self, paircols);
-            cols[std::pair<int, int>(i, j)] = paircols;
-        }
-    }
+    findCollisions(orderedtraces, cols);
 
     // convert collisions to pairs of arclength values
-    std::vector<std::vector<double> > svals;
-    svals.resize(ntraces);
-    for (int i = 0; i < ntraces; i++)
-    {
-        svals[i].push_back(0);
-        double s = 0;
-        int nsegs = orderedtraces[i].segs.size();
-        for (int j = 0; j < nsegs; j++)
-        {
-            Eigen::Vector3d pt0 = pointFromBary(*orderedtraces[i].parent_, orderedtraces[i].segs[j].face, orderedtraces[i].segs[j].side[0], orderedtraces[i].segs[j].bary[0]);
-            Eigen::Vector3d pt1 = pointFromBary(*orderedtraces[i].parent_, orderedtraces[i].segs[j].face, orderedtraces[i].segs[j].side[1], orderedtraces[i].segs[j].bary[1]);
-            double dist = (pt1 - pt0).norm();
-            s += dist;
-            svals[i].push_back(s);
-        }
-    }
     struct ArcCollision
     {
         int rod1, rod2;
@@ -778,63 +921,35 @@ void TraceSet::rationalizeTraces(double maxcurvature, double extenddist, double
             ArcCollision ac;
             ac.rod1 = it.first.first;
             ac.rod2 = it.first.second;
-            ac.s1 = (1.0 - it.second[i].bary1)*svals[ac.rod1][it.second[i].seg1] + it.second[i].bary1 * svals[ac.rod1][it.second[i].seg1 + 1];
-            ac.s2 = (1.0 - it.second[i].bary2)*svals[ac.rod2][it.second[i].seg2] + it.second[i].bary2 * svals[ac.rod2][it.second[i].seg2 + 1];
+            ac.s1 = (1.0 - it.second[i].bary1)*orderedsvals[ac.rod1][it.second[i].seg1] + it.second[i].bary1 * orderedsvals[ac.rod1][it.second[i].seg1 + 1];
+            ac.s2 = (1.0 - it.second[i].bary2)*orderedsvals[ac.rod2][it.second[i].seg2] + it.second[i].bary2 * orderedsvals[ac.rod2][it.second[i].seg2 + 1];
             arccols.push_back(ac);
         }
     }
 
+    if (!reportProgress(progress, "rationalize: sample", 0.75))
+        return;
+
+    auto sampleStart = std::chrono::steady_clock::now();
+
     // sample traces into rod segments
     std::vector<std::vector<double> > samples;
     samples.resize(ntraces);
-    for (int i = 0; i < ntraces; i++)
+    rattraces_.resize(ntraces);
+    parallelFor(0, ntraces, [&](int i)
     {
         int nsegs = 1 + int( (orderedends[i] - orderedstarts[i]) / seglen);
-        RationalizedTrace rat;
-        sampleTrace(orderedtraces[i], orderedstarts[i], orderedends[i], nsegs, rat, samples[i]);
-        rattraces_.push_back(rat);
-    }
+        sampleTrace(orderedtraces[i], orderedsvals[i], orderedstarts[i], orderedends[i], nsegs, rattraces_[i], samples[i]);
+    });
 
     // compute collisions on sampled rod segments
-    // should be rewritten to be O(m log n) with binary search
     for (auto &it : arccols)
     {
-        int seg1 = -1;
-        double bary1 = 0;
-        double curs = samples[it.rod1][0];
-        if (it.s1 < curs)
-            continue;
-        for (int i = 0; i < samples[it.rod1].size() - 1; i++)
-        {
-            double nexts = samples[it.rod1][i + 1];
-            if (curs <= it.s1 && it.s1 < nexts)
-            {
-                seg1 = i;
-                bary1 = (it.s1 - curs) / (nexts - curs);
-                break;
-            }
-            curs = nexts;
-        }
-        if (seg1 == -1)
+        int seg1, seg2;
+        double bary1, bary2;
+        if (!findSampleInterval(samples[it.rod1], it.s1, seg1, bary1))
             continue;
-
-        int seg2 = -1;
-        double bary2 = 0;
-        curs = samples[it.rod2][0];
-        if (it.s2 < curs)
-            continue;
-        for (int i = 0; i < samples[it.rod2].size() - 1; i++)
-        {
-            double nexts = samples[it.rod2][i + 1];
-            if (curs <= it.s2 && it.s2 < nexts)
-            {
-                seg2 = i;
-                bary2 = (it.s2 - curs) / (nexts - curs);
-                break;
-            }
-            curs = nexts;
-        }
-        if (seg2 == -1)
+        if (!findSampleInterval(samples[it.rod2], it.s2, seg2, bary2))
             continue;
 
         Collision col;
@@ -846,112 +961,188 @@ void TraceSet::rationalizeTraces(double maxcurvature, double extenddist, double
         col.bary2 = bary2;
         collisions_.push_back(col);
     }
+
+    auto sampleEnd = std::chrono::steady_clock::now();
+    profileCounter("rationalized rods", ntraces);
+    profileCounter("rod collisions", collisions_.size());
+    std::cout << "Rationalized " << ninput << " traces into " << ntraces << " rods with " << collisions_.size() << " collisions: split "
+        << std::chrono::duration<double>(extendStart - splitStart).count() << "s, extend "
+        << std::chrono::duration<double>(collisionStart - extendStart).count() << "s, collisions "
+        << std::chrono::duration<double>(sampleStart - collisionStart).count() << "s, sample "
+        << std::chrono::duration<double>(sampleEnd - sampleStart).count() << "s" << std::endl;
 }
     
 
+void TraceSet::rodFile(int colorGroupSize, RodFile &rods) const
+{
+    rods.rods.resize(rattraces_.size());
+    int color = 0;
+    for (int i = 0; i < rattraces_.size(); i++)
+    {
+        const RationalizedTrace &it = rattraces_[i];
+        RodFileRod &rod = rods.rods[i];
+        rod.pts = it.pts;
+        rod.normals = it.normals;
+        int nsegs = it.normals.rows();
+        rod.materials.resize(nsegs);
+        for (int j = 0; j < nsegs; j++)
+            rod.materials[j] = it.origface[j] / colorGroupSize;
+        rod.color = color;
+        color = (color + 1) % 7;
+    }
+    rods.collisions = collisions_;
+}
+
 void TraceSet::exportRodFile(const char*filename, int colorGroupSize)
 {
-    std::ofstream myfile(filename);
-    // Write Header 
-    myfile << -217 << std::endl;
-    myfile << 2 << std::endl;
-    myfile << rattraces_.size() << std::endl;;
-    myfile << collisions_.size() << std::endl;;
-    myfile << "0.001"  << std::endl;;
-    myfile << "1e+08"  << std::endl;;
-    myfile << "1"  << std::endl  << std::endl  << std::endl;;
-
-    int color=0;
-    for (auto &it : rattraces_)
-    {
-        int nverts = it.pts.rows();
-        int nsegs = it.normals.rows();        
-        myfile << nverts << std::endl;
-        myfile << 0 << std::endl;
-        myfile << 1 << std::endl;
-        myfile << color << std::endl;
-        color = (color+1)%7;
-        
-        for (int i = 0; i < nverts; i++)
-        {
-            myfile << it.pts(i,0) << " " << it.pts(i,1) << " " << it.pts(i,2) << " ";
-        }
-        myfile << std::endl;
+    RodFile rods;
+    rodFile(colorGroupSize, rods);
+    writeRodFile(filename, rods);
+}
 
-        for (int i = 0; i < nsegs; i++)
+void TraceSet::exportBinaryRodFile(const char *filename, int colorGroupSize)
+{
+    RodFile rods;
+    rodFile(colorGroupSize, rods);
+    writeBinaryRodFile(filename, rods);
+}
+
+void TraceSet::findCollisions(const std::vector<Trace> &traces,
+    std::map<std::pair<int, int>, std::vector<TraceCollision> > &cols) const
+{
+    PROFILE_SCOPE("TraceSet::findCollisions");
+    cols.clear();
+
+    // Two segments can only cross inside the same triangle. Traces on different sheets of a cover (or on different
+    // surfaces) lie on distinct faces at identical positions, so faces are identified by their sorted corner positions.
+    struct SegmentRef
+    {
+        int trace;
+        int seg;
+    };
+    std::map<std::array<double, 9>, int> faceKeys;
+    std::map<const FieldSurface *, std::vector<int> > faceBuckets;
+    std::vector<std::vector<SegmentRef> > buckets;
+    int ntraces = traces.size();
+    for (int i = 0; i < ntraces; i++)
+    {
+        const FieldSurface &parent = *traces[i].parent_;
+        std::vector<int> &parentBuckets = faceBuckets[&parent];
+        if (parentBuckets.empty())
+            parentBuckets.resize(parent.nFaces(), -1);
+        int nsegs = traces[i].segs.size();
+        for (int j = 0; j < nsegs; j++)
         {
-            myfile << it.normals(i,0) << " " << it.normals(i,1) << " " << it.normals(i,2) << " ";
+            int face = traces[i].segs[j].face;
+            if (parentBuckets[face] == -1)
+            {
+                std::array<Eigen::Vector3d, 3> corners;
+                for (int k = 0; k < 3; k++)
+                    corners[k] = parent.data().V.row(parent.data().F(face, k)).transpose();
+                std::sort(corners.begin(), corners.end(), [](const Eigen::Vector3d &a, const Eigen::Vector3d &b) -> bool
+                {
+                    return std::lexicographical_compare(a.data(), a.data() + 3, b.data(), b.data() + 3);
+                });
+                std::array<double, 9> key;
+                for (int k = 0; k < 3; k++)
+                    for (int l = 0; l < 3; l++)
+                        key[3 * k + l] = corners[k][l];
+                auto it = faceKeys.insert(std::make_pair(key, int(buckets.size())));
+                if (it.second)
+                    buckets.push_back(std::vector<SegmentRef>());
+                parentBuckets[face] = it.first->second;
+            }
+            SegmentRef ref;
+            ref.trace = i;
+            ref.seg = j;
+            buckets[parentBuckets[face]].push_back(ref);
         }
-        myfile << std::endl;
+    }
+
+    size_t bucketBytes = faceKeys.size() * sizeof(std::pair<std::array<double, 9>, int>);
+    for (const std::vector<SegmentRef> &bucket : buckets)
+        bucketBytes += bucket.capacity() * sizeof(SegmentRef) + sizeof(bucket);
+    profileCounter("collision bucket bytes", bucketBytes);
 
-        for (int i = 0; i < nsegs; i++)
+    // test co-located segments against each other, in parallel over faces
+    struct PairCollision
+    {
+        int rod1, rod2;
+        TraceCollision col;
+    };
+    int nbuckets = buckets.size();
+    std::vector<std::vector<PairCollision> > bucketcols(nbuckets);
+    parallelFor(0, nbuckets, [&](int b)
+    {
+        const std::vector<SegmentRef> &bucket = buckets[b];
+        int nbucketsegs = bucket.size();
+        std::vector<Eigen::Vector3d> endpts(2 * nbucketsegs);
+        for (int k = 0; k < nbucketsegs; k++)
         {
-            myfile << "0 ";
+            const Trace &tr = traces[bucket[k].trace];
+            const TraceSegment &seg = tr.segs[bucket[k].seg];
+            endpts[2 * k] = pointFromBary(*tr.parent_, seg.face, seg.side[0], seg.bary[0]);
+            endpts[2 * k + 1] = pointFromBary(*tr.parent_, seg.face, seg.side[1], seg.bary[1]);
         }
-        myfile << std::endl;
-        
-        for(int i=0; i<nsegs; i++)
+
+        // gather the candidate pairs, then measure them all in one batch
+        std::vector<std::pair<SegmentRef, SegmentRef> > candidates;
+        Distance::SegmentPairs pairs;
+        for (int k = 0; k < nbucketsegs; k++)
         {
-            myfile << "0.02 ";
+            for (int l = k; l < nbucketsegs; l++)
+            {
+                // order the pair as the all-pairs sweep did: lower trace first, and for self collisions the later segment first
+                int i1 = k, i2 = l;
+                if (bucket[i2].trace < bucket[i1].trace || (bucket[i1].trace == bucket[i2].trace && bucket[i2].seg > bucket[i1].seg))
+                    std::swap(i1, i2);
+                const SegmentRef &r1 = bucket[i1];
+                const SegmentRef &r2 = bucket[i2];
+                if (r1.trace == r2.trace && (r1.seg - r2.seg) < 2)
+                    continue;
+                candidates.push_back(std::make_pair(r1, r2));
+                pairs.push_back(endpts[2 * i1], endpts[2 * i1 + 1], endpts[2 * i2], endpts[2 * i2 + 1]);
+            }
         }
-        myfile << std::endl;
-        
-        for(int i=0; i<nsegs; i++)
-        {
-            myfile << int(it.origface[i] / colorGroupSize) << " ";            
-        }        
-        myfile << std::endl;
-        myfile << std::endl;
-    }
-    
-    int ncollisions = collisions_.size();
-    for (int i = 0; i < ncollisions; i++)
-    {
-        Collision &col = collisions_[i];
-        myfile << col.rod1 << std::endl;
-        myfile << col.rod2 << std::endl;
-        myfile << col.seg1 << std::endl;
-        myfile << col.seg2 << std::endl;
-        myfile << col.bary1 << std::endl;
-        myfile << col.bary2 << std::endl;
-        myfile << "1000." << std::endl;
-
-    }
-}
-
-void TraceSet::computeIntersections(const Trace &tr1, const Trace &tr2, bool selfcollision, 
-    std::vector<TraceCollision> &collisions) const
-{
-    collisions.clear();
-    int nsegs1 = tr1.segs.size();
-    int nsegs2 = tr2.segs.size();
+        int ncandidates = candidates.size();
+        std::vector<double> dist(ncandidates), p1bary(ncandidates), q1bary(ncandidates);
+        Distance::edgeEdgeDistances(pairs, dist.data(), p1bary.data(), q1bary.data());
 
-    for (int i = 0; i < nsegs1; i++)
-    {
-        for (int j = 0; j < nsegs2; j++)
+        for (int i = 0; i < ncandidates; i++)
         {
-            if (selfcollision && (i - j) < 2) { continue; }
-            else
+            double p0bary = 1.0 - p1bary[i];
+            double q0bary = 1.0 - q1bary[i];
+            if (dist[i] < 1e-6 && p0bary != 0 && p0bary != 1.0 && q0bary != 0 && q0bary != 1.0)
             {
-                Eigen::Vector3d p0 = pointFromBary(*tr1.parent_, tr1.segs[i].face, tr1.segs[i].side[0], tr1.segs[i].bary[0]);
-                Eigen::Vector3d p1 = pointFromBary(*tr1.parent_, tr1.segs[i].face, tr1.segs[i].side[1], tr1.segs[i].bary[1]);
-                Eigen::Vector3d q0 = pointFromBary(*tr2.parent_, tr2.segs[j].face, tr2.segs[j].side[0], tr2.segs[j].bary[0]);
-                Eigen::Vector3d q1 = pointFromBary(*tr2.parent_, tr2.segs[j].face, tr2.segs[j].side[1], tr2.segs[j].bary[1]);
-                double p0bary, p1bary, q0bary, q1bary;
-                Eigen::Vector3d dist = Distance::edgeEdgeDistance(p0, p1, q0, q1,
-                    p0bary, p1bary, q0bary, q1bary);
-                if (dist.norm() < 1e-6 && p0bary != 0 && p0bary != 1.0 && q0bary != 0 && q0bary != 1.0)
-                {
-                    TraceCollision tc;
-                    tc.seg1 = i;
-                    tc.seg2 = j;
-                    tc.bary1 = p1bary;
-                    tc.bary2 = q1bary;
-                    collisions.push_back(tc);
-                }
+                PairCollision pc;
+                pc.rod1 = candidates[i].first.trace;
+                pc.rod2 = candidates[i].second.trace;
+                pc.col.seg1 = candidates[i].first.seg;
+                pc.col.seg2 = candidates[i].second.seg;
+                pc.col.bary1 = p1bary[i];
+                pc.col.bary2 = q1bary[i];
+                bucketcols[b].push_back(pc);
             }
         }
-    }
+    });
+
+    // gather, in the same order as testing every pair of traces segment by segment
+    std::vector<PairCollision> allcols;
+    for (auto &it : bucketcols)
+        allcols.insert(allcols.end(), it.begin(), it.end());
+    std::sort(allcols.begin(), allcols.end(), [](const PairCollision &a, const PairCollision &b) -> bool
+    {
+        if (a.rod1 != b.rod1)
+            return a.rod1 < b.rod1;
+        if (a.rod2 != b.rod2)
+            return a.rod2 < b.rod2;
+        if (a.col.seg1 != b.col.seg1)
+            return a.col.seg1 < b.col.seg1;
+        return a.col.seg2 < b.col.seg2;
+    });
+    for (auto &it : allcols)
+        cols[std::pair<int, int>(it.rod1, it.rod2)].push_back(it.col);
+    profileCounter("collision bytes", allcols.capacity() * sizeof(PairCollision));
 }
 
 void TraceSet::collisionPoint(int collision, Eigen::Vector3d &pt0, Eigen::Vector3d &pt1) const
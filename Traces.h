@@ -4,8 +4,13 @@
 #include <vector>
 #include <Eigen/Core>
 #include <set>
+#include <map>
+#include <functional>
 
 class FieldSurface;
+struct RodFile;
+class CsvWriter;
+class SolverProgress;
 
 enum Trace_Mode {
     GEODESIC = 0,
@@ -56,6 +61,14 @@ struct RationalizedTrace
     Eigen::VectorXd curlbending;
 };
 
+// starting point of a trace: the centroid of a face, heading along one of the face's fields (sign = +1 or -1)
+struct TraceSeed
+{
+    int face;
+    int field;
+    int sign;
+};
+
 // a collection of traces on a surface
 class TraceSet
 {
@@ -72,6 +85,12 @@ public:
     
     void addTrace(const Trace &tr);
     void traceCurve(const FieldSurface &parent, const Trace_Mode trace_state, int traceIdx, int sign, int faceId, int steps);
+    // traces a curve from every seed, in parallel; the traces are appended in seed order
+    void traceCurves(const FieldSurface &parent, const Trace_Mode trace_state, const std::vector<TraceSeed> &seeds, int steps);
+    // evenly-spaced traces (Jobard-Lefer): starting from seedFace, traces along the given field in both directions,
+    // stopping within dtest of the other traces made by this call, and seeds new traces dsep to either side of each
+    // accepted one. Traces already in the set are ignored, so calling this once per field spaces each field separately.
+    void traceEvenlySpaced(const FieldSurface &parent, const Trace_Mode trace_state, int field, int seedFace, double dsep, double dtest, int steps);
 
     // delete all traces
     void clear();
@@ -80,7 +99,8 @@ public:
 
     void popLastCurve();
 
-    void rationalizeTraces(double maxcurvature, double extenddist, double seglen, double minlen);
+    // Reports to progress between its sub-stages; if it is cancelled, stops with no rationalized traces
+    void rationalizeTraces(double maxcurvature, double extenddist, double seglen, double minlen, SolverProgress *progress = NULL);
 
     // converts a trace to a set of points and normals; does *not* do any cleanup (just converts segments as-they-are)
     void renderTrace(int traceid, std::vector<Eigen::Vector3d> &verts, std::vector<Eigen::Vector3d> &normals) const;
@@ -88,35 +108,47 @@ public:
     void collisionPoint(int collision, Eigen::Vector3d &pt0, Eigen::Vector3d &pt1) const;
 
     void exportRodFile(const char*filename, int colorGroupSize);
+    void exportBinaryRodFile(const char *filename, int colorGroupSize);
+    // the rationalized traces and their collisions as rods; segments are grouped into materials by origface / colorGroupSize
+    void rodFile(int colorGroupSize, RodFile &rods) const;
     void exportForRendering(const char *filename);
+    void exportForRendering(CsvWriter &csv) const;
     void exportTraces(const char *filename);
+    void exportTraces(CsvWriter &csv) const;
+
+    // saves the traces lying on any of surfaces in the compact TraceStore format, with float32 barycentrics if singlePrecision
+    bool saveTraces(const char *filename, const std::vector<const FieldSurface *> &surfaces, bool singlePrecision) const;
+    // appends the traces of a file written by saveTraces. Every surface in the file must match one of surfaces.
+    bool loadTraces(const char *filename, const std::vector<const FieldSurface *> &surfaces);
 
 private:
-    void findTraceStart(const FieldSurface &parent,
-        int curr_face_id,
-        const Eigen::Vector3d startpoint,
-        const Eigen::Vector3d curr_dir, int &startEdge, double &startBery);
-
-    void getNextTracePoint(const FieldSurface &parent,
-        int curr_face_id,
-        int curr_edge_id,
-        double curr_bary,
-        const Eigen::Vector3d curr_dir,
-        int &next_edge_id,
-        double &next_bary,
-        int &opp_face_id,
-        int &opp_edge_id) const;
+    // integrates a curve from the centroid of faceId for at most steps faces, stopping early if stop returns true for the
+    // endpoint of the next segment
+    void integrateTrace(const FieldSurface &parent, const Trace_Mode trace_state,
+        int traceIdx, int sign, int faceId, int steps, Trace &t,
+        const std::function<bool(const Eigen::Vector3d &)> &stop = std::function<bool(const Eigen::Vector3d &)>()) const;
 
     void findCurvedVerts(const Trace &tr, double maxcurvature, std::set<int> &badverts) const;
-    void splitTrace(const Trace &tr, const std::set<int> &badvverts, std::vector<Trace> &splittr) const;
+    // cuts a trace at the given vertices into segment index ranges [first, second)
+    void splitTrace(const Trace &tr, const std::set<int> &badverts, std::vector<std::pair<int, int> > &pieces) const;
     // attempts to extend a trace in both directions by the given distance. Returns the amount it actually succeeded in extending (could be smaller or larger)
     void extendTrace(Trace &tr, double extbeginning, double extend, double &actualextbeginning, double &actualextend) const;
-
-    double arclength(const Trace &tr) const;
-    void sampleTrace(const Trace &tr, double start, double end, int nsegs, RationalizedTrace &rattrace, std::vector<double> &samples);
-    void findPointOnTrace(const Trace &tr, double s, int &seg, double &bary);
-    void computeIntersections(const Trace &tr1, const Trace &tr2, bool selfcollision,
-        std::vector<TraceCollision> &collisions) const;
+    // walks a geodesic on from where a trace leaves face through side exitEdge at exitBary, heading along dir (in face's
+    // barycentric frame), until at least length is covered. Appends the segments in walking order; returns the length covered
+    double walkGeodesic(const FieldSurface &parent, int face, int exitEdge, double exitBary, Eigen::Vector2d dir,
+        double length, std::vector<TraceSegment> &segs) const;
+
+    // length of segments [begin, end) of the trace
+    double arclength(const Trace &tr, int begin, int end) const;
+    // prefix sums of segment lengths: svals[i] is the arclength at the start of segment i, svals[nsegs] the total length
+    void arclengths(const Trace &tr, std::vector<double> &svals) const;
+    // svals are the trace's arclengths()
+    void sampleTrace(const Trace &tr, const std::vector<double> &svals, double start, double end, int nsegs, RationalizedTrace &rattrace, std::vector<double> &samples) const;
+    // locates arclength s on the trace by binary search in its arclengths() svals
+    void findPointOnTrace(const Trace &tr, const std::vector<double> &svals, double s, int &seg, double &bary) const;
+    // finds all crossings between (and within) the given traces; cols[(i,j)], i <= j, lists the crossings of traces i and j
+    void findCollisions(const std::vector<Trace> &traces,
+        std::map<std::pair<int, int>, std::vector<TraceCollision> > &cols) const;
 
     Eigen::Vector3d pointFromBary(const FieldSurface &parent, int faceId, int faceEdge, double bary) const;
 
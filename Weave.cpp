@@ -1,7 +1,7 @@
 #include "Weave.h"
 
 #include <math.h>
-#include <igl/read_triangle_mesh.h>
+#include "MeshCache.h"
 #include <map>
 #include <Eigen/Dense>
 #include <Eigen/Sparse>
@@ -20,16 +20,17 @@
 #include "RoSyUtils.h"
 #include <Eigen/Geometry>
 #include "Permutations.h"
+#include "Profiler.h"
 
 Weave::Weave(const std::string &objname, int m)
 {
     Eigen::MatrixXd Vtmp;
     Eigen::MatrixXi Ftmp;
-    if (!igl::read_triangle_mesh(objname, Vtmp, Ftmp))
+    if (!loadTriangleMesh(objname, Vtmp, Ftmp))
     {    
         std::cerr << "Couldn't load mesh " << objname << std::endl;
         std::string modname = igl::file_dialog_open();
-        if (!igl::read_triangle_mesh(modname, Vtmp, Ftmp))
+        if (!loadTriangleMesh(modname, Vtmp, Ftmp))
         {
             std::cerr << "Couldn't load mesh " << modname << " either" << std::endl;
             exit(-1);
@@ -686,6 +687,7 @@ void Weave::createVisualizationCuts(Eigen::MatrixXd &cutPts1, Eigen::MatrixXd &c
 
 CoverMesh *Weave::createCover(const std::vector<std::pair<int, int> > &singularities) const
 {
+    PROFILE_SCOPE("Weave::createCover");
     int nCover = fs->nFields() * 2;
     int nfaces = fs->nFaces();
     int nverts = fs->nVerts();
@@ -853,6 +855,7 @@ CoverMesh *Weave::createCover(const std::vector<std::pair<int, int> > &singulari
             }
         }
     }
+    profileCounter("cover mesh bytes", ret->fs->dataBytes() + ret->splitMesh().dataBytes());
     return ret;
 }
 
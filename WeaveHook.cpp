@@ -2,20 +2,14 @@
 #include "GaussNewton.h"
 #include "LinearSolver.h"
 #include <iostream>
-#include "Permutations.h"
 #include <igl/opengl/glfw/imgui/ImGuiHelpers.h>
 #include "Surface.h"
 #include "CoverMesh.h"
-#include "CurlLocalIntegration.h"
-#include "SpectralLocalIntegration.h"
-#include "MIGlobalIntegration.h"
-#include "GNGlobalIntegration.h"
-#include <igl/decimate.h>
-#include <igl/upsample.h>
+#include "RodFile.h"
 #include <igl/hsv_to_rgb.h>
 #include <igl/local_basis.h>
 #include <random>
-#include <chrono>
+#include <algorithm>
 
 using namespace std;
 
@@ -92,7 +86,7 @@ void WeaveHook::drawGUI(igl::opengl::glfw::imgui::ImGuiMenu &menu)
                 needsrender |= ImGui::Checkbox("Normalize Vectors", &normalizeVectors);
                 ImGui::Checkbox("Wireframe", &wireframe);
                 ImGui::InputDouble("Handle Scale", &params.handleScale);
-                ImGui::Combo("Shading", (int *)&weave_shading_state, "None\0F1 Energy\0F2 Energy\0F3 Energy\0Total Energy\0Connection\0\0");
+                needsrender |= ImGui::Combo("Shading", (int *)&weave_shading_state, "None\0F1 Energy\0F2 Energy\0F3 Energy\0Total Energy\0Connection\0\0");
                 if (ImGui::Button("Normalize Fields", ImVec2(-1, 0)))
                     normalizeFields();
                 ImGui::Checkbox("Fix Fields", &weave->fixFields);
@@ -206,6 +200,12 @@ void WeaveHook::drawGUI(igl::opengl::glfw::imgui::ImGuiMenu &menu)
                         computeRandomTraces(numRandomTraces);
                     }
                     ImGui::InputInt("Number of Them", &numRandomTraces);
+                    ImGui::InputInt("Random Seed", &randomTraceSeed);
+                    if (ImGui::Button("Draw Evenly Spaced Traces", ImVec2(-1, 0)))
+                    {
+                        computeEvenlySpacedTraces();
+                    }
+                    ImGui::InputDouble("Trace Separation", &traceSeparation);
                     
                     if (ImGui::Button("Delete Last Trace", ImVec2(-1, 0)))
                     {
@@ -215,6 +215,16 @@ void WeaveHook::drawGUI(igl::opengl::glfw::imgui::ImGuiMenu &menu)
                     {
                         clearTraces();
                     }                
+                    ImGui::InputText("Trace Filename", traceFilename);
+                    ImGui::Checkbox("Float32 Barycentrics", &singlePrecisionTraces);
+                    if (ImGui::Button("Save Traces", ImVec2(-1, 0)))
+                    {
+                        saveTraces();
+                    }
+                    if (ImGui::Button("Load Traces", ImVec2(-1, 0)))
+                    {
+                        loadTraces();
+                    }
                 }
                 if (ImGui::CollapsingHeader("Rods", ImGuiTreeNodeFlags_DefaultOpen))
                 {
@@ -233,10 +243,15 @@ void WeaveHook::drawGUI(igl::opengl::glfw::imgui::ImGuiMenu &menu)
                         updateRenderGeometry();
                     }
                     ImGui::InputText("Rod Filename", rodFilename);
+                    ImGui::Checkbox("Binary Rod File", &binaryRods);
                     if (ImGui::Button("Save To Rod File", ImVec2(-1, 0)))
                     {
                         saveRods();
                     }
+                    if (ImGui::Button("Convert Binary Rod File To Text", ImVec2(-1, 0)))
+                    {
+                        convertRodFile();
+                    }
                 }
                 ImGui::End();
             };
@@ -248,7 +263,7 @@ void WeaveHook::drawGUI(igl::opengl::glfw::imgui::ImGuiMenu &menu)
                 bool needsrender = false;
                 needsrender |= ImGui::InputDouble("Vector Scale", &vectorScale);
                 needsrender |= ImGui::Checkbox("Hide Vectors", &hideCoverVectors);
-                ImGui::Combo("Shading", (int *)&cover_shading_state, "None\0S Value\0Theta Value\0Connection\0Theta Grad Error\0");
+                needsrender |= ImGui::Combo("Shading", (int *)&cover_shading_state, "None\0S Value\0Theta Value\0Connection\0Theta Grad Error\0");
                 ImGui::Checkbox("Show Cuts", &showCoverCuts);
 
                 if (needsrender)
@@ -269,6 +284,7 @@ void WeaveHook::drawGUI(igl::opengl::glfw::imgui::ImGuiMenu &menu)
                 {
                     ImGui::InputInt("Alternations", &globalAlternations);                
                     ImGui::InputInt("Power Iterations", &globalPowerIters);
+                    ImGui::InputDouble("Convergence Tol", &globalConvergenceTol);
                 }
                 else if (global_field_integration_method == GFI_MI)
                 {
@@ -278,6 +294,23 @@ void WeaveHook::drawGUI(igl::opengl::glfw::imgui::ImGuiMenu &menu)
                 if (ImGui::Button("Compute Function Value", ImVec2(-1, 0)))
                     computeFunc();
                 ImGui::InputInt("Num Isolines", &numISOLines);
+                if (ImGui::CollapsingHeader("CoMISo Options"))
+                {
+                    ImGui::InputDouble("CoMISo Regularization", &comisoParams.reg);
+                    ImGui::Checkbox("Direct Rounding", &comisoParams.directRounding);
+                    ImGui::Checkbox("Multiple Rounding", &comisoParams.multipleRounding);
+                    ImGui::InputDouble("Rounding Threshold", &comisoParams.multipleRoundingThreshold);
+                    int localIters = comisoParams.localIters;
+                    if (ImGui::InputInt("Local Iterations", &localIters))
+                        comisoParams.localIters = std::max(0, localIters);
+                    ImGui::InputDouble("Local Error", &comisoParams.localError);
+                    int cgIters = comisoParams.cgIters;
+                    if (ImGui::InputInt("CG Iterations", &cgIters))
+                        comisoParams.cgIters = std::max(0, cgIters);
+                    ImGui::InputDouble("CG Error", &comisoParams.cgError);
+                    ImGui::Checkbox("Final Full Solve", &comisoParams.finalFull);
+                    ImGui::Checkbox("Verbose", &comisoParams.verbose);
+                }
                 if (ImGui::Button("Round Antipodal Covers", ImVec2(-1, 0)))
                     roundCovers();
                 if (ImGui::Button("Draw Isolines", ImVec2(-1, 0)))
@@ -289,21 +322,26 @@ void WeaveHook::drawGUI(igl::opengl::glfw::imgui::ImGuiMenu &menu)
     }
     
     ImGui::InputText("Export Prefix", exportPrefix);            
+    ImGui::InputText("Checkpoint Dir", checkpointDir);
     if (ImGui::Button("Export Everything", ImVec2(-1,0)))
         exportForRendering();
 }
 
 bool WeaveHook::mouseClicked(igl::opengl::glfw::Viewer &viewer, int button)
 {
-    if (gui_mode != GUIMode_Enum::WEAVE)
+    std::shared_ptr<const WeaveRenderSnapshot> snap = renderSnapshots.latest();
+    if (gui_mode != GUIMode_Enum::WEAVE || !snap)
         return false;
+    // pick on the mesh being displayed, which the simulation thread never modifies
+    const Eigen::MatrixXd &V = snap->renderQWeave;
+    const Eigen::MatrixXi &F = snap->renderFWeave;
     int fid;
     Eigen::Vector3f bc;
     // Cast a ray in the view direction starting from the mouse position
     double x = viewer.current_mouse_x;
     double y = viewer.core().viewport(3) - viewer.current_mouse_y;
     if (igl::unproject_onto_mesh(Eigen::Vector2f(x, y), viewer.core().view,
-        viewer.core().proj, viewer.core().viewport, this->weave->fs->data().V, this->weave->fs->data().F, fid, bc))
+        viewer.core().proj, viewer.core().viewport, V, F, fid, bc))
     {
         std::cout << fid << " - clicked on vertex #\n"; 
         bool found = false;
@@ -326,8 +364,9 @@ bool WeaveHook::mouseClicked(igl::opengl::glfw::Viewer &viewer, int button)
         renderSelectedVertices.clear();
         for (int i = 0; i < (int)selectedVertices.size(); i++)
         {
-            renderSelectedVertices.push_back(weave->fs->data().V.row(weave->fs->data().F(selectedVertices[i].first, selectedVertices[i].second)));
+            renderSelectedVertices.push_back(V.row(F(selectedVertices[i].first, selectedVertices[i].second)));
         }
+        selectionVersion++;
         return true;
     }
     return false;
@@ -337,77 +376,22 @@ bool WeaveHook::mouseClicked(igl::opengl::glfw::Viewer &viewer, int button)
 
 void WeaveHook::clear()
 {
-    if (cover)
-        delete cover;
-    cover = NULL;
+    WeavePipeline::clear();
     gui_mode = GUIMode_Enum::WEAVE;
-    ls.clearHandles();
-    
-    for (int i = 0; i < fieldCount; i++)
-    {
-        Handle h;
-        h.face = 0;
-        Eigen::Vector3d handleVec(sin( ( 2 * 3.1415 * i) / fieldCount), cos( ( 2 * 3.1415 * i) / fieldCount), 0);
-        
-        Eigen::Matrix<double, 3, 2> B = weave->fs->data().Bs[h.face];
-        Eigen::Matrix<double, 2, 3> toBarys = (B.transpose()*B).inverse() * B.transpose();
-
-        h.dir = toBarys * handleVec;
-        h.field = i;
-        ls.addHandle(h);
-    }
-    weave->handles = ls.handles;
 
-    curFaceEnergies = Eigen::MatrixXd::Zero(3, 3);
     selectedVertices.clear();
     renderSelectedVertices.clear();
-    params.edgeWeights = Eigen::VectorXd::Constant(weave->fs->nEdges(), 1);    
-    
-    singularVerts_topo.resize(0,3);
-    singularVerts_geo.resize(0,3);
-    nonIdentity1Weave.resize(0,3);
-    nonIdentity2Weave.resize(0,3);
-    cutPos1Weave.resize(0,3);
-    cutPos2Weave.resize(0,3);
-
-    weave->fixFields = false;    
-    pathstarts.resize(0,3);
-    pathends.resize(0,3);
-
-    traces.clear();
+    selectionVersion++;
 }
 
 void WeaveHook::initSimulation()
 {
-    if (weave)
-        delete weave;
-    weave = new Weave(meshName, fieldCount);    
-    rosyN = 0;
-    clear();    
+    loadMesh();
 }
 
 void WeaveHook::resample()
 {
-    Eigen::MatrixXd Vcurr = weave->fs->data().V;
-    Eigen::MatrixXi Fcurr  = weave->fs->data().F;
-    while ( Fcurr.rows() < targetResolution * 2)
-    {
-        Eigen::MatrixXd Vtmp = Vcurr;
-        Eigen::MatrixXi Ftmp = Fcurr;
-        igl::upsample(Vtmp, Ftmp, Vcurr, Fcurr);
-    }
-    Eigen::MatrixXd V;
-    Eigen::MatrixXi F;
-    Eigen::VectorXi J;
-    
-    igl::decimate(Vcurr, Fcurr, targetResolution, V, F, J);
-    igl::writeOBJ("resampled.obj",V,F);
-    
-    delete weave;
-    
-    weave = new Weave(V, F, fieldCount); 
-    clear();  
-
+    WeavePipeline::resample();
     // Hacky... 
     updateRenderGeometry();
 }
@@ -455,15 +439,15 @@ void WeaveHook::removeHandle()
     updateRenderGeometry();
 }
 
-void WeaveHook::setFaceColorsCover(igl::opengl::glfw::Viewer &viewer)
+void WeaveHook::setFaceColorsCover(igl::opengl::glfw::Viewer &viewer, const WeaveRenderSnapshot &snap)
 {
-    int faces = cover->fs->data().F.rows();
+    int faces = snap.renderFCover.rows();
     
     igl::ColorMapType viz_color = igl::COLOR_MAP_TYPE_MAGMA;
 
-    int nsplitverts = cover->splitMesh().nVerts();
+    int nsplitverts = snap.renderQCover.rows();
 
-    Eigen::MatrixXd faceColors(cover->fs->nFaces(), 3);
+    Eigen::MatrixXd faceColors(faces, 3);
     Eigen::MatrixXd vertColors(nsplitverts, 3);
 
     switch (cover_shading_state) 
@@ -473,7 +457,7 @@ void WeaveHook::setFaceColorsCover(igl::opengl::glfw::Viewer &viewer)
             const double PI = 3.1415926535898;
             for (int i = 0; i < nsplitverts; i++)
             {            
-                double theta = cover->theta[cover->visMeshToCoverMesh(i)];            
+                double theta = snap.thetaCover[i];
                 // as HSV: [ 360 * (theta+pi) / 2 pi, 1.0, 0.5 ]
                 double H = 360.0 * (theta + PI) / (2.0 * PI);
                 igl::hsv_to_rgb(H, 1.0, 0.5, vertColors(i,0), vertColors(i,1), vertColors(i,2));
@@ -482,21 +466,27 @@ void WeaveHook::setFaceColorsCover(igl::opengl::glfw::Viewer &viewer)
         }
         case CS_S_VAL:
         {
-            igl::colormap(viz_color, cover->scales, true, faceColors);        
+            igl::colormap(viz_color, snap.scalesCover, true, faceColors);        
             break;
         }
         case CS_CONNECTION_ENERGY:
         {
-            Eigen::VectorXd Z(faces);
-            cover->fs->connectionEnergy(Z, 0., params);
-            igl::colormap(viz_color, Z, true, faceColors);   
+            if (snap.connectionEnergyCover.size() != faces)
+            {
+                faceColors.setConstant(0.7);
+                break;
+            }
+            igl::colormap(viz_color, snap.connectionEnergyCover, true, faceColors);   
             break;     
         }
         case CS_GRAD_DEVIATION:
         {
-            Eigen::VectorXd Z(faces);
-            cover->gradThetaDeviation(Z);
-            igl::colormap(viz_color, Z, false, faceColors);
+            if (snap.gradDeviationCover.size() != faces)
+            {
+                faceColors.setConstant(0.7);
+                break;
+            }
+            igl::colormap(viz_color, snap.gradDeviationCover, false, faceColors);
             break;
         }
         case CS_NONE:
@@ -508,9 +498,9 @@ void WeaveHook::setFaceColorsCover(igl::opengl::glfw::Viewer &viewer)
     }
     
     // fade deleted faces
-    for(int i=0; i<cover->fs->nFaces(); i++)
+    for(int i=0; i<faces; i++)
     {
-        if(cover->fs->isFaceDeleted(i))
+        if(snap.deletedFacesCover[i])
         {
             faceColors(i,0) = 0.5 + 0.5 * faceColors(i,0);
             faceColors(i,1) *= 0.5;
@@ -519,7 +509,7 @@ void WeaveHook::setFaceColorsCover(igl::opengl::glfw::Viewer &viewer)
     }
     
     const Eigen::RowVector3d green(.1,.9,.1);
-    viewer.data().add_edges( pathstarts, pathends, green);
+    viewer.data().add_edges( snap.pathstarts, snap.pathends, green);
     
     if(cover_shading_state == FUN_VAL)
     {
@@ -533,9 +523,9 @@ void WeaveHook::setFaceColorsCover(igl::opengl::glfw::Viewer &viewer)
     }
 }
 
-void WeaveHook::setFaceColorsWeave(igl::opengl::glfw::Viewer &viewer)
+void WeaveHook::setFaceColorsWeave(igl::opengl::glfw::Viewer &viewer, const WeaveRenderSnapshot &snap)
 {
-    int faces = weave->fs->data().F.rows();
+    int faces = snap.renderFWeave.rows();
     // if ( curFaceEnergies.rows() != faces && shading_state != NONE) { return ; }
     // cout << "fuck" << endl;
 
@@ -543,6 +533,7 @@ void WeaveHook::setFaceColorsWeave(igl::opengl::glfw::Viewer &viewer)
 
     Eigen::VectorXd Z(faces);    
 
+    const Eigen::MatrixXd &curFaceEnergies = snap.faceEnergies;
     for (int i = 0; i < faces; i++)
     {
         switch (weave_shading_state)
@@ -566,14 +557,14 @@ void WeaveHook::setFaceColorsWeave(igl::opengl::glfw::Viewer &viewer)
         }
     }
 
-    if (weave_shading_state == WS_CONNECTION_ENERGY)
+    if (weave_shading_state == WS_CONNECTION_ENERGY && snap.connectionEnergyWeave.size() == faces)
     {
-        weave->fs->connectionEnergy(Z, params.curlreg, params); // TODO make real var
+        Z = snap.connectionEnergyWeave;
     }
 
     viewer.data().set_face_based(true);
    
-    Eigen::MatrixXd faceColors(weave->fs->nFaces(), 3);
+    Eigen::MatrixXd faceColors(faces, 3);
 
     switch (weave_shading_state)
     {
@@ -589,9 +580,9 @@ void WeaveHook::setFaceColorsWeave(igl::opengl::glfw::Viewer &viewer)
     }
 
     // fade deleted faces
-    for(int i=0; i<weave->fs->nFaces(); i++)
+    for(int i=0; i<faces; i++)
     {
-        if(weave->fs->isFaceDeleted(i))
+        if(snap.deletedFacesWeave[i])
         {
             faceColors(i,0) = 0.5 + 0.5 * faceColors(i,0);
             faceColors(i,1) *= 0.5;
@@ -617,28 +608,28 @@ void WeaveHook::showCutVertexSelection(igl::opengl::glfw::Viewer &viewer)
     
 }
 
-void WeaveHook::drawCuts(igl::opengl::glfw::Viewer &viewer)
+void WeaveHook::drawCuts(igl::opengl::glfw::Viewer &viewer, const WeaveRenderSnapshot &snap)
 {
     if (gui_mode == GUIMode_Enum::WEAVE)
     {
         Eigen::RowVector3d blue(.1, .1, 0.9);
         Eigen::RowVector3d purple(0.9, .1, .9);
-        Eigen::MatrixXd C1(cutPos1Weave.rows(), 3);
+        Eigen::MatrixXd C1(snap.cutPos1Weave.rows(), 3);
         for (int i = 0; i < 3; i++)
             C1.col(i).setConstant(blue[i]);
-        viewer.data().add_edges(cutPos1Weave, cutPos2Weave, C1);
-        Eigen::MatrixXd C2(nonIdentity1Weave.rows(), 3);
+        viewer.data().add_edges(snap.cutPos1Weave, snap.cutPos2Weave, C1);
+        Eigen::MatrixXd C2(snap.nonIdentity1Weave.rows(), 3);
         for(int i=0; i<3; i++)
             C2.col(i).setConstant(purple[i]);
-        viewer.data().add_edges(nonIdentity1Weave, nonIdentity2Weave, C2);
+        viewer.data().add_edges(snap.nonIdentity1Weave, snap.nonIdentity2Weave, C2);
     }
     else if (gui_mode == GUIMode_Enum::COVER)
     {
         Eigen::RowVector3d blue(0.9, .1, .9);
-        Eigen::MatrixXd C(cutPos1Cover.rows(), 3);
+        Eigen::MatrixXd C(snap.cutPos1Cover.rows(), 3);
         for (int i = 0; i < 3; i++)
             C.col(i).setConstant(blue[i]);
-        viewer.data().add_edges(cutPos1Cover, cutPos2Cover, cutColorsCover);
+        viewer.data().add_edges(snap.cutPos1Cover, snap.cutPos2Cover, snap.cutColorsCover);
     }
 }
 
@@ -654,9 +645,30 @@ void WeaveHook::clearTraces()
     updateRenderGeometry();
 }
 
+// traces can lie on the weave's surface or the cover's
+static std::vector<const FieldSurface *> traceSurfaces(const Weave *weave, const CoverMesh *cover)
+{
+    std::vector<const FieldSurface *> surfaces;
+    surfaces.push_back(weave->fs);
+    if (cover)
+        surfaces.push_back(cover->fs);
+    return surfaces;
+}
+
+void WeaveHook::saveTraces()
+{
+    traces.saveTraces(traceFilename.c_str(), traceSurfaces(weave, cover), singlePrecisionTraces);
+}
+
+void WeaveHook::loadTraces()
+{
+    if (traces.loadTraces(traceFilename.c_str(), traceSurfaces(weave, cover)))
+        updateRenderGeometry();
+}
+
 void WeaveHook::rationalizeTraces()
 {
-    traces.rationalizeTraces(maxCurvature, extendTrace, segLen, minRodLen);
+    WeavePipeline::rationalizeTraces();
     updateRenderGeometry();
 }
 
@@ -677,18 +689,19 @@ void WeaveHook::computeRandomTraces(int numtraces)
     int nfields = weave->fs->nFields();
     
     std::default_random_engine generator;
-    generator.seed(std::chrono::system_clock::now().time_since_epoch().count());
+    generator.seed(randomTraceSeed);
     std::uniform_int_distribution<int> facedistribution(0,nfaces-1);
     std::uniform_int_distribution<int> fielddistribution(0,nfields-1);
     std::uniform_int_distribution<int> dirdistribution(0, 1);
     
+    std::vector<TraceSeed> seeds(numtraces);
     for (int i = 0; i < numtraces; i++)
     {
-        int face = facedistribution(generator);
-        int field = fielddistribution(generator);
-        int dir = 2*dirdistribution(generator) - 1;
-        traces.traceCurve(*weave->fs, trace_state, field, dir, face, traceSteps);
+        seeds[i].face = facedistribution(generator);
+        seeds[i].field = fielddistribution(generator);
+        seeds[i].sign = 2*dirdistribution(generator) - 1;
     }
+    traces.traceCurves(*weave->fs, trace_state, seeds, traceSteps);
 
     std::string tracename = exportPrefix + std::string("_rand_traces.csv");    
     traces.exportTraces(tracename.c_str());
@@ -698,42 +711,77 @@ void WeaveHook::computeRandomTraces(int numtraces)
     updateRenderGeometry();
 }
 
-void WeaveHook::updateSingularVerts(igl::opengl::glfw::Viewer &viewer)
+void WeaveHook::computeEvenlySpacedTraces()
+{
+    double dsep = traceSeparation * weave->fs->data().averageEdgeLength;
+    int nfields = weave->fs->nFields();
+    for (int i = 0; i < nfields; i++)
+    {
+        traces.traceEvenlySpaced(*weave->fs, trace_state, i, traceFaceId, dsep, 0.5 * dsep, traceSteps);
+    }
+    updateRenderGeometry();
+}
+
+void WeaveHook::updateSingularVerts(igl::opengl::glfw::Viewer &viewer, const WeaveRenderSnapshot &snap)
 {
     Eigen::RowVector3d green(.1, .9, .1);
     Eigen::RowVector3d blue(.1, .1, .9);
-    viewer.data().add_points( singularVerts_topo, green ); 
+    viewer.data().add_points( snap.singularVerts_topo, green ); 
+}
+
+WeaveRenderSettings WeaveHook::renderSettings() const
+{
+    WeaveRenderSettings settings;
+    settings.gui_mode = gui_mode;
+    settings.weave_shading_state = weave_shading_state;
+    settings.cover_shading_state = cover_shading_state;
+    settings.showTraces = showTraces;
+    settings.showRatTraces = showRatTraces;
+    settings.showCoverCuts = showCoverCuts;
+    settings.wireframe = wireframe;
+    settings.selectionVersion = selectionVersion;
+    return settings;
 }
 
 void WeaveHook::renderRenderGeometry(igl::opengl::glfw::Viewer &viewer)
 {
+    // the viewer keeps drawing what was uploaded last; only re-upload when there is something new to show
+    std::shared_ptr<const WeaveRenderSnapshot> snap = renderSnapshots.latest();
+    if (!snap)
+        return;
+    WeaveRenderSettings settings = renderSettings();
+    if (snap->version == uploadedVersion && settings == uploadedSettings)
+        return;
+    uploadedVersion = snap->version;
+    uploadedSettings = settings;
+
     viewer.data().clear();
 
     if (gui_mode == GUIMode_Enum::WEAVE)
     {
-        viewer.data().set_mesh(renderQWeave, renderFWeave);
-        viewer.data().set_edges(edgePtsWeave, edgeSegsWeave, edgeColorsWeave);
-        setFaceColorsWeave(viewer);
+        viewer.data().set_mesh(snap->renderQWeave, snap->renderFWeave);
+        viewer.data().set_edges(snap->edgePtsWeave, snap->edgeSegsWeave, snap->edgeColorsWeave);
+        setFaceColorsWeave(viewer, *snap);
         if(showTraces)
-            viewer.data().add_edges( tracestarts, traceends, tracecolors );
+            viewer.data().add_edges( snap->tracestarts, snap->traceends, snap->tracecolors );
         Eigen::RowVector3d orange(0.9, 0.9, 0.1);
         Eigen::RowVector3d red(0.9, 0.1, 0.1);
         if (showRatTraces)
         {
-            viewer.data().add_edges(rattracestarts, rattraceends, orange);
-      //      viewer.data().add_points(ratcollisions, red);
+            viewer.data().add_edges(snap->rattracestarts, snap->rattraceends, orange);
+      //      viewer.data().add_points(snap->ratcollisions, red);
         }
 
-        updateSingularVerts(viewer);
-        drawCuts(viewer);
+        updateSingularVerts(viewer, *snap);
+        drawCuts(viewer, *snap);
     }
     else if (gui_mode == GUIMode_Enum::COVER)
     {
-        viewer.data().set_mesh(renderQCover, renderFCover);        
-        viewer.data().set_edges(edgePtsCover, edgeSegsCover, edgeColorsCover);
-        setFaceColorsCover(viewer);
+        viewer.data().set_mesh(snap->renderQCover, snap->renderFCover);        
+        viewer.data().set_edges(snap->edgePtsCover, snap->edgeSegsCover, snap->edgeColorsCover);
+        setFaceColorsCover(viewer, *snap);
         if(showCoverCuts)
-            drawCuts(viewer);
+            drawCuts(viewer, *snap);
     }
 
     viewer.data().show_faces = !wireframe;
@@ -741,111 +789,10 @@ void WeaveHook::renderRenderGeometry(igl::opengl::glfw::Viewer &viewer)
 
 bool WeaveHook::simulateOneStep()
 {
-    params.edgeWeights.resize(weave->fs->nEdges());
-    params.edgeWeights.setConstant(1.0);
-    for (int i = 0; i < (int)weave->cuts.size(); i++)
-    {
-        for (int j = 0; j < (int)weave->cuts[i].path.size(); j++)
-        {
-            params.edgeWeights[weave->cuts[i].path[j].first] = 0.0;
-        }
-    }
-    params.rosyN = rosyN; // make this the same...
-
-    int nfaces = weave->fs->data().F.rows();
-    int nfields = weave->fs->nFields();
-
-    if ( solver_mode == Solver_Enum::CURLFREE )
-    {
-        Eigen::VectorXd primal = weave->fs->vectorFields.segment(0, 2*nfaces*nfields);
-        Eigen::VectorXd dual = weave->fs->vectorFields.segment(2*nfaces*nfields, 2*nfaces*nfields);
-
-        const int numDesignIters = 10;
-        ls.takeSomeSteps(*weave, params, primal, dual, rosyN != 0, numDesignIters);
-
-        weave->fs->vectorFields.segment(0, 2*nfaces*nfields) = primal;
-        weave->fs->vectorFields.segment(2*nfaces*nfields, 2*nfaces*nfields) = dual;
-
-
- //       std::cout << primal.transpose()<< std::endl << primal.norm() << std::endl<< std::endl;
-  //      std::cout << dual.transpose() << std::endl <<dual.norm() << std::endl<< std::endl;
-        std::cout << "primal norm " << primal.norm() << " dual norm " <<dual.norm() <<  std::endl;
-    }
-    else 
-    {
-        Eigen::VectorXd curField = weave->fs->vectorFields.segment(0, 2*nfaces*nfields);
-        weave->fs->vectorFields.setZero();
-        weave->fs->vectorFields.segment(0, 2*nfaces*nfields) = curField;
-        oneStep(*weave, params);
-        faceEnergies(*weave, params, tempFaceEnergies);
-    }
-    Eigen::VectorXd temp;
-    std::cout << "Total Geodesic Energy" << weave->fs->getGeodesicEnergy(temp, params) << std::endl;
-
-    std::cout << "ran a step" << std::endl;
+    solveStep();
     return false;
 }
 
-void WeaveHook::reassignPermutations()
-{
-   // int flipped = reassignCutPermutations(*weave);
-    int flipped = reassignAllPermutations(*weave);
-
-    std::cout << flipped << " permutations changed" << std::endl;
-    
-    std::vector<std::pair<int, int> > topsingularities;
-    std::vector<std::pair<int, int> > geosingularities;
-    findSingularVertices(*weave, topsingularities, geosingularities);
-    std::cout << "now " << topsingularities.size() << " topological and " << geosingularities.size() << " geometric singularities" << std::endl;
-
-
-    singularVerts_geo = Eigen::MatrixXd::Zero(geosingularities.size(), 3);
-    for (int i = 0; i < geosingularities.size(); i++)
-    {
-//        singularVerts_geo.row(i) = weave->V.row(geosingularities[i]);
-    }
-    singularVerts_topo = Eigen::MatrixXd::Zero(topsingularities.size(), 3);
-    for (int i = 0; i < topsingularities.size(); i++)
-    {
-        singularVerts_topo.row(i) = weave->fs->data().V.row(topsingularities[i].first);
-    }
-
-    std::vector<int> nonIdentityEdges;
-    int m = weave->fs->nFields();
-    for (int i = 0; i < weave->fs->Ps_.size(); i++)
-    {
-        bool id = true;
-        
-        for (int j = 0; j < m; j++)
-        {
-            if (weave->fs->Ps(i)(j, j) != 1)
-            {
-                id = false;
-            }
-        }
-        if (!id)
-        {
-            nonIdentityEdges.push_back(i);  // TODO: Fix viz bug!
-        }
-    }
-    int ncuts = nonIdentityEdges.size();
-    nonIdentity1Weave.resize(ncuts, 3);
-    nonIdentity2Weave.resize(ncuts, 3);
-    for(int i=0; i<ncuts; i++)
-    {
-        Eigen::Vector3d normal(0,0,0);
-        int f0 = weave->fs->data().E(nonIdentityEdges[i], 0);
-        if(f0 != -1)
-            normal += weave->fs->faceNormal(f0);
-        int f1 = weave->fs->data().E(nonIdentityEdges[i], 1);
-        if(f1 != -1)
-            normal += weave->fs->faceNormal(f1);
-        Eigen::Vector3d offset = 0.001*normal/ normal.norm();
-        nonIdentity1Weave.row(i) = weave->fs->data().V.row(weave->fs->data().edgeVerts(nonIdentityEdges[i], 0)) + offset.transpose();
-        nonIdentity2Weave.row(i) = weave->fs->data().V.row(weave->fs->data().edgeVerts(nonIdentityEdges[i], 1)) + offset.transpose();
-    }
-}
-
 void WeaveHook::normalizeFields()
 {
     weave->fs->normalizeFields();
@@ -854,146 +801,27 @@ void WeaveHook::normalizeFields()
 
 void WeaveHook::augmentField()
 {
-    if (cover)
-    {
-        traces.purgeTraces(cover->fs);
-        delete cover;
-        cover = NULL;
-    }
-
-    weave->fs->undeleteAllFaces();
-    
-    if (rosyN)
-    {
-        Weave *splitWeave = weave->splitFromRosy(rosyN);
-//        reassignAllPermutations(*splitWeave);
-
-        std::vector<std::pair<int, int> > topsingularities;
-        std::vector<std::pair<int, int> > geosingularities;
-        findSingularVertices(*splitWeave, topsingularities, geosingularities);
-
-        std::vector<std::pair<int, int> > todelete = topsingularities;
-        for (int i = 0; i < geosingularities.size(); i++)
-            todelete.push_back(geosingularities[i]);
-
-        cover = splitWeave->createCover(todelete);
-        delete splitWeave;
-    }
-    else
-    {
-        std::vector<std::pair<int, int> > topsingularities;
-        std::vector<std::pair<int, int> > geosingularities;
-        findSingularVertices(*weave, topsingularities, geosingularities);
-
-        std::vector<std::pair<int, int> > todelete = topsingularities;
-        for (int i = 0; i < geosingularities.size(); i++)
-            todelete.push_back(geosingularities[i]);
-
-        cover = weave->createCover(todelete);
-    }
+    WeavePipeline::augmentField();
     updateRenderGeometry();
     gui_mode = GUIMode_Enum::COVER;
 }
 
 void WeaveHook::computeFunc()
 {
-    if (cover)
-    {
-        LocalFieldIntegration *method;
-        if (local_field_integration_method == LFI_TRIVIAL)
-            method = new TrivialLocalIntegration();
-        else if (local_field_integration_method == LFI_CURLCORRECT)
-            method = new CurlLocalIntegration(initSReg);
-        else if(local_field_integration_method == LFI_SPECTRAL)
-            method = new SpectralLocalIntegration(initSReg);
-        else
-        {
-            assert(!"Unknown local integration method");
-            return;
-        }
-        GlobalFieldIntegration *gmethod;
-        if (global_field_integration_method == GFI_GN)
-            gmethod = new GNGlobalIntegration(globalAlternations, globalPowerIters);
-        else if(global_field_integration_method == GFI_MI)
-            gmethod = new MIGlobalIntegration(bommesAniso, globalThetaReg);
-
-        cover->integrateField(method, gmethod, globalSScale);
-        delete method;
-        delete gmethod;
-    }
+    WeavePipeline::computeFunc();
     updateRenderGeometry();
 }
 
-void WeaveHook::roundCovers()
-{
-    if (cover && numISOLines > 0)
-    {
-        cover->roundAntipodalCovers(numISOLines);
-    }
-}
-
 void WeaveHook::drawISOLines()
 {
-    if(cover)
-    {
-        traces.purgeTraces(cover->fs);
-        std::vector<Trace> newtraces;
-        cover->recomputeIsolines(numISOLines, newtraces);
-        for (auto it : newtraces)
-            traces.addTrace(it);
-    }
-
+    WeavePipeline::drawISOLines();
     updateRenderGeometry();
 }
 
-static const int magic = 0x4242;
-
-void WeaveHook::serializeVectorField(const std::string &filename)
-{
-    int currentRLXVersion = 2;
-    std::ofstream ofs(filename, ios::binary);
-    ofs.write((char *)&magic, sizeof(int));
-    ofs.write((char *)&currentRLXVersion, sizeof(int));
-    ofs.write((char *)&rosyN, sizeof(int));
-    weave->serialize(ofs);
-}
-
 void WeaveHook::deserializeVectorField()
 {
-    std::ifstream ifs(vectorFieldName, ios::binary);
-    if (!ifs)
-    {
-        std::cerr << "Cannot open vector field file: " << vectorFieldName << std::endl;
-        return;
-    }
-    clear();    
-    int header=0;
-    ifs.read((char *)&header, sizeof(int));
-    if (header != magic)
-    {
-           // old version
-        ifs.clear();
-        ifs.seekg(0);
-        rosyN = 0;
-        weave->deserialize(ifs);
-    }
-    else
-    {
-        int saveversion = 0;
-        ifs.read((char *)&saveversion, sizeof(int));
-        if (saveversion == 1)
-        {
-            char isrosyc=0;
-            ifs.read(&isrosyc, 1);
-            rosyN = (isrosyc ? 3 : 0);
-        }
-        else
-        {
-            ifs.read((char *)&rosyN, sizeof(int));
-        }
-        weave->deserialize(ifs);
-    }
-    updateRenderGeometry();
+    if (WeavePipeline::deserializeVectorField())
+        updateRenderGeometry();
 }
 
 void WeaveHook::deserializeVectorFieldOld()
@@ -1033,6 +861,7 @@ void WeaveHook::resetCutSelection()
 {
     selectedVertices.clear();
     renderSelectedVertices.clear();
+    selectionVersion++;
 }
 
 void WeaveHook::addCut()
@@ -1071,21 +900,32 @@ void WeaveHook::removePrevCut()
 
 void WeaveHook::updateRenderGeometry()
 {
-    renderQWeave = weave->fs->data().V;
-    renderFWeave = weave->fs->data().F;
+    // built from scratch every time: the render thread may still be uploading the previous snapshot
+    std::shared_ptr<WeaveRenderSnapshot> snap = std::make_shared<WeaveRenderSnapshot>();
+    snap->renderQWeave = weave->fs->data().V;
+    snap->renderFWeave = weave->fs->data().F;
     if (rosyN)
     {
-        weave->createVisualizationEdges(edgePtsWeave, edgeSegsWeave, edgeColorsWeave,
+        weave->createVisualizationEdges(snap->edgePtsWeave, snap->edgeSegsWeave, snap->edgeColorsWeave,
             rosyVisMode, normalizeVectors, vectorScale, rosyN);
     }
     else
     {
-        weave->createVisualizationEdges(edgePtsWeave, edgeSegsWeave, edgeColorsWeave,
+        weave->createVisualizationEdges(snap->edgePtsWeave, snap->edgeSegsWeave, snap->edgeColorsWeave,
             vectorVisMode, normalizeVectors, vectorScale);
     }
    
-    weave->createVisualizationCuts(cutPos1Weave, cutPos2Weave);
-    curFaceEnergies = tempFaceEnergies;
+    weave->createVisualizationCuts(snap->cutPos1Weave, snap->cutPos2Weave);
+    snap->faceEnergies = tempFaceEnergies;
+    snap->nonIdentity1Weave = nonIdentity1Weave;
+    snap->nonIdentity2Weave = nonIdentity2Weave;
+    snap->singularVerts_topo = singularVerts_topo;
+    // only computed for the shading that shows it; picking that shading rebuilds the snapshot
+    if (weave_shading_state == WS_CONNECTION_ENERGY)
+        weave->fs->connectionEnergy(snap->connectionEnergyWeave, params.curlreg, params); // TODO make real var
+    snap->deletedFacesWeave.resize(weave->fs->nFaces());
+    for (int i = 0; i < weave->fs->nFaces(); i++)
+        snap->deletedFacesWeave[i] = weave->fs->isFaceDeleted(i);
 
     // TODO: refactor, just used for rendering 
     weave->handles = ls.handles;
@@ -1095,9 +935,9 @@ void WeaveHook::updateRenderGeometry()
     {
         tracesegs += traces.trace(i).segs.size();
     }
-    tracestarts.resize(tracesegs, 3);
-    traceends.resize(tracesegs, 3);
-    tracecolors.resize(tracesegs, 3);
+    snap->tracestarts.resize(tracesegs, 3);
+    snap->traceends.resize(tracesegs, 3);
+    snap->tracecolors.resize(tracesegs, 3);
     Eigen::RowVector3d red(0.9, .1, .1), green(.1, .9, .1);
 
     int tridx = 0;
@@ -1109,16 +949,16 @@ void WeaveHook::updateRenderGeometry()
         traces.renderTrace(i, verts, normals);
         for (int j = 0; j < nsegs; j++)
         {
-            tracestarts.row(tridx) = verts[j].transpose() + 0.0001*normals[j].transpose();
-            traceends.row(tridx) = verts[j + 1].transpose() + 0.0001*normals[j].transpose();
+            snap->tracestarts.row(tridx) = verts[j].transpose() + 0.0001*normals[j].transpose();
+            snap->traceends.row(tridx) = verts[j + 1].transpose() + 0.0001*normals[j].transpose();
 
             switch (traces.trace(i).type_)
             {
             case GEODESIC:
-                tracecolors.row(tridx) = red;
+                snap->tracecolors.row(tridx) = red;
                 break;
             case FIELD:
-                tracecolors.row(tridx) = green;
+                snap->tracecolors.row(tridx) = green;
                 break;
             }
 
@@ -1131,8 +971,8 @@ void WeaveHook::updateRenderGeometry()
     {
         rattracesegs += traces.rationalizedTrace(i).pts.rows() - 1;
     }
-    rattracestarts.resize(rattracesegs, 3);
-    rattraceends.resize(rattracesegs, 3);
+    snap->rattracestarts.resize(rattracesegs, 3);
+    snap->rattraceends.resize(rattracesegs, 3);
 
     tridx = 0;
     for (int i = 0; i < traces.nRationalizedTraces(); i++)
@@ -1141,25 +981,25 @@ void WeaveHook::updateRenderGeometry()
         for (int j = 0; j < nsegs; j++)
         {
             Eigen::Vector3d normal = traces.rationalizedTrace(i).normals.row(j);
-            rattracestarts.row(tridx) = traces.rationalizedTrace(i).pts.row(j) + 0.001*normal.transpose();
-            rattraceends.row(tridx) = traces.rationalizedTrace(i).pts.row(j+1) + 0.001*normal.transpose();
+            snap->rattracestarts.row(tridx) = traces.rationalizedTrace(i).pts.row(j) + 0.001*normal.transpose();
+            snap->rattraceends.row(tridx) = traces.rationalizedTrace(i).pts.row(j+1) + 0.001*normal.transpose();
             tridx++;
         }
     }
 
-    ratcollisions.resize(2*traces.nCollisions(), 3);
+    snap->ratcollisions.resize(2*traces.nCollisions(), 3);
     for (int i = 0; i < traces.nCollisions(); i++)
     {
         Eigen::Vector3d pt0, pt1;
         traces.collisionPoint(i, pt0, pt1);
-        ratcollisions.row(2 * i) = pt0.transpose();
-        ratcollisions.row(2 * i + 1) = pt1.transpose();
+        snap->ratcollisions.row(2 * i) = pt0.transpose();
+        snap->ratcollisions.row(2 * i + 1) = pt1.transpose();
     }
 
     if (cover)
     {
-        cover->createVisualization(renderQCover, renderFCover, edgePtsCover, edgeSegsCover, edgeColorsCover,
-            cutPos1Cover, cutPos2Cover, cutColorsCover,
+        cover->createVisualization(snap->renderQCover, snap->renderFCover, snap->edgePtsCover, snap->edgeSegsCover, snap->edgeColorsCover,
+            snap->cutPos1Cover, snap->cutPos2Cover, snap->cutColorsCover,
             hideCoverVectors, vectorScale);
 
         int totsegs = 0;
@@ -1169,8 +1009,8 @@ void WeaveHook::updateRenderGeometry()
             if (traces.trace(i).parent_ == cover->fs)
                 totsegs += traces.trace(i).segs.size();
         }
-        pathstarts.resize(totsegs, 3);
-        pathends.resize(totsegs, 3);
+        snap->pathstarts.resize(totsegs, 3);
+        snap->pathends.resize(totsegs, 3);
         int idx = 0;
         for (int j = 0; j < ntraces; j++)
         {
@@ -1182,225 +1022,82 @@ void WeaveHook::updateRenderGeometry()
             int nsegs = traces.trace(j).segs.size();
             for (int i = 0; i < nsegs; i++)
             {
-                pathstarts.row(idx) = pathstart.row(i);
-                pathends.row(idx) = pathend.row(i);
+                snap->pathstarts.row(idx) = pathstart.row(i);
+                snap->pathends.row(idx) = pathend.row(i);
                 idx++;
             }
         }
+
+        int nsplitverts = cover->splitMesh().nVerts();
+        snap->thetaCover.resize(nsplitverts);
+        for (int i = 0; i < nsplitverts; i++)
+            snap->thetaCover[i] = cover->theta[cover->visMeshToCoverMesh(i)];
+        snap->scalesCover = cover->scales;
+        if (cover_shading_state == CS_CONNECTION_ENERGY)
+            cover->fs->connectionEnergy(snap->connectionEnergyCover, 0., params);
+        if (cover_shading_state == CS_GRAD_DEVIATION)
+            cover->gradThetaDeviation(snap->gradDeviationCover);
+        snap->deletedFacesCover.resize(cover->fs->nFaces());
+        for (int i = 0; i < cover->fs->nFaces(); i++)
+            snap->deletedFacesCover[i] = cover->fs->isFaceDeleted(i);
     }
     else
     {
-        renderQCover.resize(0, 3);
-        renderFCover.resize(0, 3);
-        edgePtsCover.resize(0, 3);
-        edgeSegsCover.resize(0, 2);
-        edgeColorsCover.resize(0, 3);
-        cutPos1Cover.resize(0, 3);
-        cutPos2Cover.resize(0, 3);
-        cutColorsCover.resize(0, 3);
-        pathstarts.resize(0, 3);
-        pathends.resize(0, 3);
+        snap->renderQCover.resize(0, 3);
+        snap->renderFCover.resize(0, 3);
+        snap->edgePtsCover.resize(0, 3);
+        snap->edgeSegsCover.resize(0, 2);
+        snap->edgeColorsCover.resize(0, 3);
+        snap->cutPos1Cover.resize(0, 3);
+        snap->cutPos2Cover.resize(0, 3);
+        snap->cutColorsCover.resize(0, 3);
+        snap->pathstarts.resize(0, 3);
+        snap->pathends.resize(0, 3);
     }
+
+    renderSnapshots.publish(snap);
 }
 
 void WeaveHook::saveRods()
 {
-    traces.exportRodFile(rodFilename.c_str(), weave->fs->nFaces());
+    if (binaryRods)
+        traces.exportBinaryRodFile(rodFilename.c_str(), weave->fs->nFaces());
+    else
+        traces.exportRodFile(rodFilename.c_str(), weave->fs->nFaces());
 }
 
-void WeaveHook::exportForRendering()
-{    
-    std::string rodsName = exportPrefix + std::string(".rod");
-    traces.exportRodFile(rodsName.c_str(), weave->fs->nFaces());
-    std::string rlxName = exportPrefix + std::string(".rlx");
-    serializeVectorField(rlxName);
-    
-    std::string meshName = exportPrefix + std::string("_mesh.obj");
-    igl::writeOBJ(meshName.c_str(), weave->fs->data().V, weave->fs->data().F);
-    std::string fieldName = exportPrefix + std::string("_field.csv");
-    std::ofstream vfs(fieldName.c_str());
-    int nfaces = weave->fs->nFaces();
-    int nfields = weave->fs->nFields();
-    int nverts = weave->fs->nVerts();
-    for(int i=0; i<nfaces; i++)
-    {
-        Eigen::Vector3d centroid(0,0,0);
-        for(int j=0; j<3; j++)
-            centroid += weave->fs->data().V.row( weave->fs->data().F(i,j) ).transpose();
-        centroid /= 3.0;
-        for(int j=0; j<nfields; j++)
-        {
-            Eigen::Vector3d vf = weave->fs->data().Bs[i] * weave->fs->v(i, j);
-            if (vf.norm() != 0.0)
-                vf *= weave->fs->data().averageEdgeLength / vf.norm() * sqrt(3.0) / 6.0;
-            vfs << centroid[0]-vf[0] << ", " << centroid[1]-vf[1] << ", " << centroid[2]-vf[2] << ", " << centroid[0] + vf[0] << ", " << centroid[1] + vf[1] << ", " << centroid[2] + vf[2] << std::endl;                        
-        }
-    }
-
-    if(cover)
-    {
-        for(int i=0; i<2*nfields; i++)
-        {
-            /*std::stringstream ss;
-            ss << exportPrefix << "_s_" << i << ".csv";
-            std::ofstream sfs(ss.str().c_str());
-            for(int j=0; j<nfaces; j++)
-                sfs << cover->s[i*nfaces + j] << ",\t 0,\t0" << std::endl;*/
-                
-            std::stringstream ss2;
-            ss2 << exportPrefix << "_theta_" << i << ".csv";
-            std::ofstream thetafs(ss2.str().c_str());
-            for(int j=0; j<nverts; j++)
-            {
-                thetafs << cover->theta[cover->visMeshToCoverMesh(i*nverts+j)] << ",\t 0,\t0" << std::endl;
-            }
-        }
-
-        std::string coverMeshName = exportPrefix + std::string("_covermesh.obj");
-        igl::writeOBJ(coverMeshName.c_str(), cover->splitMesh().data().V, cover->splitMesh().data().F);
-        for(int i=0; i<2*nfields; i++)
-        {       
-            std::stringstream ssfb;
-            ssfb << exportPrefix << "_facebased_" << i << ".csv";
-            std::ofstream fbfs(ssfb.str().c_str());
-            Eigen::VectorXd connection(nfaces); 
-            Eigen::VectorXd deviation(nfaces);
-            cover->fs->connectionEnergy(connection, 0., params);// make sure calculation per face not per cover...
-            cover->gradThetaDeviation(deviation);
-            for(int j=0; j<nfaces; j++)
-            {
-                int idx = i*nfaces + j;
-                fbfs << cover->scales(idx) << ",\t" << connection(idx) << ",\t" << deviation(idx) << std::endl;
-            }
-        }
-    }
-
-    std::stringstream ss3;
-    ss3 << exportPrefix << "_geoeng" << ".csv";
-    std::ofstream geoengfs(ss3.str().c_str());
-    Eigen::VectorXd energy(nfaces);
-    weave->fs->connectionEnergy(energy, 0, params);
-    for(int i=0; i<nfaces; i++)
-    {
-        geoengfs << energy(i) << ",\t 0,\t0" << std::endl;
-    }
-
-    std::string cutsname = exportPrefix + std::string("_cuts.csv");
-    std::ofstream cfs(cutsname.c_str());
-    int nsegs = nonIdentity1Weave.rows();
-    for(int i=0; i<nsegs; i++)
-    {
-        cfs << nonIdentity1Weave(i,0) << ", " << nonIdentity1Weave(i,1) << ", " << nonIdentity1Weave(i,2) << ", " << nonIdentity2Weave(i, 0) << ", " << nonIdentity2Weave(i,1) << ", " << nonIdentity2Weave(i,2) << std::endl;
-    }
-    std::string singname_topo = exportPrefix + std::string("_toposing.csv");
-    std::ofstream singfs_topo(singname_topo.c_str());
-    int nsing = singularVerts_topo.rows();
-    for(int i=0; i<nsing; i++)
-    {
-        singfs_topo << singularVerts_topo(i,0) << ", " << singularVerts_topo(i,1) << ", " << singularVerts_topo(i,2) << std::endl;
-    }
-    
-    std::string singname_geom = exportPrefix + std::string("_geomsing.csv");
-    std::ofstream singfs(singname_geom.c_str());
-    nsing = singularVerts_geo.rows();
-    for(int i=0; i<nsing; i++)
-    {
-        singfs << singularVerts_geo(i,0) << ", " << singularVerts_geo(i,1) << ", " << singularVerts_geo(i,2) << std::endl;
-    }
-
-    std::string tracename = exportPrefix + std::string("_traces.csv");    
-    traces.exportTraces(tracename.c_str());
-    std::string rattracename = exportPrefix + std::string("_rat_traces.csv");
-    traces.exportForRendering(rattracename.c_str());
+void WeaveHook::convertRodFile()
+{
+    // foo.rodb -> foo.rod
+    std::string textname = rodFilename.substr(0, rodFilename.find_last_of('.')) + std::string(".rod");
+    if (textname == rodFilename)
+        textname += ".txt";
+    if (convertBinaryRodFile(rodFilename.c_str(), textname.c_str()))
+        std::cout << "Wrote " << textname << std::endl;
 }
 
 void WeaveHook::convertToRoSy()
 {
-    if (!weave || rosyN > 0 || desiredRoSyN < 1 || weave->fs->nFields() != 1)
-        return;
-
-    weave->convertToRoSy(desiredRoSyN);
-    ls.clearHandles();
-    weave->handles = ls.handles;
-    rosyN = desiredRoSyN;
+    WeavePipeline::convertToRoSy();
     updateRenderGeometry();
 }
 
 void WeaveHook::splitFromRoSy()
 {
-    if(!weave || rosyN == 0)
-        return;
-    
-    clear();
-    Weave *splitWeave = weave->splitFromRosy(rosyN);
-    delete weave;
-    weave = splitWeave;
-    rosyN = 0;
-    reassignAllPermutations(*weave);    
-    int m = weave->fs->nFields();
-    for (int i = 0; i < weave->fs->Ps_.size(); i++)
-    {
-        bool id = true;
-        for (int j = 0; j < m; j++)
-        {
-            if (weave->fs->Ps(i)(j, j) != 1)
-            {
-                id = false;
-            }
-        }
-        if (!id)
-        {
-            Cut c;
-            std::pair<int, int> cutedge(i, 1);
-            c.path.push_back(cutedge);
-            weave->cuts.push_back(c);
-        }
-    }
-
-    ls.clearHandles();
-    for (int i = 0; i < m; i++)
-    {
-        Handle h;
-        
-        h.face = 0;
-        h.dir = weave->fs->v(0, i);
-        h.field = i;
-
-        ls.addHandle(h);
-    }
-    weave->handles = ls.handles;
-
+    WeavePipeline::splitFromRoSy();
     updateRenderGeometry();
 }
 
 void WeaveHook::clearCuts()
 {
-    weave->cuts.clear();
+    WeavePipeline::clearCuts();
     updateRenderGeometry();
 }
 
 void WeaveHook::wholePipeline()
 {
-    resample();
-    convertToRoSy();
-    simulateOneStep();
-    splitFromRoSy();
-    reassignPermutations();
-    clearCuts();        
-    params.lambdacompat = 100;
-    simulateOneStep();
-    params.lambdacompat = 1;
-    simulateOneStep();
-    params.lambdacompat = 0.01;
-    simulateOneStep();
-    params.lambdacompat = 0.0;
-    simulateOneStep();
-    simulateOneStep();
-    augmentField();    
-    computeFunc();
     numISOLines = 1;
-    roundCovers();
-    drawISOLines();
-    rationalizeTraces();                
+    runPipeline();
+    updateRenderGeometry();
     gui_mode = GUIMode_Enum::WEAVE;
 }
@@ -2,11 +2,10 @@
 #define WEAVEHOOK_H
 
 #include "PhysicsHook.h"
-#include "Weave.h"
-#include "GaussNewton.h"
-#include "LinearSolver.h"
-#include "Traces.h"
+#include "WeavePipeline.h"
 #include <string>
+#include <vector>
+#include <cstdint>
 #include "Surface.h"
 #include <igl/unproject_onto_mesh.h>
 
@@ -21,17 +20,6 @@ enum WeaveShading_Enum {
     WS_CONNECTION_ENERGY
 };
 
-enum LocalFieldIntegration_Enum {
-    LFI_TRIVIAL,     // simple normalization
-    LFI_CURLCORRECT, // local curl correction
-    LFI_SPECTRAL     // our spectral approach
-};
-
-enum GlobalFieldIntegration_Enum {
-    GFI_GN,     // our Gauss-Newton code
-    GFI_MI      // Bommes et al mixed-integer
-};
-
 enum CoverShading_Enum {
     CS_NONE = 0,
     CS_S_VAL,
@@ -45,37 +33,86 @@ enum GUIMode_Enum {
     COVER
 };
 
-enum Solver_Enum {
-    CURLFREE = 0,
-    SMOOTH
+// Everything the viewer draws, as of one updateRenderGeometry(). Never modified once published, so the render thread can
+// read it while the next one is being built.
+struct WeaveRenderSnapshot
+{
+    uint64_t version;
+
+    Eigen::MatrixXd renderQWeave;
+    Eigen::MatrixXi renderFWeave;
+    Eigen::MatrixXd edgePtsWeave;
+    Eigen::MatrixXi edgeSegsWeave;
+    Eigen::MatrixXd edgeColorsWeave;
+    Eigen::MatrixXd cutPos1Weave; // endpoints of cut edges
+    Eigen::MatrixXd cutPos2Weave;
+    Eigen::MatrixXd nonIdentity1Weave; // endpoints of edges with a non-identity permutation
+    Eigen::MatrixXd nonIdentity2Weave;
+    Eigen::MatrixXd singularVerts_topo;
+    // per-face shading inputs
+    Eigen::MatrixXd faceEnergies;
+    Eigen::VectorXd connectionEnergyWeave;
+    std::vector<bool> deletedFacesWeave;
+
+    // traces on the single mesh
+    Eigen::MatrixXd tracestarts;
+    Eigen::MatrixXd traceends;
+    Eigen::MatrixXd tracecolors;
+    Eigen::MatrixXd rattracestarts;
+    Eigen::MatrixXd rattraceends;
+    Eigen::MatrixXd ratcollisions;
+
+    // the cover's split mesh; empty if there is no cover
+    Eigen::MatrixXd renderQCover;
+    Eigen::MatrixXi renderFCover;
+    Eigen::MatrixXd edgePtsCover;
+    Eigen::MatrixXi edgeSegsCover;
+    Eigen::MatrixXd edgeColorsCover;
+    Eigen::MatrixXd cutPos1Cover;
+    Eigen::MatrixXd cutPos2Cover;
+    Eigen::MatrixXd cutColorsCover;
+    // isolines on the split mesh
+    Eigen::MatrixXd pathstarts;
+    Eigen::MatrixXd pathends;
+    // shading inputs
+    Eigen::VectorXd thetaCover; // per split mesh vertex
+    Eigen::VectorXd scalesCover;
+    Eigen::VectorXd connectionEnergyCover;
+    Eigen::VectorXd gradDeviationCover;
+    std::vector<bool> deletedFacesCover;
+};
+
+// The display settings that only change how a snapshot is uploaded to the viewer
+struct WeaveRenderSettings
+{
+    GUIMode_Enum gui_mode;
+    WeaveShading_Enum weave_shading_state;
+    CoverShading_Enum cover_shading_state;
+    bool showTraces;
+    bool showRatTraces;
+    bool showCoverCuts;
+    bool wireframe;
+    int selectionVersion;
+
+    bool operator==(const WeaveRenderSettings &other) const
+    {
+        return gui_mode == other.gui_mode && weave_shading_state == other.weave_shading_state && cover_shading_state == other.cover_shading_state
+            && showTraces == other.showTraces && showRatTraces == other.showRatTraces && showCoverCuts == other.showCoverCuts
+            && wireframe == other.wireframe && selectionVersion == other.selectionVersion;
+    }
 };
 
-class WeaveHook : public PhysicsHook
+// The GUI front end of the pipeline: each stage also refreshes the viewer's render geometry
+class WeaveHook : public PhysicsHook, public WeavePipeline
 {
 public:
-    WeaveHook() : PhysicsHook(), weave(NULL), cover(NULL), vectorScale(1.0), normalizeVectors(true)
+    WeaveHook() : PhysicsHook(), WeavePipeline(), vectorScale(1.0), normalizeVectors(true)
     {
         gui_mode = GUIMode_Enum::WEAVE;
-        solver_mode = Solver_Enum::CURLFREE;
         weave_shading_state = WeaveShading_Enum::WS_NONE;
         cover_shading_state = CoverShading_Enum::CS_NONE;
-        // meshName = "meshes/bunny_coarser.obj";
-//        meshName = "../meshes/sphere_small_regular.obj";
-        meshName = "meshes/sphere.obj";
-        // vectorFieldName = "bunny_coarser_nosing";
-        vectorFieldName = "sphere.rlx";
         rodFilename = "example.rod";
-        exportPrefix = "../final/export/example";
-        params.lambdacompat = 100;
-        params.lambdareg = 1e-3;
-        params.softHandleConstraint = true;
-        params.disableCurlConstraint = false;
-
-        params.vizVectorCurl = 1.; // in field surface, vizualization variable
-        params.vizCorrectionCurl = 0. ; // in field surface, vizualization variable
-        params.vizNormalizeVecs = false;
-        params.vizShowCurlSign = false;
-
+        binaryRods = false;
      //   ls = new LinearSolver();
 
         traceIdx = 0;
@@ -88,9 +125,6 @@ public:
         showSingularities = false;
         wireframe = false;
 
-        targetResolution = 1000;
-    
-        fieldCount = 1;
         handleLocation = Eigen::VectorXi::Zero(2);
         handleParams = Eigen::VectorXd::Zero(3);
         handleParams(0) = 1;
@@ -98,30 +132,21 @@ public:
         handleParams(2) = 1;
 
         showCoverCuts = true;
-        numISOLines = 1;
-        
-        local_field_integration_method = LFI_SPECTRAL;
-        global_field_integration_method = GFI_GN;
-        bommesAniso = 1.0;
-        initSReg = 1e-4;
-        globalSScale = 0.5;
-        globalThetaReg = 1e-4;
-        globalAlternations = 10;
-        globalPowerIters = 10;
-
         showTraces = true;
         showRatTraces = true;
-        extendTrace = 0.;
-        segLen = 0.001;
-        maxCurvature = 0.5;
-        minRodLen = .1;
 
         hideCoverVectors = false;
-        rosyN = 0;
-        desiredRoSyN = 6;
         
         numRandomTraces = 100;
+        randomTraceSeed = 0;
+        traceSeparation = 5.0;
+        traceFilename = "example.trc";
+        singlePrecisionTraces = false;
         advancedMode = false;
+
+        selectionVersion = 0;
+        uploadedVersion = 0;
+        progress = &simProgress;
     }
     
     virtual bool showSimButtons()
@@ -133,9 +158,7 @@ public:
     virtual void drawGUI(igl::opengl::glfw::imgui::ImGuiMenu &menu);
     virtual bool mouseClicked(igl::opengl::glfw::Viewer &viewer, int button);
 
-    void reassignPermutations();
     void normalizeFields();
-    void serializeVectorField(const std::string &filename);
     void deserializeVectorField();    
     void deserializeVectorFieldOld();
     void deserializePaulField();
@@ -143,7 +166,6 @@ public:
     void deserializeVertexField();
     void augmentField();
     void computeFunc();
-    void roundCovers();
     void drawISOLines();
     void resetCutSelection();
     void addCut();
@@ -156,9 +178,12 @@ public:
     void deleteLastTrace();
     void computeTrace();   
     void computeRandomTraces(int numtraces);   
+    void computeEvenlySpacedTraces();
     void rationalizeTraces();
+    void saveTraces();
+    void loadTraces();
     void saveRods();
-    void exportForRendering();
+    void convertRodFile();
     void convertToRoSy();
     void splitFromRoSy();
     void wholePipeline();
@@ -171,22 +196,17 @@ public:
 
     virtual void renderRenderGeometry(igl::opengl::glfw::Viewer &viewer);    
 
-    void setFaceColorsWeave(igl::opengl::glfw::Viewer &viewer);
-    void setFaceColorsCover(igl::opengl::glfw::Viewer &viewer);
+    void setFaceColorsWeave(igl::opengl::glfw::Viewer &viewer, const WeaveRenderSnapshot &snap);
+    void setFaceColorsCover(igl::opengl::glfw::Viewer &viewer, const WeaveRenderSnapshot &snap);
  
-    void drawCuts(igl::opengl::glfw::Viewer &viewer);
+    void drawCuts(igl::opengl::glfw::Viewer &viewer, const WeaveRenderSnapshot &snap);
 
     void showCutVertexSelection(igl::opengl::glfw::Viewer &viewer);
-    void updateSingularVerts(igl::opengl::glfw::Viewer &viewer);
+    void updateSingularVerts(igl::opengl::glfw::Viewer &viewer, const WeaveRenderSnapshot &snap);
+    WeaveRenderSettings renderSettings() const;
 
 private:
-    void clear();
-    std::string meshName;
-    Weave *weave;
-    CoverMesh *cover;
-    SolverParams params;
-
-    TraceSet traces;
+    virtual void clear();
 
     std::vector<std::pair<int, int > > selectedVertices; // (face, vert) pairs
     
@@ -195,29 +215,19 @@ private:
     Eigen::VectorXd handleParams;
     Eigen::VectorXi handleLocation;
 
-    LinearSolver ls;
-
-    Eigen::MatrixXd curFaceEnergies;
-    Eigen::MatrixXd tempFaceEnergies;
-    Eigen::MatrixXd renderQWeave;
-    Eigen::MatrixXi renderFWeave;
-    Eigen::MatrixXd edgePtsWeave;
-    Eigen::MatrixXi edgeSegsWeave;
-    Eigen::MatrixXd edgeColorsWeave;    
-    Eigen::MatrixXd edgePtsCover;
-    Eigen::MatrixXi edgeSegsCover;
-    Eigen::MatrixXd edgeColorsCover;    
     std::vector<Eigen::Vector3d> renderSelectedVertices; // teal selected vertex spheres
+    int selectionVersion; // bumped whenever the selection changes
     VectorVisualizationMode vectorVisMode;
     RoSyVisualizationMode rosyVisMode;
     bool normalizeVectors;
     bool showCoverCuts;
     bool wireframe;
 
-    Eigen::MatrixXd renderQCover;
-    Eigen::MatrixXi renderFCover;
-    
-    Solver_Enum solver_mode;
+    SnapshotBuffer<WeaveRenderSnapshot> renderSnapshots;
+    // what the viewer currently shows; render thread only
+    uint64_t uploadedVersion;
+    WeaveRenderSettings uploadedSettings;
+
     GUIMode_Enum gui_mode;
     WeaveShading_Enum weave_shading_state;
     CoverShading_Enum cover_shading_state;
@@ -227,61 +237,23 @@ private:
     int traceSign;
     int traceFaceId;
     int traceSteps;
-    int targetResolution;
     
     bool showSingularities;
-    Eigen::MatrixXd singularVerts_topo;
-    Eigen::MatrixXd singularVerts_geo;
-    Eigen::MatrixXd nonIdentity1Weave;
-    Eigen::MatrixXd nonIdentity2Weave;
-    Eigen::MatrixXd cutPos1Weave; // endpoints of cut edges
-    Eigen::MatrixXd cutPos2Weave;
-    Eigen::MatrixXd cutPos1Cover;
-    Eigen::MatrixXd cutPos2Cover;
-    Eigen::MatrixXd cutColorsCover;
-
-    std::string vectorFieldName;
-    std::string exportPrefix;
 
     bool showTraces;
     bool showRatTraces;
-    double extendTrace;
-    double segLen;
-    double maxCurvature;
-    double minRodLen;
-    // isolines on the split mesh
-    Eigen::MatrixXd pathstarts;
-    Eigen::MatrixXd pathends;
-    // traces on the single mesh
-    Eigen::MatrixXd tracestarts;
-    Eigen::MatrixXd traceends;
-    Eigen::MatrixXd tracecolors;
     
     std::string rodFilename;
+    bool binaryRods; // save rods in the binary rod format instead of text
 
-    Eigen::MatrixXd rattracestarts;
-    Eigen::MatrixXd rattraceends;
-    Eigen::MatrixXd ratcollisions;
-
-    LocalFieldIntegration_Enum local_field_integration_method;
-    GlobalFieldIntegration_Enum global_field_integration_method;
-
-    int numISOLines;
-    double bommesAniso;
-    double initSReg;
-    double globalSScale;
-    double globalThetaReg;
-    int globalAlternations;
-    int globalPowerIters;
-
-    int fieldCount;
     bool hideCoverVectors;
     
     int numRandomTraces;
+    int randomTraceSeed; // random traces are reproducible for a given seed
+    double traceSeparation; // spacing of evenly spaced traces, in average edge lengths
+    std::string traceFilename;
+    bool singlePrecisionTraces; // store trace barycentrics as float32 when saving
 
-    int rosyN;
-    int desiredRoSyN;
-    
     bool advancedMode;
 };
 
@@ -0,0 +1,781 @@
+#include "WeavePipeline.h"
+#include "Permutations.h"
+#include "Surface.h"
+#include "CoverMesh.h"
+#include "CurlLocalIntegration.h"
+#include "SpectralLocalIntegration.h"
+#include "MIGlobalIntegration.h"
+#include "GNGlobalIntegration.h"
+#include "CsvWriter.h"
+#include "Distance.h"
+#include "Checkpoint.h"
+#include "Profiler.h"
+#include "SolverProgress.h"
+#include "MemoryUsage.h"
+#include <igl/decimate.h>
+#include <igl/upsample.h>
+#include <igl/writeOBJ.h>
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <chrono>
+#include <filesystem>
+
+using namespace std;
+
+WeavePipeline::WeavePipeline() : weave(NULL), cover(NULL), progress(NULL)
+{
+    meshName = "meshes/sphere.obj";
+    vectorFieldName = "sphere.rlx";
+    exportPrefix = "../final/export/example";
+
+    solver_mode = Solver_Enum::CURLFREE;
+    params.lambdacompat = 100;
+    params.lambdareg = 1e-3;
+    params.softHandleConstraint = true;
+    params.disableCurlConstraint = false;
+
+    params.vizVectorCurl = 1.; // in field surface, vizualization variable
+    params.vizCorrectionCurl = 0. ; // in field surface, vizualization variable
+    params.vizNormalizeVecs = false;
+    params.vizShowCurlSign = false;
+
+    fieldCount = 1;
+    rosyN = 0;
+    desiredRoSyN = 6;
+    targetResolution = 1000;
+    writeResampled = true;
+
+    numISOLines = 1;
+    local_field_integration_method = LFI_SPECTRAL;
+    global_field_integration_method = GFI_GN;
+    bommesAniso = 1.0;
+    initSReg = 1e-4;
+    globalSScale = 0.5;
+    globalThetaReg = 1e-4;
+    globalAlternations = 10;
+    globalPowerIters = 10;
+    globalConvergenceTol = 1e-8;
+
+    extendTrace = 0.;
+    segLen = 0.001;
+    maxCurvature = 0.5;
+    minRodLen = .1;
+}
+
+WeavePipeline::~WeavePipeline()
+{
+    delete cover;
+    delete weave;
+}
+
+void WeavePipeline::loadMesh()
+{
+    if (weave)
+        delete weave;
+    weave = new Weave(meshName, fieldCount);    
+    rosyN = 0;
+    clear();    
+}
+
+void WeavePipeline::clear()
+{
+    if (cover)
+        delete cover;
+    cover = NULL;
+    ls.clearHandles();
+    
+    for (int i = 0; i < fieldCount; i++)
+    {
+        Handle h;
+        h.face = 0;
+        Eigen::Vector3d handleVec(sin( ( 2 * 3.1415 * i) / fieldCount), cos( ( 2 * 3.1415 * i) / fieldCount), 0);
+        
+        Eigen::Matrix<double, 3, 2> B = weave->fs->data().Bs[h.face];
+        Eigen::Matrix<double, 2, 3> toBarys = (B.transpose()*B).inverse() * B.transpose();
+
+        h.dir = toBarys * handleVec;
+        h.field = i;
+        ls.addHandle(h);
+    }
+    weave->handles = ls.handles;
+
+    params.edgeWeights = Eigen::VectorXd::Constant(weave->fs->nEdges(), 1);    
+    
+    singularVerts_topo.resize(0,3);
+    singularVerts_geo.resize(0,3);
+    nonIdentity1Weave.resize(0,3);
+    nonIdentity2Weave.resize(0,3);
+
+    weave->fixFields = false;    
+
+    traces.clear();
+}
+
+void WeavePipeline::resample()
+{
+    Eigen::MatrixXd Vcurr = weave->fs->data().V;
+    Eigen::MatrixXi Fcurr  = weave->fs->data().F;
+    while ( Fcurr.rows() < targetResolution * 2)
+    {
+        Eigen::MatrixXd Vtmp = Vcurr;
+        Eigen::MatrixXi Ftmp = Fcurr;
+        igl::upsample(Vtmp, Ftmp, Vcurr, Fcurr);
+    }
+    Eigen::MatrixXd V;
+    Eigen::MatrixXi F;
+    Eigen::VectorXi J;
+    
+    igl::decimate(Vcurr, Fcurr, targetResolution, V, F, J);
+    if (writeResampled)
+        igl::writeOBJ("resampled.obj",V,F);
+
+    // decimation can fold the surface onto itself; report how close it comes
+    Eigen::VectorXd verts(3 * V.rows());
+    for (int i = 0; i < V.rows(); i++)
+        verts.segment<3>(3 * i) = V.row(i).transpose();
+    Eigen::Matrix3Xi faces = F.transpose();
+    std::cout << "Resampled mesh self-distance: " << Distance::meshSelfDistance(verts, faces, std::set<int>()) << std::endl;
+    
+    delete weave;
+    
+    weave = new Weave(V, F, fieldCount); 
+    clear();  
+}
+
+void WeavePipeline::convertToRoSy()
+{
+    if (!weave || rosyN > 0 || desiredRoSyN < 1 || weave->fs->nFields() != 1)
+        return;
+
+    weave->convertToRoSy(desiredRoSyN);
+    ls.clearHandles();
+    weave->handles = ls.handles;
+    rosyN = desiredRoSyN;
+}
+
+void WeavePipeline::solveStep()
+{
+    params.edgeWeights.resize(weave->fs->nEdges());
+    params.edgeWeights.setConstant(1.0);
+    for (int i = 0; i < (int)weave->cuts.size(); i++)
+    {
+        for (int j = 0; j < (int)weave->cuts[i].path.size(); j++)
+        {
+            params.edgeWeights[weave->cuts[i].path[j].first] = 0.0;
+        }
+    }
+    params.rosyN = rosyN; // make this the same...
+
+    int nfaces = weave->fs->data().F.rows();
+    int nfields = weave->fs->nFields();
+
+    if ( solver_mode == Solver_Enum::CURLFREE )
+    {
+        Eigen::VectorXd primal = weave->fs->vectorFields.segment(0, 2*nfaces*nfields);
+        Eigen::VectorXd dual = weave->fs->vectorFields.segment(2*nfaces*nfields, 2*nfaces*nfields);
+
+        const int numDesignIters = 10;
+        ls.takeSomeSteps(*weave, params, primal, dual, rosyN != 0, numDesignIters, progress);
+
+        weave->fs->vectorFields.segment(0, 2*nfaces*nfields) = primal;
+        weave->fs->vectorFields.segment(2*nfaces*nfields, 2*nfaces*nfields) = dual;
+
+
+ //       std::cout << primal.transpose()<< std::endl << primal.norm() << std::endl<< std::endl;
+  //      std::cout << dual.transpose() << std::endl <<dual.norm() << std::endl<< std::endl;
+        std::cout << "primal norm " << primal.norm() << " dual norm " <<dual.norm() <<  std::endl;
+    }
+    else 
+    {
+        Eigen::VectorXd curField = weave->fs->vectorFields.segment(0, 2*nfaces*nfields);
+        weave->fs->vectorFields.setZero();
+        weave->fs->vectorFields.segment(0, 2*nfaces*nfields) = curField;
+        oneStep(*weave, params, progress);
+        faceEnergies(*weave, params, tempFaceEnergies);
+    }
+    Eigen::VectorXd temp;
+    std::cout << "Total Geodesic Energy" << weave->fs->getGeodesicEnergy(temp, params) << std::endl;
+
+    std::cout << "ran a step" << std::endl;
+}
+
+void WeavePipeline::splitFromRoSy()
+{
+    if(!weave || rosyN == 0)
+        return;
+    
+    clear();
+    Weave *splitWeave = weave->splitFromRosy(rosyN);
+    delete weave;
+    weave = splitWeave;
+    rosyN = 0;
+    reassignAllPermutations(*weave);    
+    int m = weave->fs->nFields();
+    for (int i = 0; i < weave->fs->Ps_.size(); i++)
+    {
+        bool id = true;
+        for (int j = 0; j < m; j++)
+        {
+            if (weave->fs->Ps(i)(j, j) != 1)
+            {
+                id = false;
+            }
+        }
+        if (!id)
+        {
+            Cut c;
+            std::pair<int, int> cutedge(i, 1);
+            c.path.push_back(cutedge);
+            weave->cuts.push_back(c);
+        }
+    }
+
+    ls.clearHandles();
+    for (int i = 0; i < m; i++)
+    {
+        Handle h;
+        
+        h.face = 0;
+        h.dir = weave->fs->v(0, i);
+        h.field = i;
+
+        ls.addHandle(h);
+    }
+    weave->handles = ls.handles;
+}
+
+void WeavePipeline::reassignPermutations()
+{
+   // int flipped = reassignCutPermutations(*weave);
+    int flipped = reassignAllPermutations(*weave);
+
+    std::cout << flipped << " permutations changed" << std::endl;
+    findSingularities();
+}
+
+void WeavePipeline::findSingularities()
+{
+    std::vector<std::pair<int, int> > topsingularities;
+    std::vector<std::pair<int, int> > geosingularities;
+    findSingularVertices(*weave, topsingularities, geosingularities);
+    std::cout << "now " << topsingularities.size() << " topological and " << geosingularities.size() << " geometric singularities" << std::endl;
+
+
+    singularVerts_geo = Eigen::MatrixXd::Zero(geosingularities.size(), 3);
+    for (int i = 0; i < geosingularities.size(); i++)
+    {
+//        singularVerts_geo.row(i) = weave->V.row(geosingularities[i]);
+    }
+    singularVerts_topo = Eigen::MatrixXd::Zero(topsingularities.size(), 3);
+    for (int i = 0; i < topsingularities.size(); i++)
+    {
+        singularVerts_topo.row(i) = weave->fs->data().V.row(topsingularities[i].first);
+    }
+
+    std::vector<int> nonIdentityEdges;
+    int m = weave->fs->nFields();
+    for (int i = 0; i < weave->fs->Ps_.size(); i++)
+    {
+        bool id = true;
+        
+        for (int j = 0; j < m; j++)
+        {
+            if (weave->fs->Ps(i)(j, j) != 1)
+            {
+                id = false;
+            }
+        }
+        if (!id)
+        {
+            nonIdentityEdges.push_back(i);  // TODO: Fix viz bug!
+        }
+    }
+    int ncuts = nonIdentityEdges.size();
+    nonIdentity1Weave.resize(ncuts, 3);
+    nonIdentity2Weave.resize(ncuts, 3);
+    for(int i=0; i<ncuts; i++)
+    {
+        Eigen::Vector3d normal(0,0,0);
+        int f0 = weave->fs->data().E(nonIdentityEdges[i], 0);
+        if(f0 != -1)
+            normal += weave->fs->faceNormal(f0);
+        int f1 = weave->fs->data().E(nonIdentityEdges[i], 1);
+        if(f1 != -1)
+            normal += weave->fs->faceNormal(f1);
+        Eigen::Vector3d offset = 0.001*normal/ normal.norm();
+        nonIdentity1Weave.row(i) = weave->fs->data().V.row(weave->fs->data().edgeVerts(nonIdentityEdges[i], 0)) + offset.transpose();
+        nonIdentity2Weave.row(i) = weave->fs->data().V.row(weave->fs->data().edgeVerts(nonIdentityEdges[i], 1)) + offset.transpose();
+    }
+}
+
+void WeavePipeline::clearCuts()
+{
+    weave->cuts.clear();
+}
+
+void WeavePipeline::augmentField()
+{
+    if (cover)
+    {
+        traces.purgeTraces(cover->fs);
+        delete cover;
+        cover = NULL;
+    }
+
+    weave->fs->undeleteAllFaces();
+    
+    if (rosyN)
+    {
+        Weave *splitWeave = weave->splitFromRosy(rosyN);
+//        reassignAllPermutations(*splitWeave);
+
+        std::vector<std::pair<int, int> > topsingularities;
+        std::vector<std::pair<int, int> > geosingularities;
+        findSingularVertices(*splitWeave, topsingularities, geosingularities);
+
+        std::vector<std::pair<int, int> > todelete = topsingularities;
+        for (int i = 0; i < geosingularities.size(); i++)
+            todelete.push_back(geosingularities[i]);
+
+        cover = splitWeave->createCover(todelete);
+        delete splitWeave;
+    }
+    else
+    {
+        std::vector<std::pair<int, int> > topsingularities;
+        std::vector<std::pair<int, int> > geosingularities;
+        findSingularVertices(*weave, topsingularities, geosingularities);
+
+        std::vector<std::pair<int, int> > todelete = topsingularities;
+        for (int i = 0; i < geosingularities.size(); i++)
+            todelete.push_back(geosingularities[i]);
+
+        cover = weave->createCover(todelete);
+    }
+}
+
+void WeavePipeline::computeFunc()
+{
+    if (cover)
+    {
+        LocalFieldIntegration *method;
+        if (local_field_integration_method == LFI_TRIVIAL)
+            method = new TrivialLocalIntegration();
+        else if (local_field_integration_method == LFI_CURLCORRECT)
+            method = new CurlLocalIntegration(initSReg);
+        else if(local_field_integration_method == LFI_SPECTRAL)
+            method = new SpectralLocalIntegration(initSReg);
+        else
+        {
+            assert(!"Unknown local integration method");
+            return;
+        }
+        GlobalFieldIntegration *gmethod;
+        if (global_field_integration_method == GFI_GN)
+            gmethod = new GNGlobalIntegration(globalAlternations, globalPowerIters, globalConvergenceTol);
+        else if(global_field_integration_method == GFI_MI)
+            gmethod = new MIGlobalIntegration(bommesAniso, globalThetaReg, comisoParams);
+
+        cover->integrateField(method, gmethod, globalSScale, progress);
+        delete method;
+        delete gmethod;
+    }
+}
+
+void WeavePipeline::roundCovers()
+{
+    if (cover && numISOLines > 0)
+    {
+        cover->roundAntipodalCovers(numISOLines, comisoParams);
+    }
+}
+
+void WeavePipeline::drawISOLines()
+{
+    if(cover)
+    {
+        traces.purgeTraces(cover->fs);
+        std::vector<Trace> newtraces;
+        cover->recomputeIsolines(numISOLines, newtraces);
+        for (auto it : newtraces)
+            traces.addTrace(it);
+    }
+}
+
+void WeavePipeline::rationalizeTraces()
+{
+    traces.rationalizeTraces(maxCurvature, extendTrace, segLen, minRodLen, progress);
+}
+
+// runs one stage and records how long it took and how much memory it used; false if that left the process over the
+// memory budget, or if the stage was cancelled
+template<typename Stage>
+static bool timeStage(const char *name, std::vector<PipelineStageTiming> *timings, const SolverProgress *progress, Stage stage)
+{
+    resetPeakResidentBytes();
+    auto start = std::chrono::steady_clock::now();
+    {
+        ProfileScope scope(name);
+        stage();
+    }
+    auto end = std::chrono::steady_clock::now();
+    size_t resident = currentResidentBytes();
+    profileCounter("resident bytes", resident);
+    if (timings)
+    {
+        PipelineStageTiming t;
+        t.stage = name;
+        t.seconds = std::chrono::duration<double>(end - start).count();
+        t.residentBytes = resident;
+        t.peakBytes = peakResidentBytes();
+        timings->push_back(t);
+    }
+    if (progressCancelled(progress))
+    {
+        std::cerr << "Cancelled during " << name << std::endl;
+        return false;
+    }
+    return !overMemoryBudget(name);
+}
+
+bool WeavePipeline::designField(std::vector<PipelineStageTiming> *timings)
+{
+    if (!timeStage("resample", timings, progress, [&]() { resample(); }))
+        return false;
+    if (!timeStage("convert to RoSy", timings, progress, [&]() { convertToRoSy(); }))
+        return false;
+    if (!timeStage("RoSy solve", timings, progress, [&]() { solveStep(); }))
+        return false;
+    if (!timeStage("split", timings, progress, [&]() { splitFromRoSy(); }))
+        return false;
+    if (!timeStage("permutations", timings, progress, [&]() { reassignPermutations(); clearCuts(); }))
+        return false;
+    return timeStage("continuation solves", timings, progress, [&]()
+    {
+        params.lambdacompat = 100;
+        solveStep();
+        params.lambdacompat = 1;
+        solveStep();
+        params.lambdacompat = 0.01;
+        solveStep();
+        params.lambdacompat = 0.0;
+        solveStep();
+        solveStep();
+    });
+}
+
+bool WeavePipeline::runPipeline(std::vector<PipelineStageTiming> *timings, bool fromFieldFile)
+{
+    // checkpoint files of each stage, empty if checkpointing is off
+    std::string fieldCheckpoint, integratedCheckpoint, roundedCheckpoint, isolinesCheckpoint;
+    if (!checkpointDir.empty())
+    {
+        CheckpointKey input;
+        if (fromFieldFile)
+        {
+            input.addFile(vectorFieldName);
+        }
+        else
+        {
+            input.add(weave->fs->data().V.data(), weave->fs->data().V.size() * sizeof(double));
+            input.add(weave->fs->data().F.data(), weave->fs->data().F.size() * sizeof(int));
+        }
+        CheckpointKey fieldKey = input;
+        if (!fromFieldFile)
+        {
+            fieldKey.add(fieldCount).add(targetResolution).add(desiredRoSyN).add(int(solver_mode));
+            fieldKey.add(params.lambdacompat).add(params.lambdareg);
+            fieldKey.add(int(params.softHandleConstraint)).add(int(params.disableCurlConstraint));
+            if (solver_mode == SMOOTH)
+                fieldKey.add(params.curlreg);
+        }
+        CheckpointKey integratedKey = fieldKey;
+        integratedKey.add(int(local_field_integration_method)).add(int(global_field_integration_method)).add(initSReg).add(globalSScale);
+        integratedKey.add(globalAlternations).add(globalPowerIters).add(globalConvergenceTol).add(bommesAniso).add(globalThetaReg);
+        CheckpointKey comisoKey;
+        comisoKey.add(comisoParams.reg).add(int(comisoParams.directRounding)).add(int(comisoParams.multipleRounding));
+        comisoKey.add(comisoParams.multipleRoundingThreshold).add(int(comisoParams.localIters)).add(comisoParams.localError);
+        comisoKey.add(int(comisoParams.cgIters)).add(comisoParams.cgError).add(int(comisoParams.finalFull));
+        if (global_field_integration_method == GFI_MI)
+            integratedKey.add(comisoKey);
+        CheckpointKey roundedKey = integratedKey;
+        roundedKey.add(numISOLines).add(comisoKey);
+
+        std::string runDir = checkpointDir + "/" + input.hex();
+        std::error_code ec;
+        std::filesystem::create_directories(runDir, ec);
+        if (ec)
+        {
+            std::cerr << "Couldn't create checkpoint directory " << runDir << ": " << ec.message() << "; not checkpointing" << std::endl;
+        }
+        else
+        {
+            fieldCheckpoint = runDir + "/field-" + fieldKey.hex() + ".rlx";
+            integratedCheckpoint = runDir + "/integrated-" + integratedKey.hex() + ".cvr";
+            roundedCheckpoint = runDir + "/rounded-" + roundedKey.hex() + ".cvr";
+            isolinesCheckpoint = runDir + "/isolines-" + roundedKey.hex() + ".trc";
+        }
+    }
+    auto haveCheckpoint = [](const std::string &filename)
+    {
+        std::error_code ec;
+        return !filename.empty() && std::filesystem::exists(filename, ec);
+    };
+
+    // each stage is restored from its checkpoint only if every stage before it was
+    bool haveField = false;
+    if (haveCheckpoint(fieldCheckpoint))
+    {
+        haveField = deserializeVectorField(fieldCheckpoint);
+        if (haveField)
+        {
+            std::cout << "Restored field from " << fieldCheckpoint << std::endl;
+            findSingularities();
+        }
+        else if (!fromFieldFile)
+        {
+            loadMesh();
+        }
+    }
+    if (!haveField)
+    {
+        if (fromFieldFile)
+        {
+            if (!deserializeVectorField(vectorFieldName))
+                return false;
+        }
+        else if (!designField(timings))
+        {
+            return false;
+        }
+        if (!fieldCheckpoint.empty())
+            writeCheckpoint(fieldCheckpoint, [&](const std::string &f) { return serializeVectorField(f); });
+    }
+
+    if (!timeStage("cover", timings, progress, [&]() { augmentField(); }))
+        return false;
+
+    bool haveRounded = haveField && haveCheckpoint(roundedCheckpoint)
+        && loadCoverCheckpoint(roundedCheckpoint, cover->fs->nVerts(), cover->fs->nFaces(), cover->theta, cover->scales);
+    bool haveIntegrated = haveRounded || (haveField && haveCheckpoint(integratedCheckpoint)
+        && loadCoverCheckpoint(integratedCheckpoint, cover->fs->nVerts(), cover->fs->nFaces(), cover->theta, cover->scales));
+    if (haveIntegrated)
+    {
+        std::cout << "Restored cover functions from " << (haveRounded ? roundedCheckpoint : integratedCheckpoint) << std::endl;
+    }
+    else
+    {
+        bool ok = timeStage("integrate", timings, progress, [&]() { computeFunc(); });
+        // a cancelled integration leaves some components unintegrated
+        if (!integratedCheckpoint.empty() && !progressCancelled(progress))
+            writeCheckpoint(integratedCheckpoint, [&](const std::string &f) { return saveCoverCheckpoint(f, cover->theta, cover->scales); });
+        if (!ok)
+            return false;
+    }
+    if (!haveRounded)
+    {
+        bool ok = timeStage("round", timings, progress, [&]() { roundCovers(); });
+        if (!roundedCheckpoint.empty())
+            writeCheckpoint(roundedCheckpoint, [&](const std::string &f) { return saveCoverCheckpoint(f, cover->theta, cover->scales); });
+        if (!ok)
+            return false;
+    }
+
+    std::vector<const FieldSurface *> surfaces;
+    surfaces.push_back(weave->fs);
+    surfaces.push_back(cover->fs);
+    bool haveIsolines = haveRounded && haveCheckpoint(isolinesCheckpoint) && traces.loadTraces(isolinesCheckpoint.c_str(), surfaces);
+    if (haveIsolines)
+    {
+        std::cout << "Restored isolines from " << isolinesCheckpoint << std::endl;
+    }
+    else
+    {
+        bool ok = timeStage("isolines", timings, progress, [&]() { drawISOLines(); });
+        if (!isolinesCheckpoint.empty())
+            writeCheckpoint(isolinesCheckpoint, [&](const std::string &f) { return traces.saveTraces(f.c_str(), surfaces, false); });
+        if (!ok)
+            return false;
+    }
+
+    return timeStage("rationalize", timings, progress, [&]() { rationalizeTraces(); });
+}
+
+static const int magic = 0x4242;
+
+bool WeavePipeline::serializeVectorField(const std::string &filename)
+{
+    int currentRLXVersion = 2;
+    std::ofstream ofs(filename, ios::binary);
+    ofs.write((char *)&magic, sizeof(int));
+    ofs.write((char *)&currentRLXVersion, sizeof(int));
+    ofs.write((char *)&rosyN, sizeof(int));
+    weave->serialize(ofs);
+    ofs.flush();
+    return bool(ofs);
+}
+
+bool WeavePipeline::deserializeVectorField()
+{
+    return deserializeVectorField(vectorFieldName);
+}
+
+bool WeavePipeline::deserializeVectorField(const std::string &filename)
+{
+    std::ifstream ifs(filename, ios::binary);
+    if (!ifs)
+    {
+        std::cerr << "Cannot open vector field file: " << filename << std::endl;
+        return false;
+    }
+    clear();    
+    int header=0;
+    ifs.read((char *)&header, sizeof(int));
+    if (header != magic)
+    {
+           // old version
+        ifs.clear();
+        ifs.seekg(0);
+        rosyN = 0;
+        weave->deserialize(ifs);
+    }
+    else
+    {
+        int saveversion = 0;
+        ifs.read((char *)&saveversion, sizeof(int));
+        if (saveversion == 1)
+        {
+            char isrosyc=0;
+            ifs.read(&isrosyc, 1);
+            rosyN = (isrosyc ? 3 : 0);
+        }
+        else
+        {
+            ifs.read((char *)&rosyN, sizeof(int));
+        }
+        weave->deserialize(ifs);
+    }
+    if (!ifs)
+    {
+        std::cerr << "Error reading vector field file " << filename << ": file is truncated" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+void WeavePipeline::exportForRendering()
+{    
+    std::string rodsName = exportPrefix + std::string(".rod");
+    traces.exportRodFile(rodsName.c_str(), weave->fs->nFaces());
+    std::string rlxName = exportPrefix + std::string(".rlx");
+    serializeVectorField(rlxName);
+    
+    std::string meshName = exportPrefix + std::string("_mesh.obj");
+    igl::writeOBJ(meshName.c_str(), weave->fs->data().V, weave->fs->data().F);
+    // CSVs are formatted here and written out by the I/O thread
+    std::string fieldName = exportPrefix + std::string("_field.csv");
+    CsvWriter vfs;
+    int nfaces = weave->fs->nFaces();
+    int nfields = weave->fs->nFields();
+    int nverts = weave->fs->nVerts();
+    for(int i=0; i<nfaces; i++)
+    {
+        Eigen::Vector3d centroid(0,0,0);
+        for(int j=0; j<3; j++)
+            centroid += weave->fs->data().V.row( weave->fs->data().F(i,j) ).transpose();
+        centroid /= 3.0;
+        for(int j=0; j<nfields; j++)
+        {
+            Eigen::Vector3d vf = weave->fs->data().Bs[i] * weave->fs->v(i, j);
+            if (vf.norm() != 0.0)
+                vf *= weave->fs->data().averageEdgeLength / vf.norm() * sqrt(3.0) / 6.0;
+            vfs << centroid[0]-vf[0] << ", " << centroid[1]-vf[1] << ", " << centroid[2]-vf[2] << ", " << centroid[0] + vf[0] << ", " << centroid[1] + vf[1] << ", " << centroid[2] + vf[2] << '\n';
+        }
+    }
+    ioQueue.write(fieldName, vfs.release());
+
+    if(cover)
+    {
+        for(int i=0; i<2*nfields; i++)
+        {
+            /*std::stringstream ss;
+            ss << exportPrefix << "_s_" << i << ".csv";
+            std::ofstream sfs(ss.str().c_str());
+            for(int j=0; j<nfaces; j++)
+                sfs << cover->s[i*nfaces + j] << ",\t 0,\t0" << std::endl;*/
+                
+            std::stringstream ss2;
+            ss2 << exportPrefix << "_theta_" << i << ".csv";
+            CsvWriter thetafs;
+            for(int j=0; j<nverts; j++)
+            {
+                thetafs << cover->theta[cover->visMeshToCoverMesh(i*nverts+j)] << ",\t 0,\t0" << '\n';
+            }
+            ioQueue.write(ss2.str(), thetafs.release());
+        }
+
+        std::string coverMeshName = exportPrefix + std::string("_covermesh.obj");
+        igl::writeOBJ(coverMeshName.c_str(), cover->splitMesh().data().V, cover->splitMesh().data().F);
+        CoverDiagnostics diag;
+        cover->computeDiagnostics(params, diag);
+        for(int i=0; i<2*nfields; i++)
+        {       
+            std::stringstream ssfb;
+            ssfb << exportPrefix << "_facebased_" << i << ".csv";
+            CsvWriter fbfs;
+            for(int j=0; j<nfaces; j++)
+            {
+                int idx = i*nfaces + j;
+                fbfs << diag.scales(idx) << ",\t" << diag.connectionEnergy(idx) << ",\t" << diag.gradDeviation(idx) << '\n';
+            }
+            ioQueue.write(ssfb.str(), fbfs.release());
+        }
+    }
+
+    std::stringstream ss3;
+    ss3 << exportPrefix << "_geoeng" << ".csv";
+    CsvWriter geoengfs;
+    Eigen::VectorXd energy(nfaces);
+    weave->fs->connectionEnergy(energy, 0, params);
+    for(int i=0; i<nfaces; i++)
+    {
+        geoengfs << energy(i) << ",\t 0,\t0" << '\n';
+    }
+    ioQueue.write(ss3.str(), geoengfs.release());
+
+    std::string cutsname = exportPrefix + std::string("_cuts.csv");
+    CsvWriter cfs;
+    int nsegs = nonIdentity1Weave.rows();
+    for(int i=0; i<nsegs; i++)
+    {
+        cfs << nonIdentity1Weave(i,0) << ", " << nonIdentity1Weave(i,1) << ", " << nonIdentity1Weave(i,2) << ", " << nonIdentity2Weave(i, 0) << ", " << nonIdentity2Weave(i,1) << ", " << nonIdentity2Weave(i,2) << '\n';
+    }
+    ioQueue.write(cutsname, cfs.release());
+    std::string singname_topo = exportPrefix + std::string("_toposing.csv");
+    CsvWriter singfs_topo;
+    int nsing = singularVerts_topo.rows();
+    for(int i=0; i<nsing; i++)
+    {
+        singfs_topo << singularVerts_topo(i,0) << ", " << singularVerts_topo(i,1) << ", " << singularVerts_topo(i,2) << '\n';
+    }
+    ioQueue.write(singname_topo, singfs_topo.release());
+    
+    std::string singname_geom = exportPrefix + std::string("_geomsing.csv");
+    CsvWriter singfs;
+    nsing = singularVerts_geo.rows();
+    for(int i=0; i<nsing; i++)
+    {
+        singfs << singularVerts_geo(i,0) << ", " << singularVerts_geo(i,1) << ", " << singularVerts_geo(i,2) << '\n';
+    }
+    ioQueue.write(singname_geom, singfs.release());
+
+    std::string tracename = exportPrefix + std::string("_traces.csv");    
+    CsvWriter tracefs;
+    traces.exportTraces(tracefs);
+    ioQueue.write(tracename, tracefs.release());
+    std::string rattracename = exportPrefix + std::string("_rat_traces.csv");
+    CsvWriter rattracefs;
+    traces.exportForRendering(rattracefs);
+    ioQueue.write(rattracename, rattracefs.release());
+}
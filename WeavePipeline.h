@@ -0,0 +1,131 @@
+#ifndef WEAVEPIPELINE_H
+#define WEAVEPIPELINE_H
+
+#include "Weave.h"
+#include "GaussNewton.h"
+#include "LinearSolver.h"
+#include "Traces.h"
+#include "FileWriteQueue.h"
+#include "CoMISoWrapper.h"
+#include <string>
+#include <vector>
+
+class CoverMesh;
+class SolverProgress;
+
+enum LocalFieldIntegration_Enum {
+    LFI_TRIVIAL,     // simple normalization
+    LFI_CURLCORRECT, // local curl correction
+    LFI_SPECTRAL     // our spectral approach
+};
+
+enum GlobalFieldIntegration_Enum {
+    GFI_GN,     // our Gauss-Newton code
+    GFI_MI      // Bommes et al mixed-integer
+};
+
+enum Solver_Enum {
+    CURLFREE = 0,
+    SMOOTH
+};
+
+// Wall-clock time (in seconds) spent in one stage of the pipeline, and the process's memory use over it
+struct PipelineStageTiming
+{
+    std::string stage;
+    double seconds;
+    size_t residentBytes; // resident set size when the stage finished
+    size_t peakBytes;     // peak resident set size during the stage (or since the process started, where the peak can't be reset)
+};
+
+/*
+ * The weaving pipeline (field design on a resampled mesh, cover construction, integration, isoline extraction and
+ * rod rationalization) together with the state it operates on. Does not depend on the viewer, so it can be driven
+ * from the GUI (WeaveHook) or from the headless batch executable.
+ */
+class WeavePipeline
+{
+public:
+    WeavePipeline();
+    virtual ~WeavePipeline();
+
+    // replaces the current weave by the mesh in meshName
+    void loadMesh();
+    // resets handles, cuts, cover and traces on the current weave
+    virtual void clear();
+
+    void resample();
+    void convertToRoSy();
+    void solveStep();
+    void splitFromRoSy();
+    void reassignPermutations();
+    // locates the singular vertices and the edges with non-identity permutations, for display and export
+    void findSingularities();
+    void clearCuts();
+    void augmentField();
+    void computeFunc();
+    void roundCovers();
+    void drawISOLines();
+    void rationalizeTraces();
+
+    // resample -> RoSy -> solve -> split -> permutations -> continuation solves. Returns false if a stage leaves the
+    // process over the memory budget (see MemoryUsage.h), or if progress is cancelled.
+    bool designField(std::vector<PipelineStageTiming> *timings = NULL);
+    // Designs a field on the current mesh (or, if fromFieldFile, loads the one in vectorFieldName), then
+    // cover -> integrate -> round -> isolines -> rationalize. With a checkpointDir, the field, the integrated and
+    // rounded cover functions and the isolines are saved under a run directory keyed by the input, each file keyed by
+    // a hash of the parameters up to that stage, and the run resumes after the last stage with a valid checkpoint.
+    // Returns false if the field file can't be read, if a stage leaves the process over the memory budget, or if
+    // progress is cancelled; the checkpoints of the stages that completed are kept.
+    bool runPipeline(std::vector<PipelineStageTiming> *timings = NULL, bool fromFieldFile = false);
+
+    bool serializeVectorField(const std::string &filename);
+    bool deserializeVectorField();
+    bool deserializeVectorField(const std::string &filename);
+    void exportForRendering();
+
+    std::string meshName;
+    std::string vectorFieldName;
+    std::string exportPrefix;
+    std::string checkpointDir; // empty to disable checkpointing
+
+    Weave *weave;
+    CoverMesh *cover;
+    SolverParams params;
+    Solver_Enum solver_mode;
+    LinearSolver ls;
+    TraceSet traces;
+    FileWriteQueue ioQueue; // exports write their files through this, off the calling thread
+    SolverProgress *progress; // if not NULL, the solves, integration and rationalization report to and can be cancelled through this
+
+    int fieldCount;
+    int rosyN;
+    int desiredRoSyN;
+    int targetResolution;
+    bool writeResampled; // resample() also saves the resampled mesh to resampled.obj in the working directory
+
+    LocalFieldIntegration_Enum local_field_integration_method;
+    GlobalFieldIntegration_Enum global_field_integration_method;
+    int numISOLines;
+    double bommesAniso;
+    double initSReg;
+    double globalSScale;
+    double globalThetaReg;
+    ComisoParams comisoParams; // for the mixed-integer integration and the rounding of the covers
+    int globalAlternations;
+    int globalPowerIters;
+    double globalConvergenceTol;
+
+    double extendTrace;
+    double segLen;
+    double maxCurvature;
+    double minRodLen;
+
+    Eigen::MatrixXd tempFaceEnergies; // per-face energies of the last Dirichlet solve
+    Eigen::MatrixXd singularVerts_topo;
+    Eigen::MatrixXd singularVerts_geo;
+    Eigen::MatrixXd nonIdentity1Weave; // endpoints of edges with a non-identity permutation
+    Eigen::MatrixXd nonIdentity2Weave;
+};
+
+#endif
@@ -0,0 +1,393 @@
+#include "PipelineOptions.h"
+#include "CoverMesh.h"
+#include "CsvWriter.h"
+#include "Parallel.h"
+#include "Profiler.h"
+#include "MemoryUsage.h"
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <chrono>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <new>
+
+// Runs the weaving pipeline on every job of a manifest, several jobs at a time:
+//
+//   relax-field_batch --manifest FILE [--cores N] [--summary FILE] [--verbose 0|1] [--config FILE] [--option value ...]
+//
+// Each non-empty manifest line is one job, given as "option value" pairs on one line (# starts a comment), e.g.
+//
+//   mesh meshes/bunny.obj resolution 30000 export out/bunny threads 8
+//
+// Options on the command line (and in --config files) apply to every job, and a job's own options override them. A
+// job's threads option is its share of the --cores (all by default) the batch may use: jobs are started largest share
+// first, as soon as enough cores are free, so small meshes run many at once while big ones get the whole machine.
+// Jobs without an export prefix are not exported. When all jobs are done, a summary of each job's stage timings,
+// energies and singularity counts is written as CSV.
+
+static void usage(const char *name)
+{
+    std::cerr << "Usage: " << name << " --manifest FILE [--cores N] [--summary FILE] [--verbose 0|1] [--config FILE] [--option value ...]" << std::endl
+        << "  manifest FILE         one job per line, as \"option value\" pairs" << std::endl
+        << "  cores N               cores shared by the running jobs (all by default)" << std::endl
+        << "  summary FILE          summary CSV (batch_summary.csv)" << std::endl
+        << "  verbose 0|1           show the pipeline's own output (0)" << std::endl
+        << "Job options (threads defaults to 1; profile and memory-budget apply to the whole batch and can't be set per job):" << std::endl;
+    printPipelineOptions(std::cerr);
+}
+
+struct BatchJob
+{
+    int line;               // in the manifest
+    PipelineOptionList options; // the batch-wide options followed by the job's own
+    int threads;
+
+    // results
+    bool ok;
+    std::string error;
+    double seconds;
+    std::vector<PipelineStageTiming> timings;
+    int faces;
+    double geodesicEnergy;
+    double gradDeviation; // mean over the cover's faces of the angle between grad theta and the field
+    int topologicalSingularities;
+    int geometricSingularities;
+    int rods;
+    int collisions;
+    std::string meshName;
+};
+
+static bool readManifest(const char *filename, const PipelineOptionList &defaults, int defaultThreads, std::vector<BatchJob> &jobs)
+{
+    std::ifstream ifs(filename);
+    if (!ifs)
+    {
+        std::cerr << "Couldn't open manifest " << filename << std::endl;
+        return false;
+    }
+    std::string line;
+    int lineno = 0;
+    while (std::getline(ifs, line))
+    {
+        lineno++;
+        line = line.substr(0, line.find('#'));
+        std::istringstream ss(line);
+        std::vector<std::string> tokens;
+        std::string token;
+        while (ss >> token)
+            tokens.push_back(token);
+        if (tokens.empty())
+            continue;
+        if (tokens.size() % 2 != 0)
+        {
+            std::cerr << filename << ":" << lineno << ": options must come in \"option value\" pairs" << std::endl;
+            return false;
+        }
+
+        BatchJob job;
+        job.line = lineno;
+        job.options = defaults;
+        job.options.insert(job.options.begin(), std::make_pair(std::string("threads"), std::to_string(defaultThreads)));
+        for (size_t i = 0; i < tokens.size(); i += 2)
+        {
+            if (tokens[i] == "profile" || tokens[i] == "memory-budget")
+            {
+                std::cerr << filename << ":" << lineno << ": " << tokens[i] << " applies to the whole batch" << std::endl;
+                return false;
+            }
+            job.options.push_back(std::make_pair(tokens[i], tokens[i + 1]));
+        }
+
+        // check the options now rather than when the job starts
+        WeavePipeline scratch;
+        PipelineRunOptions run;
+        for (auto &it : job.options)
+        {
+            if (!setPipelineOption(scratch, run, it.first, it.second))
+            {
+                std::cerr << filename << ":" << lineno << ": bad option \"" << it.first << " " << it.second << "\"" << std::endl;
+                return false;
+            }
+        }
+        job.threads = run.threads;
+        job.meshName = scratch.meshName;
+        job.ok = false;
+        job.seconds = 0;
+        job.faces = 0;
+        job.geodesicEnergy = 0;
+        job.gradDeviation = 0;
+        job.topologicalSingularities = 0;
+        job.geometricSingularities = 0;
+        job.rods = 0;
+        job.collisions = 0;
+        jobs.push_back(job);
+    }
+    return true;
+}
+
+static void runJob(BatchJob &job)
+{
+    auto start = std::chrono::steady_clock::now();
+    try
+    {
+        WeavePipeline pipeline;
+        setWholePipelineDefaults(pipeline);
+        pipeline.exportPrefix.clear();
+        // concurrent jobs would all write the same resampled.obj
+        pipeline.writeResampled = false;
+        PipelineRunOptions run;
+        for (auto &it : job.options)
+            setPipelineOption(pipeline, run, it.first, it.second);
+        setThreadBudget(job.threads);
+
+        // the weave's loader falls back to a file dialog, which a batch can't wait on
+        if (!std::ifstream(pipeline.meshName))
+        {
+            job.error = "couldn't open mesh";
+        }
+        else
+        {
+            pipeline.loadMesh();
+            if (!run.fieldName.empty())
+                pipeline.vectorFieldName = run.fieldName;
+            if (!pipeline.runPipeline(&job.timings, !run.fieldName.empty()))
+            {
+                job.error = "pipeline stopped (unreadable field or over the memory budget)";
+            }
+            else
+            {
+                if (!pipeline.exportPrefix.empty())
+                {
+                    pipeline.exportForRendering();
+                    pipeline.ioQueue.flush();
+                }
+                job.ok = true;
+                job.faces = pipeline.weave->fs->nFaces();
+                Eigen::VectorXd energy;
+                pipeline.params.rosyN = pipeline.rosyN;
+                job.geodesicEnergy = pipeline.weave->fs->getGeodesicEnergy(energy, pipeline.params);
+                if (pipeline.cover)
+                {
+                    Eigen::VectorXd deviation;
+                    pipeline.cover->gradThetaDeviation(deviation);
+                    if (deviation.size() > 0)
+                        job.gradDeviation = deviation.mean();
+                }
+                job.topologicalSingularities = pipeline.singularVerts_topo.rows();
+                job.geometricSingularities = pipeline.singularVerts_geo.rows();
+                job.rods = pipeline.traces.nRationalizedTraces();
+                job.collisions = pipeline.traces.nCollisions();
+            }
+        }
+    }
+    catch (const std::bad_alloc &)
+    {
+        job.error = "out of memory";
+    }
+    catch (const std::exception &e)
+    {
+        job.error = e.what();
+    }
+    job.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// quotes a CSV field if it needs it
+static std::string csvField(const std::string &s)
+{
+    if (s.find_first_of(",\"\n") == std::string::npos)
+        return s;
+    std::string quoted = "\"";
+    for (char c : s)
+    {
+        if (c == '"')
+            quoted += '"';
+        quoted += c;
+    }
+    return quoted + "\"";
+}
+
+static bool writeSummary(const char *filename, const std::vector<BatchJob> &jobs)
+{
+    // one column per stage, in the order stages first appear
+    std::vector<std::string> stages;
+    for (const BatchJob &job : jobs)
+        for (const PipelineStageTiming &t : job.timings)
+            if (std::find(stages.begin(), stages.end(), t.stage) == stages.end())
+                stages.push_back(t.stage);
+
+    CsvWriter csv(1 << 16);
+    csv << "line,mesh,status,threads,seconds";
+    for (const std::string &stage : stages)
+        csv << "," << csvField(stage + " (s)").c_str();
+    csv << ",faces,geodesic energy,grad deviation,topological singularities,geometric singularities,rods,collisions\n";
+    for (const BatchJob &job : jobs)
+    {
+        csv << job.line << ',' << csvField(job.meshName).c_str() << ',' << csvField(job.ok ? "ok" : job.error).c_str() << ',' << job.threads << ',' << job.seconds;
+        for (const std::string &stage : stages)
+        {
+            csv << ',';
+            for (const PipelineStageTiming &t : job.timings)
+                if (t.stage == stage)
+                    csv << t.seconds;
+        }
+        csv << ',' << job.faces << ',' << job.geodesicEnergy << ',' << job.gradDeviation << ',' << job.topologicalSingularities
+            << ',' << job.geometricSingularities << ',' << job.rods << ',' << job.collisions << '\n';
+    }
+    return csv.writeToFile(filename);
+}
+
+int main(int argc, char *argv[])
+{
+    std::string manifest;
+    std::string summary = "batch_summary.csv";
+    int cores = std::max(1, int(std::thread::hardware_concurrency()));
+    bool verbose = false;
+    PipelineOptionList defaults;
+    WeavePipeline scratch;
+    PipelineRunOptions batchRun;
+
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        if (arg == "-h" || arg == "--help")
+        {
+            usage(argv[0]);
+            return 0;
+        }
+        if (arg.compare(0, 2, "--") != 0 || i + 1 == argc)
+        {
+            usage(argv[0]);
+            return 1;
+        }
+        std::string key = arg.substr(2);
+        std::string value = argv[++i];
+        if (key == "manifest")
+        {
+            manifest = value;
+        }
+        else if (key == "summary")
+        {
+            summary = value;
+        }
+        else if (key == "cores" || key == "verbose")
+        {
+            std::istringstream ss(value);
+            int n;
+            if (!(ss >> n) || n < 0)
+            {
+                std::cerr << "Bad option " << arg << " " << value << std::endl;
+                return 1;
+            }
+            if (key == "cores")
+                cores = std::max(1, n);
+            else
+                verbose = (n != 0);
+        }
+        else if (key == "config")
+        {
+            if (!readPipelineConfig(value.c_str(), defaults))
+                return 1;
+        }
+        else if (setPipelineOption(scratch, batchRun, key, value))
+        {
+            defaults.push_back(std::make_pair(key, value));
+        }
+        else
+        {
+            std::cerr << "Bad option " << arg << " " << value << std::endl;
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (manifest.empty())
+    {
+        usage(argv[0]);
+        return 1;
+    }
+    // replay the config files' options too, so batchRun sees all of them
+    for (auto &it : defaults)
+        setPipelineOption(scratch, batchRun, it.first, it.second);
+
+    std::vector<BatchJob> jobs;
+    if (!readManifest(manifest.c_str(), defaults, 1, jobs))
+        return 1;
+
+    setMemoryBudget(batchRun.memoryBudget);
+    if (!batchRun.profileName.empty())
+        setProfilingEnabled(true);
+
+    // the pipeline's progress messages from concurrent jobs would be interleaved beyond use
+    std::ostream out(std::cout.rdbuf());
+    if (!verbose)
+        std::cout.rdbuf(NULL);
+
+    // largest thread share first; a job asking for 0 (all) or more than the batch has gets every core
+    int njobs = jobs.size();
+    std::vector<int> order(njobs);
+    for (int i = 0; i < njobs; i++)
+    {
+        order[i] = i;
+        if (jobs[i].threads == 0 || jobs[i].threads > cores)
+            jobs[i].threads = cores;
+    }
+    std::stable_sort(order.begin(), order.end(), [&](int a, int b) { return jobs[a].threads > jobs[b].threads; });
+
+    std::mutex mutex;
+    std::condition_variable freed;
+    int freeCores = cores;
+    int finished = 0;
+    std::vector<std::thread> workers;
+    auto start = std::chrono::steady_clock::now();
+    std::vector<int> pending = order;
+    while (!pending.empty())
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        // the first pending job that fits; the largest ones come first, and since no new jobs arrive, they can't starve
+        std::vector<int>::iterator next;
+        freed.wait(lock, [&]()
+        {
+            next = std::find_if(pending.begin(), pending.end(), [&](int j) { return jobs[j].threads <= freeCores; });
+            return next != pending.end();
+        });
+        int j = *next;
+        pending.erase(next);
+        freeCores -= jobs[j].threads;
+        out << "Starting " << jobs[j].meshName << " (line " << jobs[j].line << ") on " << jobs[j].threads << " threads" << std::endl;
+        workers.push_back(std::thread([&, j]()
+        {
+            runJob(jobs[j]);
+            std::lock_guard<std::mutex> doneLock(mutex);
+            freeCores += jobs[j].threads;
+            finished++;
+            out << "[" << finished << "/" << njobs << "] " << jobs[j].meshName << ": " << (jobs[j].ok ? "done" : jobs[j].error)
+                << " in " << jobs[j].seconds << "s" << std::endl;
+            freed.notify_all();
+        }));
+    }
+    for (auto &t : workers)
+        t.join();
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    int nfailed = 0;
+    for (const BatchJob &job : jobs)
+        if (!job.ok)
+            nfailed++;
+    out << njobs - nfailed << " of " << njobs << " jobs succeeded in " << seconds << "s" << std::endl;
+    bool wrote = writeSummary(summary.c_str(), jobs);
+    if (wrote)
+        out << "Wrote summary to " << summary << std::endl;
+    else
+        std::cerr << "Couldn't write summary " << summary << std::endl;
+    if (!batchRun.profileName.empty())
+    {
+        printProfileSummary(out);
+        writeChromeTrace(batchRun.profileName.c_str());
+    }
+    std::cout.rdbuf(out.rdbuf());
+    return (wrote && nfailed == 0) ? 0 : 1;
+}
@@ -0,0 +1,365 @@
+#include "WeavePipeline.h"
+#include "Surface.h"
+#include "CoverMesh.h"
+#include "Permutations.h"
+#include "SpectralLocalIntegration.h"
+#include "GNGlobalIntegration.h"
+#include "MemoryUsage.h"
+#include "Distance.h"
+#include <benchmark/benchmark.h>
+#include <iostream>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+// Times the stages of the weaving pipeline on a set of meshes:
+//
+//   relax-field_benchmark [--benchmark_filter=REGEX ...] [mesh.obj ...]
+//
+// With no meshes given, runs on a few of the bundled ones. Each benchmark is named stage/mesh and reports, besides its
+// time, the throughput in faces of the input mesh per second and the process's peak resident set size so far. The
+// Distance/ benchmarks, which don't depend on a mesh, compare the scalar and batched distance kernels on random pairs. The field,
+// cover, isolines and traces each stage starts from are computed once per mesh, at the mesh's own resolution (no
+// resampling), before the first benchmark that needs them.
+
+#ifndef RELAX_FIELD_MESH_DIR
+#define RELAX_FIELD_MESH_DIR "meshes"
+#endif
+
+// Swallows everything written to std::cout while in scope; the pipeline is chatty, and the benchmark reports also go to
+// std::cout, between runs
+class QuietOutput
+{
+public:
+    QuietOutput() : saved_(std::cout.rdbuf(NULL)) {}
+    ~QuietOutput() { std::cout.rdbuf(saved_); }
+
+private:
+    std::streambuf *saved_;
+};
+
+// A pipeline brought up to the input of every benchmarked stage: designed field, cover with rounded functions,
+// isolines and rationalized traces
+struct BenchmarkMesh
+{
+    WeavePipeline pipeline;
+    Eigen::MatrixXd V;
+    Eigen::MatrixXi F;
+    std::vector<std::pair<int, int> > singularities;
+};
+
+static BenchmarkMesh &benchmarkMesh(const std::string &filename)
+{
+    static std::map<std::string, std::unique_ptr<BenchmarkMesh> > meshes;
+    std::unique_ptr<BenchmarkMesh> &mesh = meshes[filename];
+    if (mesh)
+        return *mesh;
+
+    mesh.reset(new BenchmarkMesh);
+    WeavePipeline &p = mesh->pipeline;
+    p.meshName = filename;
+    p.loadMesh();
+    mesh->V = p.weave->fs->data().V;
+    mesh->F = p.weave->fs->data().F;
+
+    // the Whole Pipeline field design, without resampling and with a single continuation solve
+    p.desiredRoSyN = 6;
+    p.convertToRoSy();
+    p.solveStep();
+    p.splitFromRoSy();
+    p.reassignPermutations();
+    p.clearCuts();
+    p.params.lambdacompat = 0;
+    p.solveStep();
+
+    std::vector<std::pair<int, int> > geosingularities;
+    findSingularVertices(*p.weave, mesh->singularities, geosingularities);
+    mesh->singularities.insert(mesh->singularities.end(), geosingularities.begin(), geosingularities.end());
+
+    p.augmentField();
+    p.computeFunc();
+    p.roundCovers();
+    p.drawISOLines();
+    p.rationalizeTraces();
+    return *mesh;
+}
+
+static void reportCounters(benchmark::State &state, const BenchmarkMesh &mesh)
+{
+    double faces = mesh.F.rows();
+    state.counters["faces"] = faces;
+    state.counters["faces/s"] = benchmark::Counter(faces, benchmark::Counter::kIsIterationInvariantRate);
+    state.counters["peak RSS (MB)"] = peakResidentBytes() / (1024.0 * 1024.0);
+}
+
+static void BM_Surface(benchmark::State &state, std::string filename)
+{
+    QuietOutput quiet;
+    BenchmarkMesh &mesh = benchmarkMesh(filename);
+    for (auto _ : state)
+    {
+        Surface surf(mesh.V, mesh.F);
+        benchmark::DoNotOptimize(surf.data().E.data());
+    }
+    reportCounters(state, mesh);
+}
+
+// the Gauss-Newton metric and Jacobian
+static void BM_OperatorAssembly(benchmark::State &state, std::string filename)
+{
+    QuietOutput quiet;
+    BenchmarkMesh &mesh = benchmarkMesh(filename);
+    const Weave &weave = *mesh.pipeline.weave;
+    for (auto _ : state)
+    {
+        Eigen::SparseMatrix<double> M, J;
+        GNmetric(weave, M);
+        GNGradient(weave, mesh.pipeline.params, J);
+        benchmark::DoNotOptimize(J.valuePtr());
+    }
+    reportCounters(state, mesh);
+}
+
+static void BM_CurlFreeStep(benchmark::State &state, std::string filename)
+{
+    QuietOutput quiet;
+    BenchmarkMesh &mesh = benchmarkMesh(filename);
+    const Weave &weave = *mesh.pipeline.weave;
+    int n = 2 * weave.fs->nFaces() * weave.fs->nFields();
+    Eigen::VectorXd primal = weave.fs->vectorFields.segment(0, n);
+    Eigen::VectorXd dual = weave.fs->vectorFields.segment(n, n);
+    for (auto _ : state)
+        mesh.pipeline.ls.takeSomeSteps(weave, mesh.pipeline.params, primal, dual, false, 1);
+    reportCounters(state, mesh);
+}
+
+static void BM_GaussNewtonStep(benchmark::State &state, std::string filename)
+{
+    QuietOutput quiet;
+    BenchmarkMesh &mesh = benchmarkMesh(filename);
+    for (auto _ : state)
+    {
+        state.PauseTiming();
+        Weave weave(*mesh.pipeline.weave);
+        state.ResumeTiming();
+        oneStep(weave, mesh.pipeline.params);
+    }
+    reportCounters(state, mesh);
+}
+
+static void BM_Cover(benchmark::State &state, std::string filename)
+{
+    QuietOutput quiet;
+    BenchmarkMesh &mesh = benchmarkMesh(filename);
+    for (auto _ : state)
+        delete mesh.pipeline.weave->createCover(mesh.singularities);
+    reportCounters(state, mesh);
+}
+
+// local and global integration of the cover functions, with the pipeline's default methods
+static void BM_Integrate(benchmark::State &state, std::string filename)
+{
+    QuietOutput quiet;
+    BenchmarkMesh &mesh = benchmarkMesh(filename);
+    WeavePipeline &p = mesh.pipeline;
+    // the isoline benchmark starts from the rounded functions
+    Eigen::VectorXd theta = p.cover->theta;
+    Eigen::VectorXd scales = p.cover->scales;
+    for (auto _ : state)
+    {
+        SpectralLocalIntegration lmethod(p.initSReg);
+        GNGlobalIntegration gmethod(p.globalAlternations, p.globalPowerIters, p.globalConvergenceTol);
+        p.cover->integrateField(&lmethod, &gmethod, p.globalSScale);
+    }
+    p.cover->theta = theta;
+    p.cover->scales = scales;
+    reportCounters(state, mesh);
+}
+
+static void BM_Isolines(benchmark::State &state, std::string filename)
+{
+    QuietOutput quiet;
+    BenchmarkMesh &mesh = benchmarkMesh(filename);
+    for (auto _ : state)
+    {
+        std::vector<Trace> isotraces;
+        mesh.pipeline.cover->recomputeIsolines(mesh.pipeline.numISOLines, isotraces);
+        benchmark::DoNotOptimize(isotraces.data());
+    }
+    reportCounters(state, mesh);
+}
+
+static void BM_Rationalize(benchmark::State &state, std::string filename)
+{
+    QuietOutput quiet;
+    BenchmarkMesh &mesh = benchmarkMesh(filename);
+    WeavePipeline &p = mesh.pipeline;
+    for (auto _ : state)
+        p.traces.rationalizeTraces(p.maxCurvature, p.extendTrace, p.segLen, p.minRodLen);
+    state.counters["rods"] = p.traces.nRationalizedTraces();
+    reportCounters(state, mesh);
+}
+
+// Random pairs for the distance kernels, the same on every run; one in eight is degenerate
+static const int distancePairs = 1 << 16;
+
+static const Distance::PointTriangles &randomPointTriangles()
+{
+    static Distance::PointTriangles pairs;
+    if (pairs.size() == 0)
+    {
+        std::mt19937 rng(0);
+        std::uniform_real_distribution<double> coord(-1.0, 1.0);
+        auto point = [&]() { return Eigen::Vector3d(coord(rng), coord(rng), coord(rng)); };
+        for (int i = 0; i < distancePairs; i++)
+        {
+            Eigen::Vector3d p = point(), q0 = point(), q1 = point(), q2 = point();
+            if (i % 8 == 0)
+                q1 = q0;
+            pairs.push_back(p, q0, q1, q2);
+        }
+    }
+    return pairs;
+}
+
+static const Distance::SegmentPairs &randomSegmentPairs()
+{
+    static Distance::SegmentPairs pairs;
+    if (pairs.size() == 0)
+    {
+        std::mt19937 rng(0);
+        std::uniform_real_distribution<double> coord(-1.0, 1.0);
+        auto point = [&]() { return Eigen::Vector3d(coord(rng), coord(rng), coord(rng)); };
+        for (int i = 0; i < distancePairs; i++)
+        {
+            Eigen::Vector3d p0 = point(), p1 = point(), q0 = point(), q1 = point();
+            if (i % 8 == 0)
+                q1 = q0 + (p1 - p0);
+            pairs.push_back(p0, p1, q0, q1);
+        }
+    }
+    return pairs;
+}
+
+static void BM_VertexFaceDistance(benchmark::State &state)
+{
+    const Distance::PointTriangles &pairs = randomPointTriangles();
+    std::vector<double> dist(pairs.size()), q1bary(pairs.size()), q2bary(pairs.size());
+    for (auto _ : state)
+    {
+        for (int i = 0; i < pairs.size(); i++)
+        {
+            Eigen::Vector3d p(pairs.p[0][i], pairs.p[1][i], pairs.p[2][i]);
+            Eigen::Vector3d q0(pairs.q0[0][i], pairs.q0[1][i], pairs.q0[2][i]);
+            Eigen::Vector3d q1(pairs.q1[0][i], pairs.q1[1][i], pairs.q1[2][i]);
+            Eigen::Vector3d q2(pairs.q2[0][i], pairs.q2[1][i], pairs.q2[2][i]);
+            double q0bary;
+            dist[i] = Distance::vertexFaceDistance(p, q0, q1, q2, q0bary, q1bary[i], q2bary[i]).norm();
+        }
+        benchmark::DoNotOptimize(dist.data());
+    }
+    state.SetItemsProcessed(state.iterations() * pairs.size());
+}
+
+static void BM_VertexFaceDistances(benchmark::State &state)
+{
+    const Distance::PointTriangles &pairs = randomPointTriangles();
+    std::vector<double> dist(pairs.size()), q1bary(pairs.size()), q2bary(pairs.size());
+    for (auto _ : state)
+    {
+        Distance::vertexFaceDistances(pairs, dist.data(), q1bary.data(), q2bary.data());
+        benchmark::DoNotOptimize(dist.data());
+    }
+    state.SetItemsProcessed(state.iterations() * pairs.size());
+}
+
+static void BM_EdgeEdgeDistance(benchmark::State &state)
+{
+    const Distance::SegmentPairs &pairs = randomSegmentPairs();
+    std::vector<double> dist(pairs.size()), p1bary(pairs.size()), q1bary(pairs.size());
+    for (auto _ : state)
+    {
+        for (int i = 0; i < pairs.size(); i++)
+        {
+            Eigen::Vector3d p0(pairs.p0[0][i], pairs.p0[1][i], pairs.p0[2][i]);
+            Eigen::Vector3d p1(pairs.p1[0][i], pairs.p1[1][i], pairs.p1[2][i]);
+            Eigen::Vector3d q0(pairs.q0[0][i], pairs.q0[1][i], pairs.q0[2][i]);
+            Eigen::Vector3d q1(pairs.q1[0][i], pairs.q1[1][i], pairs.q1[2][i]);
+            double p0bary, q0bary;
+            dist[i] = Distance::edgeEdgeDistance(p0, p1, q0, q1, p0bary, p1bary[i], q0bary, q1bary[i]).norm();
+        }
+        benchmark::DoNotOptimize(dist.data());
+    }
+    state.SetItemsProcessed(state.iterations() * pairs.size());
+}
+
+static void BM_EdgeEdgeDistances(benchmark::State &state)
+{
+    const Distance::SegmentPairs &pairs = randomSegmentPairs();
+    std::vector<double> dist(pairs.size()), p1bary(pairs.size()), q1bary(pairs.size());
+    for (auto _ : state)
+    {
+        Distance::edgeEdgeDistances(pairs, dist.data(), p1bary.data(), q1bary.data());
+        benchmark::DoNotOptimize(dist.data());
+    }
+    state.SetItemsProcessed(state.iterations() * pairs.size());
+}
+
+int main(int argc, char *argv[])
+{
+    benchmark::Initialize(&argc, argv);
+
+    std::vector<std::string> meshes;
+    for (int i = 1; i < argc; i++)
+        meshes.push_back(argv[i]);
+    if (meshes.empty())
+    {
+        meshes.push_back(RELAX_FIELD_MESH_DIR "/icosahedron.obj");
+        meshes.push_back(RELAX_FIELD_MESH_DIR "/sphere_small.obj");
+        meshes.push_back(RELAX_FIELD_MESH_DIR "/bunny_coarser.obj");
+    }
+
+    benchmark::RegisterBenchmark("Distance/VertexFace/scalar", BM_VertexFaceDistance)->Unit(benchmark::kMicrosecond);
+    benchmark::RegisterBenchmark("Distance/VertexFace/batched", BM_VertexFaceDistances)->Unit(benchmark::kMicrosecond);
+    benchmark::RegisterBenchmark("Distance/EdgeEdge/scalar", BM_EdgeEdgeDistance)->Unit(benchmark::kMicrosecond);
+    benchmark::RegisterBenchmark("Distance/EdgeEdge/batched", BM_EdgeEdgeDistances)->Unit(benchmark::kMicrosecond);
+
+    typedef void (*StageBenchmark)(benchmark::State &, std::string);
+    const std::pair<const char *, StageBenchmark> stages[] =
+    {
+        { "Surface", BM_Surface },
+        { "OperatorAssembly", BM_OperatorAssembly },
+        { "CurlFreeStep", BM_CurlFreeStep },
+        { "GaussNewtonStep", BM_GaussNewtonStep },
+        { "Cover", BM_Cover },
+        { "Integrate", BM_Integrate },
+        { "Isolines", BM_Isolines },
+        { "Rationalize", BM_Rationalize },
+    };
+
+    for (const std::string &filename : meshes)
+    {
+        // the weave's loader falls back to a file dialog, which we don't want here
+        if (!std::ifstream(filename))
+        {
+            std::cerr << "Couldn't open mesh " << filename << std::endl;
+            return 1;
+        }
+        std::string name = filename.substr(filename.find_last_of("/\\") + 1);
+        for (const auto &stage : stages)
+        {
+            std::string benchmarkName = std::string(stage.first) + "/" + name;
+            // the stages run their loops in parallel, so CPU time would overstate them
+            benchmark::RegisterBenchmark(benchmarkName.c_str(), stage.second, filename)
+                ->Unit(benchmark::kMillisecond)
+                ->UseRealTime();
+        }
+    }
+
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+    return 0;
+}
@@ -0,0 +1,114 @@
+#include "PipelineOptions.h"
+#include "Parallel.h"
+#include "Profiler.h"
+#include "MemoryUsage.h"
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <chrono>
+
+// Runs the whole weaving pipeline without a viewer, for batch jobs on machines with no display:
+//
+//   relax-field_headless [--config FILE] [--option value ...]
+//
+// A config file holds one "option value" pair per line (no leading dashes; # starts a comment). Options given on
+// the command line are applied in order, so they override earlier ones from a config file.
+
+static void usage(const char *name)
+{
+    std::cerr << "Usage: " << name << " [--config FILE] [--option value ...]" << std::endl;
+    printPipelineOptions(std::cerr);
+}
+
+int main(int argc, char *argv[])
+{
+    WeavePipeline pipeline;
+    setWholePipelineDefaults(pipeline);
+    PipelineRunOptions run;
+
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        if (arg == "-h" || arg == "--help")
+        {
+            usage(argv[0]);
+            return 0;
+        }
+        if (arg.compare(0, 2, "--") != 0 || i + 1 == argc)
+        {
+            usage(argv[0]);
+            return 1;
+        }
+        std::string key = arg.substr(2);
+        std::string value = argv[++i];
+        if (key == "config")
+        {
+            PipelineOptionList options;
+            if (!readPipelineConfig(value.c_str(), options))
+                return 1;
+            for (auto &it : options)
+                setPipelineOption(pipeline, run, it.first, it.second);
+        }
+        else if (!setPipelineOption(pipeline, run, key, value))
+        {
+            std::cerr << "Bad option " << arg << " " << value << std::endl;
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    // the weave's loader falls back to a file dialog, which a batch node can't show
+    if (!std::ifstream(pipeline.meshName))
+    {
+        std::cerr << "Couldn't open mesh " << pipeline.meshName << std::endl;
+        return 1;
+    }
+
+    setThreadBudget(run.threads);
+    setMemoryBudget(run.memoryBudget);
+    if (!run.profileName.empty())
+        setProfilingEnabled(true);
+
+    auto start = std::chrono::steady_clock::now();
+    std::vector<PipelineStageTiming> timings;
+    pipeline.loadMesh();
+    if (!run.fieldName.empty())
+        pipeline.vectorFieldName = run.fieldName;
+    if (!pipeline.runPipeline(&timings, !run.fieldName.empty()))
+    {
+        std::cerr << "Stopped after:" << std::endl;
+        for (const PipelineStageTiming &t : timings)
+            std::cerr << "  " << t.stage << ": " << t.seconds << "s, " << (t.residentBytes >> 20) << " MB resident, " << (t.peakBytes >> 20) << " MB peak" << std::endl;
+        return 1;
+    }
+
+    resetPeakResidentBytes();
+    auto exportStart = std::chrono::steady_clock::now();
+    {
+        ProfileScope exportScope("export");
+        pipeline.exportForRendering();
+        pipeline.ioQueue.flush();
+    }
+    auto end = std::chrono::steady_clock::now();
+    PipelineStageTiming exportTiming;
+    exportTiming.stage = "export";
+    exportTiming.seconds = std::chrono::duration<double>(end - exportStart).count();
+    exportTiming.residentBytes = currentResidentBytes();
+    exportTiming.peakBytes = peakResidentBytes();
+    timings.push_back(exportTiming);
+
+    std::cout << "Wove " << pipeline.meshName << " into " << pipeline.traces.nRationalizedTraces() << " rods; stage timings:" << std::endl;
+    for (const PipelineStageTiming &t : timings)
+        std::cout << "  " << t.stage << ": " << t.seconds << "s, " << (t.residentBytes >> 20) << " MB resident, " << (t.peakBytes >> 20) << " MB peak" << std::endl;
+    std::cout << "  total: " << std::chrono::duration<double>(end - start).count() << "s" << std::endl;
+
+    if (!run.profileName.empty())
+    {
+        std::cout << std::endl;
+        printProfileSummary(std::cout);
+        if (!writeChromeTrace(run.profileName.c_str()))
+            return 1;
+        std::cout << "Wrote trace to " << run.profileName << std::endl;
+    }
+    return 0;
+}
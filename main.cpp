@@ -73,6 +73,8 @@ bool drawGUI(igl::opengl::glfw::imgui::ImGuiMenu &menu)
             {
                 resetSimulation();
             }
+            const SolverProgress &progress = hook->stepProgress();
+            ImGui::ProgressBar(progress.fraction(), ImVec2(-1, 0), progress.stage());
         }
     }
     hook->drawGUI(menu);